@@ -0,0 +1,100 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bench
+{
+
+/// A single benchmark measurement
+struct result
+{
+    std::string name;
+    size_t iterations{};
+    double ns_per_iteration{};
+    /// custom named values reported by the benchmark
+    std::vector<std::pair<std::string, double>> counters;
+};
+
+/// A minimal benchmark runner with machine readable output
+class suite
+{
+public:
+    using clock_t = std::chrono::steady_clock;
+
+    //-----------------------------------------------------------------------------
+    /// Runs the callable a number of times and records the average time.
+    //-----------------------------------------------------------------------------
+    template<typename F>
+    result& run(const std::string& name, size_t iterations, F&& f)
+    {
+        // warm up caches and allocators
+        f();
+
+        auto start = clock_t::now();
+        for(size_t i = 0; i < iterations; ++i)
+        {
+            f();
+        }
+        auto end = clock_t::now();
+
+        results_.emplace_back();
+        auto& res = results_.back();
+        res.name = name;
+        res.iterations = iterations;
+        auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+        res.ns_per_iteration = double(dur.count()) / double(iterations);
+        return res;
+    }
+
+    //-----------------------------------------------------------------------------
+    /// Records a result without timing, used for pure metrics.
+    //-----------------------------------------------------------------------------
+    result& record(const std::string& name)
+    {
+        results_.emplace_back();
+        auto& res = results_.back();
+        res.name = name;
+        return res;
+    }
+
+    std::string to_json() const
+    {
+        std::stringstream ss;
+        ss << "{\n  \"benchmarks\": [";
+        for(size_t i = 0; i < results_.size(); ++i)
+        {
+            const auto& res = results_[i];
+            ss << (i == 0 ? "\n" : ",\n");
+            ss << "    {\"name\": \"" << res.name << "\""
+               << ", \"iterations\": " << res.iterations
+               << ", \"ns_per_iteration\": " << res.ns_per_iteration;
+            for(const auto& counter : res.counters)
+            {
+                ss << ", \"" << counter.first << "\": " << counter.second;
+            }
+            ss << "}";
+        }
+        ss << "\n  ]\n}\n";
+        return ss.str();
+    }
+
+private:
+    std::vector<result> results_;
+};
+
+//-----------------------------------------------------------------------------
+/// Keeps the compiler from optimizing away the benchmarked work.
+//-----------------------------------------------------------------------------
+template<typename T>
+inline void do_not_optimize(const T& value)
+{
+    static const void* volatile sink{};
+    sink = &value;
+}
+
+}
@@ -0,0 +1,91 @@
+#include "bench.h"
+
+#include <videopp/draw_list.h>
+
+#include <array>
+#include <functional>
+
+namespace
+{
+
+/// Layout of draw_cmd before the texture slots, clip rect
+/// and program setup were moved to the draw_list side tables.
+struct legacy_draw_cmd
+{
+    gfx::primitive_type type{};
+    gfx::draw_type dr_type{};
+    gfx::blending_mode blend{};
+    std::uint32_t indices_offset{};
+    std::uint32_t indices_count{};
+    std::uint32_t vertices_offset{};
+    std::uint32_t vertices_count{};
+    gfx::rect clip_rect{};
+    gfx::gpu_program program{};
+    std::function<math::transformf()> get_gpu_transform;
+    std::function<void(const gfx::gpu_context&)> begin;
+    std::function<void(const gfx::gpu_context&)> end;
+    uint64_t uniforms_hash{};
+    std::array<gfx::texture_view, 32> texture_slots{{}};
+    uint8_t used_slots{};
+    uint64_t hash{};
+    size_t subcount{};
+};
+
+size_t command_bytes(const gfx::draw_list& list)
+{
+    return list.commands.size() * sizeof(gfx::draw_cmd) +
+           list.texture_slots.size() * sizeof(gfx::texture_view) +
+           list.clip_sets.size() * sizeof(gfx::rect);
+}
+
+void record_interleaved(gfx::draw_list& list, const std::vector<gfx::texture_view>& textures, size_t count)
+{
+    // images interleaved with rects never batch, so every
+    // request ends up as a separate command
+    for(size_t i = 0; i < count; ++i)
+    {
+        const auto& tex = textures[i % textures.size()];
+        int x = int(i % 64) * 16;
+        int y = int(i / 64) * 16;
+        list.add_image(tex, gfx::rect{x, y, 16, 16});
+        list.add_rect(gfx::rect{x, y, 4, 4}, gfx::color::red());
+    }
+}
+
+}
+
+void run_draw_cmd_bench(bench::suite& suite)
+{
+    std::vector<gfx::texture_view> textures;
+    for(uint32_t i = 1; i <= 8; ++i)
+    {
+        textures.emplace_back(gfx::texture_view::create(i, 64, 64));
+    }
+
+    for(size_t count : {size_t(256), size_t(4096)})
+    {
+        gfx::draw_list list(false);
+        record_interleaved(list, textures, count);
+
+        auto& sizes = suite.record("draw_cmd/bytes_per_command/" + std::to_string(count));
+        sizes.counters.emplace_back("legacy_bytes_per_command", double(sizeof(legacy_draw_cmd)));
+        sizes.counters.emplace_back("sizeof_draw_cmd", double(sizeof(gfx::draw_cmd)));
+        sizes.counters.emplace_back("bytes_per_command", double(command_bytes(list)) / double(list.commands.size()));
+        sizes.counters.emplace_back("commands", double(list.commands.size()));
+
+        suite.run("draw_cmd/record/" + std::to_string(count), 100, [&]()
+        {
+            list.clear();
+            record_interleaved(list, textures, count);
+            bench::do_not_optimize(list);
+        });
+
+        gfx::draw_list merged(false);
+        suite.run("draw_cmd/add_list/" + std::to_string(count), 100, [&]()
+        {
+            merged.clear();
+            merged.add_list(list);
+            bench::do_not_optimize(merged);
+        });
+    }
+}
@@ -0,0 +1,98 @@
+#include "bench.h"
+
+#include <videopp/draw_list.h>
+
+namespace
+{
+
+std::string with_count(const std::string& name, size_t count)
+{
+    return name + "/" + std::to_string(count);
+}
+
+void add_list_counters(bench::result& res, const gfx::draw_list& list, size_t count)
+{
+    res.counters.emplace_back("ns_per_primitive", res.ns_per_iteration / double(count));
+    res.counters.emplace_back("commands", double(list.commands.size()));
+    res.counters.emplace_back("vertices", double(list.vertices.size() + list.compact_vertices.size()));
+    res.counters.emplace_back("indices", double(list.indices.size()));
+}
+
+}
+
+void run_draw_list_bench(bench::suite& suite)
+{
+    std::vector<gfx::texture_view> textures;
+    for(uint32_t i = 1; i <= 8; ++i)
+    {
+        textures.emplace_back(gfx::texture_view::create(i, 64, 64));
+    }
+
+    gfx::draw_list list(false);
+
+    for(size_t count : {size_t(100), size_t(1000), size_t(10000)})
+    {
+        auto& rects = suite.run(with_count("draw_list/add_rect", count), 100, [&]()
+        {
+            list.clear();
+            for(size_t i = 0; i < count; ++i)
+            {
+                list.add_rect(gfx::rect{int(i % 100) * 8, int(i / 100) * 8, 6, 6}, gfx::color::red());
+            }
+            bench::do_not_optimize(list);
+        });
+        add_list_counters(rects, list, count);
+
+        auto& images = suite.run(with_count("draw_list/add_image", count), 100, [&]()
+        {
+            list.clear();
+            for(size_t i = 0; i < count; ++i)
+            {
+                list.add_image(textures[i % textures.size()], gfx::rect{int(i % 100) * 8, int(i / 100) * 8, 8, 8});
+            }
+            bench::do_not_optimize(list);
+        });
+        add_list_counters(images, list, count);
+
+        math::transformf transform{};
+        transform.rotate(0.0f, 0.0f, math::radians(15.0f));
+        auto& transformed = suite.run(with_count("draw_list/add_image_transformed", count), 100, [&]()
+        {
+            list.clear();
+            for(size_t i = 0; i < count; ++i)
+            {
+                transform.set_position(float(i % 100) * 8.0f, float(i / 100) * 8.0f, 0.0f);
+                list.add_image(textures[i % textures.size()], gfx::rect{0, 0, 64, 64}, gfx::rect{0, 0, 8, 8}, transform);
+            }
+            bench::do_not_optimize(list);
+        });
+        add_list_counters(transformed, list, count);
+    }
+
+    for(size_t points : {size_t(16), size_t(256), size_t(4096)})
+    {
+        gfx::polyline line;
+        for(size_t i = 0; i < points; ++i)
+        {
+            line.line_to({float(i), float((i * 37) % 100)});
+        }
+
+        auto& stroke = suite.run(with_count("draw_list/add_polyline", points), 100, [&]()
+        {
+            list.clear();
+            list.add_polyline(line, gfx::color::white(), false, 2.0f);
+            bench::do_not_optimize(list);
+        });
+        add_list_counters(stroke, list, points);
+
+        gfx::polyline convex;
+        convex.ellipse({500.0f, 500.0f}, {400.0f, 300.0f}, points);
+        auto& filled = suite.run(with_count("draw_list/add_polyline_filled_convex", points), 100, [&]()
+        {
+            list.clear();
+            list.add_polyline_filled_convex(convex, gfx::color::white());
+            bench::do_not_optimize(list);
+        });
+        add_list_counters(filled, list, points);
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <videopp/font.h>
+#include <videopp/glyph_range.h>
+#include <videopp/ttf_font.h>
+
+#include <memory>
+#include <string>
+
+namespace bench
+{
+
+//-----------------------------------------------------------------------------
+/// Creates the embedded font without a renderer. It has no texture,
+/// so it serves only layout and recording benchmarks.
+//-----------------------------------------------------------------------------
+inline gfx::font_ptr create_font(float size)
+{
+    auto font = std::make_shared<gfx::font>();
+    static_cast<gfx::font_info&>(*font) = gfx::create_default_font(size);
+    return font;
+}
+
+//-----------------------------------------------------------------------------
+/// Creates a latin ttf font with its kerning pairs loaded, without a renderer.
+//-----------------------------------------------------------------------------
+inline gfx::font_ptr create_kerned_font(float size)
+{
+    gfx::font_desc_file desc;
+    desc.path = DATA "fonts/wds052801.ttf";
+    desc.desc.codepoint_ranges = gfx::get_latin_glyph_range();
+    desc.desc.font_size = size;
+    desc.desc.kerning = true;
+
+    auto font = std::make_shared<gfx::font>();
+    static_cast<gfx::font_info&>(*font) = gfx::create_font_from_ttf({desc});
+    return font;
+}
+
+//-----------------------------------------------------------------------------
+/// Deterministic text of words with varying lengths.
+//-----------------------------------------------------------------------------
+inline std::string create_words(size_t chars)
+{
+    static const char* words[] = {"lorem", "ipsum", "dolor", "sit", "amet", "consectetur",
+                                  "adipiscing", "elit", "sed", "do", "eiusmod", "tempor"};
+    std::string result;
+    result.reserve(chars + 16);
+    for(size_t i = 0; result.size() < chars; ++i)
+    {
+        result.append(words[(i * 7) % 12]);
+        result.append(i % 11 == 10 ? "\n" : " ");
+    }
+    result.resize(chars);
+    return result;
+}
+
+}
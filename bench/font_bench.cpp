@@ -0,0 +1,44 @@
+#include "bench.h"
+
+#include <videopp/font_info.h>
+#include <videopp/glyph_range.h>
+#include <videopp/ttf_font.h>
+
+void run_font_bench(bench::suite& suite)
+{
+    for(float size : {16.0f, 48.0f})
+    {
+        const auto name = std::to_string(int(size));
+
+        gfx::font_info info;
+        auto& embedded = suite.run("font/atlas_default/" + name, 3, [&]()
+        {
+            info = gfx::create_default_font(size);
+            bench::do_not_optimize(info);
+        });
+        embedded.counters.emplace_back("glyphs", double(info.glyphs.size()));
+        embedded.counters.emplace_back("atlas_pixels", double(info.surface->get_width() * info.surface->get_height()));
+
+        auto& latin = suite.run("font/atlas_ttf_latin/" + name, 3, [&]()
+        {
+            info = gfx::create_font_from_ttf(DATA "fonts/wds052801.ttf", gfx::get_latin_glyph_range(), size);
+            bench::do_not_optimize(info);
+        });
+        latin.counters.emplace_back("glyphs", double(info.glyphs.size()));
+        latin.counters.emplace_back("kerning_pairs", double(info.kernings.size()));
+        latin.counters.emplace_back("atlas_pixels", double(info.surface->get_width() * info.surface->get_height()));
+        latin.counters.emplace_back("index_bytes", double(info.glyph_index.get_memory_bytes()));
+        latin.counters.emplace_back("dense_index_bytes", double(info.glyph_index.get_dense_memory_bytes()));
+
+        auto& lookup = suite.run("font/get_glyph/" + name, 100, [&]()
+        {
+            float total = 0.0f;
+            for(uint32_t c = 0; c < 0x3000; ++c)
+            {
+                total += info.get_glyph(c).advance_x;
+            }
+            bench::do_not_optimize(total);
+        });
+        lookup.counters.emplace_back("ns_per_lookup", lookup.ns_per_iteration / double(0x3000));
+    }
+}
@@ -0,0 +1,142 @@
+#include "bench.h"
+#include "fixtures.h"
+
+#include <videopp/renderer.h>
+#include <videopp/text.h>
+#include <videopp/text_layout_cache.h>
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <memory>
+
+namespace
+{
+
+constexpr int frame_width = 1280;
+constexpr int frame_height = 720;
+
+void record_frame(gfx::draw_list& list, const gfx::text& text, size_t count)
+{
+    for(size_t i = 0; i < count; ++i)
+    {
+        const auto x = int(i % 128) * 10;
+        const auto y = int(i / 128 % 72) * 10;
+        list.add_rect(gfx::rect{x, y, 8, 8}, gfx::color(uint8_t(i), 128, uint8_t(255 - i % 256)));
+    }
+
+    math::transformf transform{};
+    transform.set_position(20.0f, 20.0f, 0.0f);
+    list.add_text(text, transform);
+}
+
+}
+
+void run_frame_bench(bench::suite& suite)
+{
+    std::unique_ptr<gfx::renderer> rend;
+    try
+    {
+        rend = std::make_unique<gfx::renderer>(gfx::size{frame_width, frame_height});
+    }
+    catch(const std::exception& e)
+    {
+        // the frame benchmarks need the headless build and an egl driver (e.g. llvmpipe)
+        std::cerr << "Skipping the frame benchmarks: " << e.what() << std::endl;
+        return;
+    }
+
+    auto font = rend->create_font(gfx::create_default_font(24));
+    gfx::text text;
+    text.set_font(font);
+    text.set_utf8_text(bench::create_words(512));
+    text.set_wrap_width(float(frame_width - 40));
+
+    // the geometry of a text needs the font atlas, so recording
+    // texts is measured here and not with the draw list benchmarks
+    gfx::draw_list list;
+    auto& texts = suite.run("draw_list/add_text/512", 100, [&]()
+    {
+        list.clear();
+        list.add_text(text, math::transformf{});
+        bench::do_not_optimize(list);
+    });
+    texts.counters.emplace_back("vertices", double(list.vertices.size()));
+
+    // ui code builds its texts anew every frame, the layout cache serves them
+    const auto words = bench::create_words(512);
+    for(size_t budget : {size_t(0), size_t(16) << 20})
+    {
+        gfx::text_layout_cache::set_budget(budget);
+        gfx::text_layout_cache::reset_stats();
+
+        const std::string mode = budget > 0 ? "cached" : "uncached";
+        auto& fresh = suite.run("text/fresh_per_frame/" + mode + "/512", 100, [&]()
+        {
+            gfx::text fresh_text;
+            fresh_text.set_font(font);
+            fresh_text.set_utf8_text(words);
+            fresh_text.set_wrap_width(float(frame_width - 40));
+            bench::do_not_optimize(fresh_text.get_geometry());
+        });
+
+        const auto stats = gfx::text_layout_cache::get_stats();
+        fresh.counters.emplace_back("hits", double(stats.hits));
+        fresh.counters.emplace_back("misses", double(stats.misses));
+        fresh.counters.emplace_back("bytes", double(stats.bytes));
+    }
+    gfx::text_layout_cache::set_budget(0);
+
+    for(bool threaded : {false, true})
+    {
+        rend->set_render_thread(threaded);
+        const std::string mode = threaded ? "threaded" : "immediate";
+
+        for(size_t count : {size_t(1000), size_t(10000)})
+        {
+            auto& frame = suite.run("frame/present/" + mode + "/" + std::to_string(count), 50, [&]()
+            {
+                rend->clear(gfx::color::black());
+                record_frame(rend->get_list(), text, count);
+                rend->present();
+            });
+
+            // the stats of the last frame presented
+            const auto& stats = rend->get_stats();
+            frame.counters.emplace_back("fps", 1e9 / frame.ns_per_iteration);
+            frame.counters.emplace_back("requested_calls", double(stats.requested_calls));
+            frame.counters.emplace_back("rendered_calls", double(stats.rendered_calls));
+            frame.counters.emplace_back("uploaded_bytes", double(stats.uploaded_bytes));
+            frame.counters.emplace_back("skipped_upload_bytes", double(stats.skipped_upload_bytes));
+        }
+
+        if(!threaded)
+        {
+            continue;
+        }
+
+        // Frame N + 1 is recorded while the render thread still presents frame N.
+        // Anything on the way which takes the context back waits for frame N,
+        // so the frame is no longer in flight once the recording is done.
+        size_t frames = 0;
+        size_t overlapped = 0;
+        auto& overlap = suite.run("frame/record_while_presenting/10000", 50, [&]()
+        {
+            rend->clear(gfx::color::black());
+            record_frame(rend->get_list(), text, 10000);
+            overlapped += rend->is_frame_in_flight() ? 1 : 0;
+            frames++;
+            rend->present();
+        });
+        overlap.counters.emplace_back("overlapped_frames", double(overlapped) / double(std::max<size_t>(frames, 1)));
+    }
+    rend->set_render_thread(false);
+
+    std::vector<uint8_t> pixels;
+    auto& read_back = suite.run("frame/read_back", 20, [&]()
+    {
+        rend->read_back(pixels);
+        bench::do_not_optimize(pixels);
+    });
+    read_back.counters.emplace_back("bytes", double(pixels.size()));
+}
@@ -0,0 +1,41 @@
+#include "bench.h"
+
+#include <videopp/logger.h>
+
+#include <fstream>
+#include <iostream>
+
+void run_draw_cmd_bench(bench::suite& suite);
+void run_transform_bench(bench::suite& suite);
+void run_draw_list_bench(bench::suite& suite);
+void run_text_bench(bench::suite& suite);
+void run_surface_bench(bench::suite& suite);
+void run_font_bench(bench::suite& suite);
+void run_frame_bench(bench::suite& suite);
+
+int main(int argc, char* argv[])
+{
+    gfx::set_extern_logger([](const std::string& msg) { std::cerr << msg << std::endl; });
+
+    bench::suite suite;
+    run_draw_cmd_bench(suite);
+    run_transform_bench(suite);
+    run_draw_list_bench(suite);
+    run_text_bench(suite);
+    run_surface_bench(suite);
+    run_font_bench(suite);
+    run_frame_bench(suite);
+
+    auto json = suite.to_json();
+    if(argc > 1)
+    {
+        std::ofstream out(argv[1]);
+        out << json;
+    }
+    else
+    {
+        std::cout << json;
+    }
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include "bench.h"
+
+#include <videopp/surface.h>
+
+#include <memory>
+
+void run_surface_bench(bench::suite& suite)
+{
+    const std::string file_name = DATA "wheel.png";
+
+    std::unique_ptr<gfx::surface> loaded;
+    auto& load = suite.run("surface/load_png", 20, [&]()
+    {
+        loaded = std::make_unique<gfx::surface>(file_name);
+        bench::do_not_optimize(loaded);
+    });
+    load.counters.emplace_back("pixels", double(loaded->get_width() * loaded->get_height()));
+
+    for(int dim : {64, 512, 2048})
+    {
+        const auto name = std::to_string(dim);
+        gfx::surface src(dim, dim, gfx::pix_type::rgba);
+        src.fill(gfx::color::white());
+        gfx::surface dst(dim, dim, gfx::pix_type::rgba);
+
+        auto& fill = suite.run("surface/fill/" + name, 20, [&]()
+        {
+            dst.fill(gfx::color::red());
+            bench::do_not_optimize(dst);
+        });
+        fill.counters.emplace_back("ns_per_pixel", fill.ns_per_iteration / double(dim * dim));
+
+        auto& copy = suite.run("surface/copy_from/" + name, 20, [&]()
+        {
+            dst.copy_from(src, src.get_rect(), {0, 0});
+            bench::do_not_optimize(dst);
+        });
+        copy.counters.emplace_back("ns_per_pixel", copy.ns_per_iteration / double(dim * dim));
+
+        // the searched pixel is the last one, so the whole area is scanned
+        dst.fill(gfx::color::clear());
+        dst.set_pixel({dim - 1, dim - 1}, gfx::color::green());
+
+        auto& find = suite.run("surface/find_pixel/" + name, 20, [&]()
+        {
+            bench::do_not_optimize(dst.find_pixel(gfx::color::green(), dst.get_rect()));
+        });
+        find.counters.emplace_back("ns_per_pixel", find.ns_per_iteration / double(dim * dim));
+
+        auto& find_alpha = suite.run("surface/find_pixel_with_alpha/" + name, 20, [&]()
+        {
+            bench::do_not_optimize(dst.find_pixel_with_alpha(dst.get_rect()));
+        });
+        find_alpha.counters.emplace_back("ns_per_pixel", find_alpha.ns_per_iteration / double(dim * dim));
+    }
+}
@@ -0,0 +1,112 @@
+#include "bench.h"
+#include "fixtures.h"
+
+#include <videopp/draw_list.h>
+#include <videopp/text.h>
+
+void run_text_bench(bench::suite& suite)
+{
+    auto font = bench::create_font(24);
+
+    for(size_t chars : {size_t(16), size_t(256), size_t(4096)})
+    {
+        const auto str = bench::create_words(chars);
+
+        gfx::text text;
+        text.set_font(font);
+        text.set_utf8_text(str);
+
+        auto& layout = suite.run("text/layout/" + std::to_string(chars), 100, [&]()
+        {
+            text.clear_lines();
+            bench::do_not_optimize(text.get_lines());
+        });
+        layout.counters.emplace_back("ns_per_char", layout.ns_per_iteration / double(chars));
+        layout.counters.emplace_back("lines", double(text.get_lines().size()));
+
+        auto& wrap = suite.run("text/wrap/" + std::to_string(chars), 100, [&]()
+        {
+            text.set_wrap_width(300.0f);
+            text.clear_lines();
+            bench::do_not_optimize(text.get_lines());
+        });
+        wrap.counters.emplace_back("ns_per_char", wrap.ns_per_iteration / double(chars));
+        wrap.counters.emplace_back("lines", double(text.get_lines().size()));
+
+        // a log appending a line, only the changed last line is laid out again
+        const std::string appended[] = {str + "\nappended line", str + "\nanother appended line"};
+        size_t append_idx = 0;
+        auto& append = suite.run("text/append_line/" + std::to_string(chars), 100, [&]()
+        {
+            text.set_utf8_text(appended[append_idx++ % 2]);
+            bench::do_not_optimize(text.get_lines());
+        });
+        append.counters.emplace_back("lines", double(text.get_lines().size()));
+        text.set_utf8_text(str);
+
+        auto& decode = suite.run("text/decode/" + std::to_string(chars), 100, [&]()
+        {
+            text.clear_lines();
+            bench::do_not_optimize(text.get_unicode_text());
+        });
+        decode.counters.emplace_back("ns_per_char", decode.ns_per_iteration / double(chars));
+
+        gfx::frect area{0.0f, 0.0f, 400.0f, 200.0f};
+        auto& fit = suite.run("text/wrap_and_fit/" + std::to_string(chars), 20, [&]()
+        {
+            text.set_wrap_width(0.0f);
+            auto transform = gfx::align_wrap_and_fit_text(text, math::transformf{}, area);
+            bench::do_not_optimize(transform);
+        });
+        fit.counters.emplace_back("ns_per_char", fit.ns_per_iteration / double(chars));
+    }
+
+    // kerning looks up every glyph pair during the layout
+    auto kerned_font = bench::create_kerned_font(24);
+    const auto str = bench::create_words(4096);
+    for(bool kerning : {false, true})
+    {
+        gfx::text text;
+        text.set_font(kerned_font);
+        text.set_kerning(kerning);
+        text.set_wrap_width(300.0f);
+        text.set_utf8_text(str);
+
+        const std::string mode = kerning ? "on" : "off";
+        auto& layout = suite.run("text/layout_kerning/" + mode + "/4096", 100, [&]()
+        {
+            text.clear_lines();
+            bench::do_not_optimize(text.get_lines());
+        });
+        layout.counters.emplace_back("ns_per_char", layout.ns_per_iteration / 4096.0);
+        layout.counters.emplace_back("kerning_pairs", double(kerned_font->kerning_pairs.size()));
+    }
+
+    // the lookup alone, over the pairs of the text
+    auto& lookup = suite.run("font/get_kerning/4096", 100, [&]()
+    {
+        float total = 0.0f;
+        for(size_t i = 1; i < str.size(); ++i)
+        {
+            total += kerned_font->get_kerning(uint8_t(str[i - 1]), uint8_t(str[i]));
+        }
+        bench::do_not_optimize(total);
+    });
+    lookup.counters.emplace_back("ns_per_pair", lookup.ns_per_iteration / double(str.size() - 1));
+
+    // ascii runs broken by multibyte sequences take the slow decoding path
+    std::string mixed;
+    while(mixed.size() < 4096)
+    {
+        mixed += "stra\xc3\x9f""e gr\xc3\xbc\xc3\x9f""e \xd0\xbc\xd0\xb8\xd1\x80 ";
+    }
+    gfx::text mixed_text;
+    mixed_text.set_font(font);
+    mixed_text.set_utf8_text(mixed);
+    auto& decode = suite.run("text/decode_mixed/4096", 100, [&]()
+    {
+        mixed_text.clear_lines();
+        bench::do_not_optimize(mixed_text.get_unicode_text());
+    });
+    decode.counters.emplace_back("ns_per_byte", decode.ns_per_iteration / double(mixed.size()));
+}
@@ -0,0 +1,39 @@
+#include "bench.h"
+
+#include <videopp/vertex.h>
+
+#include <vector>
+
+void run_transform_bench(bench::suite& suite)
+{
+    math::transformf transform{};
+    transform.translate(100.0f, 50.0f);
+    transform.rotate(0.0f, 0.0f, math::radians(30.0f));
+    transform.scale(1.5f, 0.75f);
+
+    for(size_t count : {size_t(96), size_t(4096)})
+    {
+        std::vector<gfx::vertex_2d> vertices(count);
+        for(size_t i = 0; i < count; ++i)
+        {
+            vertices[i].pos = {float(i % 64), float(i / 64)};
+        }
+
+        auto& full = suite.run("transform/transform_coord/" + std::to_string(count), 1000, [&]()
+        {
+            for(auto& v : vertices)
+            {
+                v.pos = transform.transform_coord(v.pos);
+            }
+            bench::do_not_optimize(vertices);
+        });
+        full.counters.emplace_back("ns_per_vertex", full.ns_per_iteration / double(count));
+
+        auto& bulk = suite.run("transform/transform_vertices/" + std::to_string(count), 1000, [&]()
+        {
+            gfx::transform_vertices(vertices.data(), vertices.size(), transform);
+            bench::do_not_optimize(vertices);
+        });
+        bulk.counters.emplace_back("ns_per_vertex", bulk.ns_per_iteration / double(count));
+    }
+}
@@ -15,6 +15,9 @@ namespace gfx
     {
         virtual ~context() = default;
         virtual bool make_current() = 0;
+        /// Detach the context from the calling thread,
+        /// so another thread can make it current.
+        virtual bool release_current() = 0;
         virtual bool swap_buffers() = 0;
         virtual bool set_vsync(bool vsync) = 0;
 
@@ -3,6 +3,7 @@
 #include "../../utils.h"
 #include "../../logger.h"
 #include <algorithm>
+#include <cstring>
 
 namespace gfx
 {
@@ -10,10 +11,11 @@ namespace
 {
 std::vector<context_egl*> ctxs {};
 
+/// the context current on each thread
+thread_local context_egl* current{};
+
 bool make_current_context(context_egl* ctx)
 {
-	static context_egl* current{};
-
     if(current != ctx)
     {
 		if(eglMakeCurrent(ctx->display_, ctx->surface_, ctx->surface_, ctx->context_))
@@ -112,6 +114,119 @@ context_egl::context_egl(native_handle handle, native_display display, int major
     make_current_context(this);
 }
 
+context_egl::context_egl(const size& offscreen_size)
+{
+    if(!gladLoadEGL())
+    {
+        throw gfx::exception("Cannot load egl.");
+    }
+
+    // the surfaceless platform needs neither a display server nor a gpu
+    display_ = EGL_NO_DISPLAY;
+    if(eglGetPlatformDisplayEXT)
+    {
+        display_ = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+
+    if(display_ == EGL_NO_DISPLAY)
+    {
+        display_ = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    if(display_ == EGL_NO_DISPLAY)
+    {
+        throw gfx::exception("Cannot get EGL Display.");
+    }
+
+    int major_version {};
+    int minor_version {};
+
+    if(!eglInitialize(display_, &major_version, &minor_version))
+    {
+        throw gfx::exception("Cannot get EGL Initialize.");
+    }
+
+    // the shaders are written for desktop gl
+    if(!eglBindAPI(EGL_OPENGL_API))
+    {
+        throw gfx::exception("Cannot bind the OpenGL API.");
+    }
+
+    EGLConfig config {};
+    EGLint num_config {};
+    {
+        EGLint attribList[] =
+            {
+                EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                EGL_RED_SIZE, 8,
+                EGL_GREEN_SIZE, 8,
+                EGL_BLUE_SIZE, 8,
+                EGL_ALPHA_SIZE, 8,
+                EGL_NONE
+            };
+
+        if(!eglChooseConfig(display_, attribList, &config, 1, &num_config))
+        {
+            throw gfx::exception("Cannot choose EGL Config.");
+        }
+    }
+
+    if(num_config > 0)
+    {
+        EGLint surface_attribs[] =
+        {
+            EGL_WIDTH, EGLint(offscreen_size.w),
+            EGL_HEIGHT, EGLint(offscreen_size.h),
+            EGL_NONE
+        };
+        surface_ = eglCreatePbufferSurface(display_, config, surface_attribs);
+    }
+    else
+    {
+        // no pbuffers, everything is drawn into framebuffer objects anyway
+        EGLint attribList[] =
+            {
+                EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                EGL_NONE
+            };
+
+        if(!eglChooseConfig(display_, attribList, &config, 1, &num_config) || num_config < 1)
+        {
+            throw gfx::exception("No EGL Config.");
+        }
+
+        surface_ = EGL_NO_SURFACE;
+    }
+
+    if(surface_ == EGL_NO_SURFACE)
+    {
+        const char* extensions = eglQueryString(display_, EGL_EXTENSIONS);
+        if(!extensions || !std::strstr(extensions, "EGL_KHR_surfaceless_context"))
+        {
+            throw gfx::exception("Cannot create EGL Surface.");
+        }
+    }
+
+    // no version requested to get the highest compatibility profile
+    EGLint context_attribs[] =
+    {
+        EGL_NONE
+    };
+
+    context_ = eglCreateContext(display_, config, ctxs.empty() ? EGL_NO_CONTEXT : ctxs.front()->context_, context_attribs);
+    if(context_ == EGL_NO_CONTEXT)
+    {
+        throw gfx::exception("Failed to create an offscreen OpenGL context.");
+    }
+
+    log("Offscreen OpenGL context was created.");
+
+    ctxs.push_back(this);
+
+    make_current_context(this);
+}
+
 context_egl::~context_egl()
 {
     auto it = std::remove(std::begin(ctxs), std::end(ctxs), this);
@@ -119,6 +234,11 @@ context_egl::~context_egl()
 
     eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
     eglDestroyContext(display_, context_);
+    if(surface_ != EGL_NO_SURFACE)
+    {
+        eglDestroySurface(display_, surface_);
+    }
+    current = nullptr;
 
     if (!ctxs.empty())
     {
@@ -143,8 +263,30 @@ bool context_egl::make_current()
     return make_current_context(this);
 }
 
+bool context_egl::release_current()
+{
+    if(current != this)
+    {
+        return true;
+    }
+
+    if(eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT))
+    {
+        current = nullptr;
+        return true;
+    }
+
+    return false;
+}
+
 bool context_egl::swap_buffers()
 {
+    // an offscreen context without a surface has nothing to swap
+    if(surface_ == EGL_NO_SURFACE)
+    {
+        return true;
+    }
+
 	return eglSwapBuffers(display_, surface_);
 }
 
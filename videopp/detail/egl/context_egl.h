@@ -18,10 +18,15 @@ namespace gfx
 struct context_egl : context
 {
     context_egl(native_handle handle, native_display display, int major = 2, int minor = 0);
+    /// Desktop gl context without a window. Uses the surfaceless platform
+    /// when available (e.g. Mesa llvmpipe) and renders into a pbuffer
+    /// or, when pbuffers are not supported, into no surface at all.
+    explicit context_egl(const size& offscreen_size);
     ~context_egl() override;
 
     bool set_vsync(bool vsync) override;
     bool make_current() override;
+    bool release_current() override;
     bool swap_buffers() override;
 
     //pixmap impl
@@ -0,0 +1,17 @@
+#include "offscreen_egl.h"
+#include "context_egl.h"
+
+namespace gfx
+{
+
+std::unique_ptr<context> create_offscreen_context(const size& offscreen_size)
+{
+    return std::make_unique<context_egl>(offscreen_size);
+}
+
+bool load_offscreen_gl()
+{
+    return gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress)) != 0;
+}
+
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "../../context.h"
+
+#include <memory>
+
+namespace gfx
+{
+// The egl headers clash with the glx ones, so
+// the renderer reaches egl only through these.
+
+/// Create a desktop gl context which needs no window
+std::unique_ptr<context> create_offscreen_context(const size& offscreen_size);
+
+/// Load the gl functions through egl
+bool load_offscreen_gl();
+}
@@ -0,0 +1,236 @@
+#include "gl_state.h"
+#include "utils.h"
+
+namespace gfx
+{
+constexpr uint32_t gl_state::unknown;
+constexpr uint32_t gl_state::max_units;
+
+void gl_state::invalidate() noexcept
+{
+    // the attributes of a vertex array may point to a
+    // deleted buffer whose id was reused, so forget them too
+    vertex_arrays_.clear();
+    vertex_array_ = unknown;
+    vertex_buffer_ = unknown;
+    program_ = unknown;
+    active_unit_ = unknown;
+    textures_.fill(unknown);
+    samplers_.fill(unknown);
+    scissor_test_ = unknown;
+    scissor_valid_ = false;
+    blending_mode_ = unknown;
+}
+
+void gl_state::reset() noexcept
+{
+    use_program(0);
+    set_scissor_test(false);
+
+    for(uint32_t unit = 0; unit < max_units; ++unit)
+    {
+        if(textures_[unit] != 0 && textures_[unit] != unknown)
+        {
+            bind_texture(unit, 0);
+        }
+        if(samplers_[unit] != 0 && samplers_[unit] != unknown)
+        {
+            bind_sampler(unit, 0);
+        }
+    }
+
+    // activate just 1 texture
+    if(active_unit_ != 0)
+    {
+        gl_call(glActiveTexture(GL_TEXTURE0));
+        active_unit_ = 0;
+    }
+}
+
+void gl_state::use_program(uint32_t id) noexcept
+{
+    if(program_ == id)
+    {
+        redundant_calls_++;
+        return;
+    }
+
+    gl_call(glUseProgram(id));
+    program_ = id;
+}
+
+void gl_state::bind_vertex_array(const vertex_array_object& vao) noexcept
+{
+    if(vertex_array_ == vao.get_id())
+    {
+        redundant_calls_++;
+        return;
+    }
+
+    vao.bind();
+    vertex_array_ = vao.get_id();
+}
+
+void gl_state::bind_vertex_buffer(const vertex_buffer& vbo) noexcept
+{
+    if(vertex_buffer_ == vbo.get_id())
+    {
+        redundant_calls_++;
+        return;
+    }
+
+    vbo.bind();
+    vertex_buffer_ = vbo.get_id();
+}
+
+gl_state::vertex_array_state& gl_state::get_vertex_array() noexcept
+{
+    for(auto& state : vertex_arrays_)
+    {
+        if(state.id == vertex_array_)
+        {
+            return state;
+        }
+    }
+
+    vertex_arrays_.emplace_back();
+    auto& state = vertex_arrays_.back();
+    state.id = vertex_array_;
+    // we don't know what was enabled before
+    state.enabled_attributes = used_attributes_;
+    state.instanced_attributes = used_instanced_attributes_;
+    return state;
+}
+
+void gl_state::bind_layout(const vertex_buffer_layout& layout, std::size_t base_offset) noexcept
+{
+    auto& state = get_vertex_array();
+
+    bool same_layout = state.layout == &layout || (state.layout && *state.layout == layout);
+    if(same_layout && state.base_offset == base_offset && state.vbo == vertex_buffer_ && vertex_buffer_ != unknown)
+    {
+        redundant_calls_++;
+        return;
+    }
+
+    const auto mask = layout.get_attributes_mask();
+    const auto to_disable = state.enabled_attributes & ~mask;
+    const auto to_enable = mask & ~state.enabled_attributes;
+    for(uint32_t location = 0; location < 32; ++location)
+    {
+        const auto bit = uint32_t(1) << location;
+        if(to_disable & bit)
+        {
+            gl_call(glDisableVertexAttribArray(location));
+        }
+        else if(to_enable & bit)
+        {
+            gl_call(glEnableVertexAttribArray(location));
+        }
+    }
+
+    // the divisor is a property of the attribute location, so
+    // locations used by an instanced layout must be reset
+    const auto instanced = layout.get_divisor() != 0 ? mask : 0;
+    const auto to_update = (instanced ^ state.instanced_attributes) & mask;
+    for(uint32_t location = 0; to_update != 0 && location < 32; ++location)
+    {
+        const auto bit = uint32_t(1) << location;
+        if(to_update & bit)
+        {
+            gl_call(glVertexAttribDivisor(location, (instanced & bit) ? layout.get_divisor() : 0));
+        }
+    }
+
+    layout.bind_pointers(base_offset);
+
+    state.layout = &layout;
+    state.base_offset = base_offset;
+    state.vbo = vertex_buffer_;
+    state.enabled_attributes = mask;
+    state.instanced_attributes = (state.instanced_attributes & ~mask) | instanced;
+    used_attributes_ |= mask;
+    used_instanced_attributes_ |= instanced;
+}
+
+void gl_state::bind_texture(uint32_t unit, uint32_t id) noexcept
+{
+    if(unit < max_units && textures_[unit] == id)
+    {
+        redundant_calls_++;
+        return;
+    }
+
+    if(active_unit_ != unit)
+    {
+        gl_call(glActiveTexture(GL_TEXTURE0 + unit));
+        active_unit_ = unit;
+    }
+
+    gl_call(glBindTexture(GL_TEXTURE_2D, id));
+    if(unit < max_units)
+    {
+        textures_[unit] = id;
+    }
+}
+
+void gl_state::bind_sampler(uint32_t unit, uint32_t id) noexcept
+{
+    if(unit < max_units && samplers_[unit] == id)
+    {
+        redundant_calls_++;
+        return;
+    }
+
+    gl_call(glBindSampler(unit, id));
+    if(unit < max_units)
+    {
+        samplers_[unit] = id;
+    }
+}
+
+void gl_state::set_scissor_test(bool enabled) noexcept
+{
+    if(scissor_test_ == uint32_t(enabled))
+    {
+        redundant_calls_++;
+        return;
+    }
+
+    if(enabled)
+    {
+        gl_call(glEnable(GL_SCISSOR_TEST));
+    }
+    else
+    {
+        gl_call(glDisable(GL_SCISSOR_TEST));
+    }
+    scissor_test_ = uint32_t(enabled);
+}
+
+void gl_state::set_scissor(const rect& scissor) noexcept
+{
+    if(scissor_valid_ && scissor_ == scissor)
+    {
+        redundant_calls_++;
+        return;
+    }
+
+    gl_call(glScissor(scissor.x, scissor.y, scissor.w, scissor.h));
+    scissor_ = scissor;
+    scissor_valid_ = true;
+}
+
+bool gl_state::change_blending_mode(blending_mode mode) noexcept
+{
+    if(blending_mode_ == uint32_t(mode))
+    {
+        redundant_calls_++;
+        return false;
+    }
+
+    blending_mode_ = uint32_t(mode);
+    return true;
+}
+
+}
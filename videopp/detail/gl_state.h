@@ -0,0 +1,87 @@
+#pragma once
+
+#include "../color.h"
+#include "../rect.h"
+#include "../vertex.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace gfx
+{
+
+/// Shadows the gl state changed while drawing and issues
+/// gl calls only when the state really changes.
+class gl_state
+{
+public:
+    gl_state() noexcept { invalidate(); }
+
+    /// Forget the shadowed state. Call when the state
+    /// may have been changed around the tracker.
+    void invalidate() noexcept;
+
+    /// Unbind the program, textures and samplers and disable clipping
+    void reset() noexcept;
+
+    void use_program(uint32_t id) noexcept;
+    void bind_vertex_array(const vertex_array_object& vao) noexcept;
+    void bind_vertex_buffer(const vertex_buffer& vbo) noexcept;
+
+    /// Sets up the attributes of the bound vertex array. Skipped when it was
+    /// set up with an equal layout, base offset and vertex buffer.
+    void bind_layout(const vertex_buffer_layout& layout, std::size_t base_offset) noexcept;
+
+    void bind_texture(uint32_t unit, uint32_t id) noexcept;
+    void bind_sampler(uint32_t unit, uint32_t id) noexcept;
+
+    void set_scissor_test(bool enabled) noexcept;
+    void set_scissor(const rect& scissor) noexcept;
+
+    /// Returns false if the mode is already set
+    bool change_blending_mode(blending_mode mode) noexcept;
+
+    /// Number of gl calls skipped because they would not change the state
+    size_t get_redundant_calls() const noexcept { return redundant_calls_; }
+    void reset_redundant_calls() noexcept { redundant_calls_ = 0; }
+
+private:
+    static constexpr uint32_t unknown = 0xffffffff;
+    static constexpr uint32_t max_units = 32;
+
+    struct vertex_array_state
+    {
+        uint32_t id{};
+        const vertex_buffer_layout* layout{};
+        std::size_t base_offset{};
+        uint32_t vbo{unknown};
+        uint32_t enabled_attributes{};
+        uint32_t instanced_attributes{};
+    };
+
+    vertex_array_state& get_vertex_array() noexcept;
+
+    std::vector<vertex_array_state> vertex_arrays_;
+    uint32_t vertex_array_{unknown};
+    uint32_t vertex_buffer_{unknown};
+    /// attributes enabled (or made instanced) at some point,
+    /// used when the state of a vertex array is unknown
+    uint32_t used_attributes_{};
+    uint32_t used_instanced_attributes_{};
+
+    uint32_t program_{unknown};
+    uint32_t active_unit_{unknown};
+    std::array<uint32_t, max_units> textures_{};
+    std::array<uint32_t, max_units> samplers_{};
+
+    uint32_t scissor_test_{unknown};
+    rect scissor_{};
+    bool scissor_valid_{};
+
+    uint32_t blending_mode_{unknown};
+
+    size_t redundant_calls_{};
+};
+
+}
@@ -137,10 +137,11 @@ GLXFBConfig choose_fb_config(Display* display)
     return best_fbc;
 }
 
+/// the context current on each thread
+thread_local context_glx* current{};
+
 bool make_current_context(context_glx* ctx)
 {
-	static context_glx* current{};
-
     if(current != ctx)
     {
 		if(glXMakeCurrent(ctx->display_, ctx->surface_, ctx->context_))
@@ -229,6 +230,7 @@ context_glx::~context_glx()
 
     glXMakeCurrent(display_, 0, nullptr);
     glXDestroyContext(display_, context_);
+    current = nullptr;
 
     if (!ctxs.empty())
     {
@@ -286,6 +288,22 @@ bool context_glx::make_current()
 	return make_current_context(this);
 }
 
+bool context_glx::release_current()
+{
+    if(current != this)
+    {
+        return true;
+    }
+
+    if(glXMakeCurrent(display_, 0, nullptr))
+    {
+        current = nullptr;
+        return true;
+    }
+
+    return false;
+}
+
 bool context_glx::swap_buffers()
 {
     glXSwapBuffers(display_, surface_);
@@ -13,6 +13,9 @@ struct pixmap_glx
     uint64_t glx_pixmap = 0;
 };
 
+/// With the render thread of the renderer this context is made current and
+/// swapped from two threads. Xlib is thread safe only when XInitThreads() was
+/// called before the display was opened, which is up to the window's owner.
 struct context_glx : context
 {
     context_glx(native_handle handle, native_display display, int major = 1, int minor = 0);
@@ -20,6 +23,7 @@ struct context_glx : context
 
     bool set_vsync(bool vsync) override;
     bool make_current() override;
+    bool release_current() override;
     bool swap_buffers() override;
     //pixmap impl
     pixmap create_pixmap(const size& sz, pix_type pix_t) override;
@@ -0,0 +1,255 @@
+#include "gpu_timer.h"
+#include "utils.h"
+#include "../draw_list.h"
+
+#include <algorithm>
+
+namespace gfx
+{
+constexpr size_t gpu_timer::max_frames_in_flight;
+constexpr size_t gpu_timer::history_size;
+
+const char* to_string(gpu_pass pass) noexcept
+{
+    switch(pass)
+    {
+        case gpu_pass::master:
+            return "master";
+        case gpu_pass::fbo:
+            return "fbo";
+        case gpu_pass::blur:
+            return "blur";
+        default:
+            return "unknown";
+    }
+}
+
+gpu_timer::~gpu_timer()
+{
+    if(!all_queries_.empty())
+    {
+        gl_call(glDeleteQueries(GLsizei(all_queries_.size()), all_queries_.data()));
+    }
+}
+
+bool gpu_timer::is_supported() noexcept
+{
+    return GLAD_GL_VERSION_3_3 || GLAD_GL_ARB_timer_query;
+}
+
+uint32_t gpu_timer::begin_query() noexcept
+{
+    if(free_queries_.empty())
+    {
+        uint32_t id = 0;
+        gl_call(glGenQueries(1, &id));
+        all_queries_.push_back(id);
+        free_queries_.push_back(id);
+    }
+
+    auto id = free_queries_.back();
+    free_queries_.pop_back();
+
+    gl_call(glBeginQuery(GL_TIME_ELAPSED, id));
+    query_active_ = true;
+    return id;
+}
+
+void gpu_timer::begin_pass(gpu_pass pass) noexcept
+{
+    if(pass_depth_ > 0)
+    {
+        pass_depth_++;
+        return;
+    }
+
+    const auto mode = get_draw_config().gpu_timing;
+    if(mode == gpu_timing_mode::none || query_active_ || !is_supported())
+    {
+        return;
+    }
+
+    auto& f = frames_[current_];
+    gpu_pass_timing timing{};
+    timing.pass = pass;
+    f.passes.emplace_back(timing);
+
+    pass_depth_ = 1;
+    time_commands_ = mode == gpu_timing_mode::commands;
+    if(!time_commands_)
+    {
+        query q{};
+        q.pass = f.passes.size() - 1;
+        q.id = begin_query();
+        f.queries.emplace_back(q);
+    }
+}
+
+void gpu_timer::end_pass() noexcept
+{
+    if(pass_depth_ == 0)
+    {
+        return;
+    }
+
+    // only the outermost pass ends the query
+    if(--pass_depth_ > 0)
+    {
+        return;
+    }
+
+    if(query_active_)
+    {
+        gl_call(glEndQuery(GL_TIME_ELAPSED));
+        query_active_ = false;
+    }
+
+    time_commands_ = false;
+}
+
+void gpu_timer::begin_command(size_t index) noexcept
+{
+    // the commands of a nested pass are part of the outer command
+    if(!time_commands_ || query_active_ || pass_depth_ != 1)
+    {
+        return;
+    }
+
+    auto& f = frames_[current_];
+    query q{};
+    q.pass = f.passes.size() - 1;
+    q.command = int64_t(index);
+    q.id = begin_query();
+    f.queries.emplace_back(q);
+}
+
+void gpu_timer::end_command() noexcept
+{
+    if(!time_commands_ || !query_active_ || pass_depth_ != 1)
+    {
+        return;
+    }
+
+    gl_call(glEndQuery(GL_TIME_ELAPSED));
+    query_active_ = false;
+}
+
+bool gpu_timer::read_back(frame& f) noexcept
+{
+    if(!f.queries.empty())
+    {
+        // the results of a frame become available in the order the queries ended
+        GLint available = 0;
+        gl_call(glGetQueryObjectiv(f.queries.back().id, GL_QUERY_RESULT_AVAILABLE, &available));
+        if(!available)
+        {
+            return false;
+        }
+    }
+
+    std::chrono::nanoseconds frame_time{};
+    for(const auto& q : f.queries)
+    {
+        GLuint64 elapsed = 0;
+        gl_call(glGetQueryObjectui64v(q.id, GL_QUERY_RESULT, &elapsed));
+
+        const auto time = std::chrono::nanoseconds(elapsed);
+        auto& pass = f.passes[q.pass];
+        pass.time += time;
+        frame_time += time;
+
+        if(q.command >= 0)
+        {
+            pass.timed_commands++;
+            if(time > pass.slowest_command_time)
+            {
+                pass.slowest_command_time = time;
+                pass.slowest_command = size_t(q.command);
+            }
+        }
+    }
+
+    latest_.latency = size_t(frame_index_ - f.index);
+    latest_.frame_time = frame_time;
+    latest_.passes.swap(f.passes);
+
+    history_[history_count_ % history_size] = frame_time.count();
+    history_count_++;
+    update_percentiles();
+
+    return true;
+}
+
+void gpu_timer::release(frame& f) noexcept
+{
+    for(const auto& q : f.queries)
+    {
+        free_queries_.push_back(q.id);
+    }
+    f.queries.clear();
+    f.passes.clear();
+    f.pending = false;
+}
+
+void gpu_timer::update_percentiles() noexcept
+{
+    const auto count = std::min(history_count_, history_size);
+    sorted_history_.assign(history_.begin(), history_.begin() + std::ptrdiff_t(count));
+
+    auto percentile = [&](size_t p)
+    {
+        auto nth = sorted_history_.begin() + std::ptrdiff_t((count - 1) * p / 100);
+        std::nth_element(sorted_history_.begin(), nth, sorted_history_.end());
+        return std::chrono::nanoseconds(*nth);
+    };
+
+    latest_.frame_time_p50 = percentile(50);
+    latest_.frame_time_p90 = percentile(90);
+    latest_.frame_time_p99 = percentile(99);
+}
+
+const gpu_frame_timings& gpu_timer::end_frame() noexcept
+{
+    // close a pass left open, however deeply nested
+    if(pass_depth_ > 0)
+    {
+        pass_depth_ = 1;
+        end_pass();
+    }
+
+    auto& current = frames_[current_];
+    current.index = frame_index_++;
+    current.pending = !current.passes.empty();
+
+    // read back the oldest frames first
+    for(size_t i = 1; i <= max_frames_in_flight; ++i)
+    {
+        auto& f = frames_[(current_ + i) % max_frames_in_flight];
+        if(!f.pending)
+        {
+            continue;
+        }
+
+        if(!read_back(f))
+        {
+            break;
+        }
+
+        release(f);
+    }
+
+    current_ = (current_ + 1) % max_frames_in_flight;
+
+    // never wait for the gpu, a frame which is still
+    // not ready when its slot is needed again is dropped
+    auto& next = frames_[current_];
+    if(next.pending)
+    {
+        latest_.dropped_frames++;
+    }
+    release(next);
+
+    return latest_;
+}
+
+}
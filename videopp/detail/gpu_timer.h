@@ -0,0 +1,123 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace gfx
+{
+
+/// The kind of target a list is drawn into
+enum class gpu_pass : uint8_t
+{
+    master,
+    fbo,
+    blur,
+    count
+};
+
+const char* to_string(gpu_pass pass) noexcept;
+
+struct gpu_pass_timing
+{
+    gpu_pass pass{};
+    std::chrono::nanoseconds time{};
+    /// commands timed one by one, 0 when only the pass is timed
+    size_t timed_commands{};
+    /// the slowest of the timed commands and its index in the drawn list
+    std::chrono::nanoseconds slowest_command_time{};
+    size_t slowest_command{};
+};
+
+/// Gpu timings of a frame, read back a few frames after it was drawn
+struct gpu_frame_timings
+{
+    /// frames between drawing and reading back the timings
+    size_t latency{};
+    std::chrono::nanoseconds frame_time{};
+    std::vector<gpu_pass_timing> passes;
+
+    /// rolling percentiles of the frame time over the last frames
+    std::chrono::nanoseconds frame_time_p50{};
+    std::chrono::nanoseconds frame_time_p90{};
+    std::chrono::nanoseconds frame_time_p99{};
+
+    /// frames whose timings were not available in time and were dropped
+    size_t dropped_frames{};
+};
+
+/// Measures the gpu time of passes and commands with GL_TIME_ELAPSED queries.
+/// The results are polled at the end of every frame and never waited for.
+class gpu_timer
+{
+public:
+    gpu_timer() = default;
+    ~gpu_timer();
+    gpu_timer(const gpu_timer& other) = delete;
+    gpu_timer& operator=(const gpu_timer& other) = delete;
+
+    /// Requires GL 3.3 or ARB_timer_query
+    static bool is_supported() noexcept;
+
+    /// Time elapsed queries cannot be nested, so when commands
+    /// are timed the pass time is the sum of its commands.
+    /// A pass begun inside another one is part of the outer pass,
+    /// which is timed until its own end_pass.
+    void begin_pass(gpu_pass pass) noexcept;
+    void end_pass() noexcept;
+
+    /// Time a command drawn inside the current pass
+    void begin_command(size_t index) noexcept;
+    void end_command() noexcept;
+
+    /// Close the frame and read back the timings of the earlier frames which are ready.
+    /// Returns the timings of the latest frame read back.
+    const gpu_frame_timings& end_frame() noexcept;
+
+private:
+    static constexpr size_t max_frames_in_flight = 4;
+    static constexpr size_t history_size = 128;
+
+    struct query
+    {
+        uint32_t id{};
+        /// the pass it belongs to
+        size_t pass{};
+        /// the command index, or -1 for the pass itself
+        int64_t command{-1};
+    };
+
+    struct frame
+    {
+        std::vector<query> queries;
+        std::vector<gpu_pass_timing> passes;
+        uint64_t index{};
+        bool pending{};
+    };
+
+    uint32_t begin_query() noexcept;
+    bool read_back(frame& f) noexcept;
+    void release(frame& f) noexcept;
+    void update_percentiles() noexcept;
+
+    std::array<frame, max_frames_in_flight> frames_{};
+    size_t current_{};
+    uint64_t frame_index_{};
+
+    std::vector<uint32_t> free_queries_;
+    std::vector<uint32_t> all_queries_;
+    /// the query begun last is running
+    bool query_active_{};
+    /// passes begun and not ended yet, the outermost one is timed
+    size_t pass_depth_{};
+    bool time_commands_{};
+
+    std::array<int64_t, history_size> history_{};
+    size_t history_count_{};
+    std::vector<int64_t> sorted_history_;
+
+    gpu_frame_timings latest_{};
+};
+
+}
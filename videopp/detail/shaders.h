@@ -104,6 +104,7 @@ static constexpr const char* vs_simple =
                     in float aTexIndex;
 
                     uniform mat4 uProjection;
+                    uniform vec4 uColorMultiplier;
 
                     out vec2 vTexCoord;
                     out vec4 vColor;
@@ -114,13 +115,42 @@ static constexpr const char* vs_simple =
                     {
                         gl_Position = uProjection * vec4(aPosition, 0.0, 1.0);
                         vTexCoord = aTexCoord;
-                        vColor = aColor;
-                        vExtraColor = aExtraColor;
+                        vColor = aColor * uColorMultiplier;
+                        vExtraColor = aExtraColor * uColorMultiplier;
                         vExtraData = aExtraData;
                         vTexIndex = aTexIndex;
                     }
                 )";
 
+static constexpr const char* vs_instanced =
+                R"(
+                    in vec2 aPosition;
+                    in vec2 aAxisX;
+                    in vec2 aAxisY;
+                    in vec4 aTexRect;
+                    in vec4 aColor;
+                    in float aTexIndex;
+
+                    uniform mat4 uProjection;
+                    uniform vec4 uColorMultiplier;
+
+                    out vec2 vTexCoord;
+                    out vec4 vColor;
+                    out float vTexIndex;
+                    void main()
+                    {
+                        // the corner of the unit quad picked by the shared quad indices
+                        vec2 corner = vec2(gl_VertexID == 1 || gl_VertexID == 2 ? 1.0 : 0.0,
+                                           gl_VertexID >= 2 ? 1.0 : 0.0);
+
+                        vec2 position = aPosition + aAxisX * corner.x + aAxisY * corner.y;
+                        gl_Position = uProjection * vec4(position, 0.0, 1.0);
+                        vTexCoord = mix(aTexRect.xy, aTexRect.zw, corner);
+                        vColor = aColor * uColorMultiplier;
+                        vTexIndex = aTexIndex;
+                    }
+                )";
+
 static constexpr const char* fs_simple =
                 R"(
                     in vec4 vColor;
@@ -6,10 +6,11 @@ namespace
 {
 std::vector<context_wgl*> ctxs {};
 
+/// the context current on each thread
+thread_local context_wgl* current{};
+
 bool make_current_context(context_wgl* ctx)
 {
-    static context_wgl* current{};
-
     if(current != ctx)
     {
         if(wglMakeCurrent(ctx->hdc_, ctx->context_))
@@ -113,6 +114,7 @@ context_wgl::~context_wgl()
 
     wglMakeCurrent(nullptr, nullptr);
 	wglDeleteContext(context_);
+    current = nullptr;
 	ReleaseDC(hwnd_, hdc_);
 
     if (!ctxs.empty())
@@ -140,6 +142,22 @@ bool context_wgl::make_current()
     return make_current_context(this);
 }
 
+bool context_wgl::release_current()
+{
+    if(current != this)
+    {
+        return true;
+    }
+
+    if(wglMakeCurrent(nullptr, nullptr))
+    {
+        current = nullptr;
+        return true;
+    }
+
+    return false;
+}
+
 bool context_wgl::swap_buffers()
 {
     return SwapBuffers(hdc_);
@@ -12,6 +12,7 @@ struct context_wgl : context
 
     bool set_vsync(bool vsync) override;
     bool make_current() override;
+    bool release_current() override;
     bool swap_buffers() override;
 
     pixmap create_pixmap(const size&, pix_type) override { throw std::runtime_error("Not implemented!"); }
@@ -7,8 +7,10 @@
 
 #include <array>
 #include <cstdint>
+#include <cstring>
 #include <vector>
 #include <functional>
+#include <type_traits>
 
 namespace gfx
 {
@@ -29,11 +31,14 @@ enum programs : uint32_t
     halphamix,
     raw_alpha,
     grayscale,
-    blur
+    blur,
+    /// Sprites expanded from sprite_instance records. Not
+    /// created when the context does not support instancing.
+    instanced_sprite
 };
 
 /// Types of primitives to draw
-enum class primitive_type
+enum class primitive_type : uint8_t
 {
     triangles,
     triangle_fan,
@@ -43,12 +48,30 @@ enum class primitive_type
 };
 
 /// Types of primitives to draw
-enum class draw_type
+enum class draw_type : uint8_t
 {
     elements,
     array,
+    /// Triangles made of 4 vertices per quad without index data.
+    /// Drawn with the renderer's shared quad index buffer.
+    quads,
+    /// A reference to another list in draw_list::sub_lists.
+    /// Its vertices_offset is the index of the referenced list.
+    sub_list,
+    /// A reference to a static segment in draw_list::static_segments.
+    /// Its vertices_offset is the index of the referenced segment.
+    static_segment,
+    /// Instances of the shared unit quad. Its vertices_offset and vertices_count
+    /// are the first instance and the number of instances in draw_list::instances.
+    instanced,
 };
 
+/// References to other lists or segments carry no vertices of their own
+inline bool is_reference(draw_type type) noexcept
+{
+    return type == draw_type::sub_list || type == draw_type::static_segment;
+}
+
 
 struct gpu_program
 {
@@ -74,48 +97,100 @@ struct gpu_context
     const gpu_program& program;
 };
 
+/// A plain data uniform value. It is uploaded by the renderer
+/// right before the draw, without any callbacks involved.
+/// The name must outlive the draw list (e.g. a string literal).
+struct uniform_value
+{
+    enum class value_type : uint8_t
+    {
+        int1,
+        float1,
+        vec2,
+        vec4,
+        texture
+    };
+
+    const char* name{};
+    value_type type{value_type::int1};
+    /// texture slot, used only by textures
+    uint32_t slot{};
+    math::vec4 data{};
+    texture_view tex{};
+};
+
 struct program_setup
 {
     gpu_program program;
 
-    std::function<math::transformf()> get_gpu_transform;
+    /// Plain data uniforms. This is the preferred way of
+    /// passing custom uniforms to a program.
+    std::vector<uniform_value> uniforms;
+
+    /// Custom callbacks. This is the opt-in slow path
+    /// for setups which cannot be expressed as plain data.
     std::function<void(const gpu_context&)> begin;
     std::function<void(const gpu_context&)> end;
 
     /// this is used for batching
     uint64_t uniforms_hash{};
-};
 
-/// A draw command
-struct draw_cmd
-{
-    uint8_t get_texture_idx(const texture_view& tex)
+    void set_uniform(const char* name, int value)
     {
-        auto tex_idx = used_slots;
-
-        for(uint8_t i = 0; i < used_slots; ++i)
-        {
-            if(texture_slots[i] == tex)
-            {
-                tex_idx = i;
-                break;
-            }
-        }
-
-        return tex_idx;
+        add_uniform(name, uniform_value::value_type::int1, {float(value), 0.0f, 0.0f, 0.0f});
     }
 
-    void set_texture_idx(const texture_view& tex, uint8_t tex_idx)
+    void set_uniform(const char* name, float value)
     {
-        texture_slots[tex_idx] = tex;
-        used_slots++;
+        add_uniform(name, uniform_value::value_type::float1, {value, 0.0f, 0.0f, 0.0f});
     }
-    /// Type of primitive we're drawing
-    primitive_type type{primitive_type::triangles};
-    /// Type of draw method
-    draw_type dr_type{draw_type::elements};
-    /// Type of blend mode
-    blending_mode blend{blending_mode::blend_none};
+
+    void set_uniform(const char* name, const math::vec2& value)
+    {
+        add_uniform(name, uniform_value::value_type::vec2, {value.x, value.y, 0.0f, 0.0f});
+    }
+
+    void set_uniform(const char* name, const math::vec4& value)
+    {
+        add_uniform(name, uniform_value::value_type::vec4, value);
+    }
+
+    void set_uniform(const char* name, const texture_view& tex, uint32_t slot = 0)
+    {
+        auto& uniform = add_uniform(name, uniform_value::value_type::texture, {});
+        uniform.slot = slot;
+        uniform.tex = tex;
+        utils::hash(uniforms_hash, tex, slot);
+    }
+
+    bool has_custom_state() const noexcept
+    {
+        return !uniforms.empty() || begin || end;
+    }
+
+private:
+    uniform_value& add_uniform(const char* name, uniform_value::value_type type, const math::vec4& data)
+    {
+        uniforms.emplace_back();
+        auto& uniform = uniforms.back();
+        uniform.name = name;
+        uniform.type = type;
+        uniform.data = data;
+        // the name is hashed by content, equal names
+        // from different buffers must batch together
+        utils::hash(uniforms_hash, utils::hash_bytes(name, std::strlen(name)), data.x, data.y, data.z, data.w);
+        return uniform;
+    }
+};
+
+/// A draw command. Kept small and trivially copyable, everything
+/// bulky lives in the side tables of the owning draw_list.
+struct draw_cmd
+{
+    /// Program used for drawing
+    gpu_program program{};
+    /// Uniforms's hash used for batching.
+    uint64_t hash{0};
     /// Starting index for the index buffer buffer
     std::uint32_t indices_offset{0};
     /// Number of indices to draw
@@ -124,20 +199,37 @@ struct draw_cmd
     std::uint32_t vertices_offset{0};
     /// Number of vertices to draw
     std::uint32_t vertices_count{0};
-    /// Clipping rectangle
-    rect clip_rect{0, 0, 0, 0};
-    /// Program setup
-    program_setup setup{};
-
-    std::array<texture_view, 32> texture_slots{{}};
+    /// Index into draw_list::gpu_transforms. -1 when
+    /// the vertices are already transformed on the cpu.
+    int32_t transform_idx{-1};
+    /// Index into draw_list::clip_sets. -1 when not clipped.
+    int32_t clip_idx{-1};
+    /// Index into draw_list::crop_sets. -1 when not cropped.
+    int32_t crop_idx{-1};
+    /// Index into draw_list::setups for commands carrying
+    /// plain data uniforms or custom callbacks. -1 otherwise.
+    int32_t setup_idx{-1};
+    /// Starting index of the texture slots in draw_list::texture_slots
+    std::uint32_t slots_offset{0};
+    /// Number of requested commands merged into this one
+    std::uint32_t subcount{0};
+    /// Type of blend mode
+    blending_mode blend{blending_mode::blend_none};
+    /// Type of primitive we're drawing
+    primitive_type type{primitive_type::triangles};
+    /// Type of draw method
+    draw_type dr_type{draw_type::elements};
+    /// Vertex stream the command draws from
+    vertex_format format{vertex_format::full};
+    /// Number of used texture slots
     uint8_t used_slots{};
-    /// Uniforms's hash used for batching.
-    uint64_t hash{0};
-
-    size_t subcount{0};
-
+    /// Snap the gpu transform position to whole pixels.
+    bool pixel_snap{};
 };
 
+static_assert(sizeof(draw_cmd) <= 64, "draw_cmd should fit in a cache line");
+static_assert(std::is_trivially_copyable<draw_cmd>::value, "draw_cmd should be trivially copyable");
+
 }
 
 
@@ -7,10 +7,13 @@
 
 #include "font.h"
 #include "logger.h"
+#include "profiling.h"
 #include "renderer.h"
 #include "text.h"
 #include <algorithm>
 #include <iostream>
+#include <limits>
+#include <type_traits>
 
 namespace gfx
 {
@@ -68,15 +71,66 @@ inline uint64_t simple_hash() noexcept
     return seed;
 }
 
-inline bool can_be_batched(draw_list& list, uint64_t hash, const texture_view& tex, uint8_t& tex_idx) noexcept
+inline uint8_t get_texture_idx(const draw_list& list, const draw_cmd& cmd, const texture_view& tex) noexcept
 {
-//    EGT_BLOCK_PROFILING("draw_list::can_be_batched")
+    auto tex_idx = cmd.used_slots;
+
+    const auto* slots = list.texture_slots.data() + cmd.slots_offset;
+    for(uint8_t i = 0; i < cmd.used_slots; ++i)
+    {
+        if(slots[i] == tex)
+        {
+            tex_idx = i;
+            break;
+        }
+    }
+
+    return tex_idx;
+}
+
+inline void set_texture_idx(draw_list& list, draw_cmd& cmd, const texture_view& tex, uint8_t tex_idx)
+{
+    // only the last command receives new slots, so its slots are always at the end of the pool
+    assert(cmd.slots_offset + tex_idx == list.texture_slots.size() && "texture slots are not contiguous");
+    list.texture_slots.emplace_back(tex);
+    cmd.used_slots++;
+}
+
+/// Indices are relative to the first vertex of the command,
+/// so a command can grow only within its vertex window.
+inline bool fits_vertex_window(const draw_cmd& cmd, uint32_t vertices_before, uint32_t vertices_added) noexcept
+{
+    return vertices_before + vertices_added - cmd.vertices_offset <= draw_list::max_window_vertices;
+}
+
+inline bool can_be_batched(draw_list& list, uint64_t hash, const texture_view& tex,
+                           uint32_t vertices_before, uint32_t vertices_added, uint8_t& tex_idx) noexcept
+{
+    VIDEOPP_PROFILE_ZONE("draw_list::can_be_batched")
     if(list.commands.empty())
     {
         return false;
     }
 
     auto& cmd = list.commands.back();
+
+    if(is_reference(cmd.dr_type) || cmd.dr_type == draw_type::instanced)
+    {
+        return false;
+    }
+
+    // non indexed commands address a single vertex range, which
+    // may be broken by a look-back merge into an earlier command
+    if(cmd.dr_type != draw_type::elements && cmd.vertices_offset + cmd.vertices_count != vertices_before)
+    {
+        return false;
+    }
+
+    if(cmd.dr_type != draw_type::array && !fits_vertex_window(cmd, vertices_before, vertices_added))
+    {
+        return false;
+    }
+
     if(cmd.hash == hash)
     {
         if(!tex)
@@ -91,7 +145,7 @@ inline bool can_be_batched(draw_list& list, uint64_t hash, const texture_view& t
         {
             if(cmd.used_slots <= max_slots)
             {
-                tex_idx = cmd.get_texture_idx(tex);
+                tex_idx = get_texture_idx(list, cmd, tex);
                 return tex_idx < max_slots;
             }
         }
@@ -102,182 +156,405 @@ inline bool can_be_batched(draw_list& list, uint64_t hash, const texture_view& t
 
 inline void transform_vertices(draw_list& list, size_t vtx_offset, size_t vtx_count, bool pixel_snap)
 {
-//    EGT_BLOCK_PROFILING("draw_list::transform_vertices")
+    VIDEOPP_PROFILE_ZONE("draw_list::transform_vertices")
 
     if(!list.transforms.empty())
     {
         const auto& tr = list.transforms.back();
-        for(size_t i = vtx_offset; i < vtx_offset + vtx_count; ++i)
-        {
-            auto& v = list.vertices[i];
-            v.pos = tr.transform_coord(v.pos);
-
-            if(pixel_snap)
-            {
-                v.pos.x = float(int(v.pos.x));
-            }
-        }
+        gfx::transform_vertices(list.vertices.data() + vtx_offset, vtx_count, tr, pixel_snap);
+    }
+    else if(pixel_snap)
+    {
+        gfx::transform_vertices(list.vertices.data() + vtx_offset, vtx_count, math::transformf::identity(), pixel_snap);
     }
 }
 
-inline void apply_transform_and_texture(draw_list& list,
-                                    draw_cmd& cmd,
-                                    uint8_t tex_idx,
-                                    size_t vtx_offset,
-                                    size_t vtx_count,
-                                    bool pixel_snap,
-                                    const texture_view& texture,
-                                    bool apply_transform)
+inline void apply_texture(draw_list& list, draw_cmd& cmd, uint8_t tex_idx, size_t vtx_offset, size_t vtx_count, const texture_view& texture)
 {
-//    EGT_BLOCK_PROFILING("draw_list::apply_transform_and_texture")
+    VIDEOPP_PROFILE_ZONE("draw_list::apply_texture")
 
-    const auto& tr = [&]() -> const math::transformf&
+    if(!texture)
     {
-        if(!list.transforms.empty())
-        {
-            return list.transforms.back();
-        }
-
-        static math::transformf trans{};
-        return trans;
-    }();
+        return;
+    }
 
     if(tex_idx == cmd.used_slots)
     {
-        cmd.set_texture_idx(texture, tex_idx);
+        set_texture_idx(list, cmd, texture, tex_idx);
     }
 
-
     for(size_t i = vtx_offset; i < vtx_offset + vtx_count; ++i)
     {
         auto& v = list.vertices[i];
-        if(apply_transform)
-        {
-            v.pos = tr.transform_coord(v.pos);
+        v.tex_idx = tex_idx;
+    }
+}
+
+/// Bounds used by commands whose screen area is not known on the cpu
+/// (e.g. they are transformed on the gpu). They block any look-back.
+inline frect get_unbounded() noexcept
+{
+    constexpr auto max = std::numeric_limits<float>::max();
+    return {-max * 0.5f, -max * 0.5f, max, max};
+}
+
+inline frect get_vertices_bounds(const draw_list& list, size_t vtx_offset, size_t vtx_count) noexcept
+{
+    if(vtx_count == 0)
+    {
+        return {};
+    }
+
+    auto min = list.vertices[vtx_offset].pos;
+    auto max = min;
+    for(size_t i = vtx_offset + 1; i < vtx_offset + vtx_count; ++i)
+    {
+        const auto& pos = list.vertices[i].pos;
+        min = math::min(min, pos);
+        max = math::max(max, pos);
+    }
+
+    frect bounds{min.x, min.y, max.x - min.x, max.y - min.y};
+    // be conservative about lines and antialiased edges
+    bounds.expand(1.0f, 1.0f);
+    return bounds;
+}
+
+/// Searches the last few commands for one with the same state that
+/// the new primitive can be merged into. This is valid only if the
+/// primitive does not overlap anything drawn after that command,
+/// otherwise the painter's order would change.
+inline int64_t find_lookback_cmd(draw_list& list, uint64_t hash, const texture_view& tex,
+                                 uint32_t vertices_before, uint32_t vertices_added,
+                                 const frect& bounds, uint8_t& tex_idx) noexcept
+{
+    VIDEOPP_PROFILE_ZONE("draw_list::find_lookback_cmd")
+
+    auto& cfg = get_draw_config();
+    const auto count = list.commands.size();
+    if(cfg.batching_lookback == 0 || list.commands_bounds.size() != count)
+    {
+        return -1;
+    }
 
-            if(pixel_snap)
+    const auto first = count - std::min(count, cfg.batching_lookback + 1);
+    for(auto i = count; i-- > first;)
+    {
+        // the last command was already checked by can_be_batched
+        if(i + 1 < count)
+        {
+            const auto& cmd = list.commands[i];
+            if(cmd.hash == hash && cmd.dr_type == draw_type::elements &&
+               fits_vertex_window(cmd, vertices_before, vertices_added))
             {
-                v.pos.x = float(int(v.pos.x));
+                if(!tex)
+                {
+                    return int64_t(i);
+                }
+
+                // new slots can be added only at the end of the pool
+                auto idx = get_texture_idx(list, cmd, tex);
+                bool has_slot = idx < cmd.used_slots;
+                bool can_add_slot = cmd.slots_offset + cmd.used_slots == list.texture_slots.size() &&
+                                    idx < cfg.max_textures_per_batch;
+                if(has_slot || can_add_slot)
+                {
+                    tex_idx = idx;
+                    return int64_t(i);
+                }
             }
         }
-        if(texture)
+
+        if(list.commands_bounds[i].is_overlapping(bounds))
         {
-            v.tex_idx = tex_idx;
+            break;
         }
     }
-}
 
+    return -1;
+}
 
-inline void apply_texture(draw_list& list, draw_cmd& cmd, uint8_t tex_idx, size_t vtx_offset, size_t vtx_count, const texture_view& texture)
+/// Moves the freshly added indices right after the indices of the
+/// command at cmd_idx, shifting the commands recorded after it.
+inline void move_indices_to_cmd(draw_list& list, size_t cmd_idx, uint32_t indices_before, uint32_t indices_added)
 {
-//    EGT_BLOCK_PROFILING("draw_list::apply_texture")
+    auto& cmd = list.commands[cmd_idx];
+    auto insert_at = cmd.indices_offset + cmd.indices_count;
+    auto begin = std::begin(list.indices);
+    std::rotate(begin + insert_at, begin + indices_before, begin + indices_before + indices_added);
 
-    if(tex_idx == cmd.used_slots)
+    for(size_t i = cmd_idx + 1; i < list.commands.size(); ++i)
     {
-        cmd.set_texture_idx(texture, tex_idx);
+        list.commands[i].indices_offset += indices_added;
     }
+}
 
-    for(size_t i = vtx_offset; i < vtx_offset + vtx_count; ++i)
+inline int32_t get_clip_idx(draw_list& list)
+{
+    if(list.clip_rects.empty() || !list.clip_rects.back())
     {
-        auto& v = list.vertices[i];
-        v.tex_idx = tex_idx;
+        return -1;
+    }
+
+    // consecutive commands usually share the same clip rect
+    const auto& clip = list.clip_rects.back();
+    if(list.clip_sets.empty() || list.clip_sets.back() != clip)
+    {
+        list.clip_sets.emplace_back(clip);
     }
+
+    return int32_t(list.clip_sets.size()) - 1;
 }
 
+inline int32_t get_crop_idx(draw_list& list)
+{
+    if(list.crop_areas.empty())
+    {
+        return -1;
+    }
+
+    // consecutive commands usually share the same crop set
+    const auto& crop = list.crop_areas.back();
+    if(list.crop_sets.empty() || list.crop_sets.back() != crop)
+    {
+        list.crop_sets.emplace_back(crop);
+    }
 
-std::function<void(const gpu_context&)> crop_rects_setup(const draw_list& list)
+    return int32_t(list.crop_sets.size()) - 1;
+}
+
+inline void add_reference_cmd(draw_list& list, draw_type dr_type, size_t idx)
 {
-    if(!list.crop_areas.empty())
+    list.commands.emplace_back();
+    auto& cmd = list.commands.back();
+    cmd.dr_type = dr_type;
+    cmd.vertices_offset = uint32_t(idx);
+    cmd.clip_idx = get_clip_idx(list);
+    cmd.slots_offset = uint32_t(list.texture_slots.size());
+    if(!list.transforms.empty())
     {
-        return [rects = list.crop_areas.back()](const gpu_context& ctx) mutable
-        {
-            if(ctx.program.shader->has_uniform("uRects[0]"))
-            {
-                if (!ctx.rend.is_with_fbo())
-                {
-                    for (auto& area : rects)
-                    {
-                        area.y = ctx.rend.get_rect().h - (area.y + area.h);
-                    }
-                }
+        list.gpu_transforms.emplace_back(list.transforms.back());
+        cmd.transform_idx = int32_t(list.gpu_transforms.size()) - 1;
+    }
 
-                auto transform = ctx.rend.get_transform();
-                const auto& scale = transform.get_scale();
-                const auto& pos = transform.get_position();
-                for (auto& area : rects)
-                {
-                    area.x = int(float(area.x) * scale.x + pos.x);
-                    area.y = int(float(area.y) * scale.y + pos.y);
-                    area.w = int(float(area.w) * scale.x);
-                    area.h = int(float(area.h) * scale.y);
-                }
+    // the referenced commands are not known here, so nothing
+    // may be merged across the reference
+    if(list.commands_bounds.size() + 1 == list.commands.size())
+    {
+        list.commands_bounds.emplace_back(get_unbounded());
+    }
+}
 
-                ctx.program.shader->set_uniform("uRects[0]", rects);
-                ctx.program.shader->set_uniform("uRectsCount", int(rects.size()));
-            }
-        };
+template<typename Setup>
+inline void setup_cmd(draw_list& list, draw_cmd& cmd, Setup&& setup, bool apply_transform, bool pixel_snap)
+{
+    VIDEOPP_PROFILE_ZONE("draw_list::setup_cmd")
+
+    cmd.program = setup.program;
+    cmd.pixel_snap = pixel_snap;
+    cmd.clip_idx = get_clip_idx(list);
+    cmd.crop_idx = get_crop_idx(list);
+    cmd.slots_offset = uint32_t(list.texture_slots.size());
+
+    if(!apply_transform && !list.transforms.empty())
+    {
+        list.gpu_transforms.emplace_back(list.transforms.back());
+        cmd.transform_idx = int32_t(list.gpu_transforms.size()) - 1;
     }
 
-    return nullptr;
+    // only setups with custom state go to the side table
+    if(setup.has_custom_state())
+    {
+        list.setups.emplace_back(std::forward<Setup>(setup));
+        cmd.setup_idx = int32_t(list.setups.size()) - 1;
+    }
 }
 
+inline uint16_t to_unorm16(float value) noexcept
+{
+    return uint16_t(value * 65535.0f + 0.5f);
+}
 
-inline void setup_cmd(draw_list& list, draw_cmd& cmd, bool apply_transform = true, bool pixel_snap = false)
+/// Adds a sprite instance, batched with the last command when it draws
+/// instances with the same state. Sprites are never merged across other
+/// commands, so the painter's order with the non instanced ones is kept.
+inline void add_instance_impl(draw_list& list, const texture_view& texture, std::array<math::vec2, 4> points,
+                              const color& col, const math::vec2& min_uv, const math::vec2& max_uv)
 {
-    // check if a new command was added
-    bool setup_gpu_transform = !apply_transform && !list.transforms.empty();
-    if(!cmd.setup.begin)
+    VIDEOPP_PROFILE_ZONE("draw_list::add_instance_impl")
+
+    if(!list.transforms.empty())
+    {
+        const auto& tr = list.transforms.back();
+        for(auto& p : points)
+        {
+            p = tr.transform_coord(p);
+        }
+    }
+
+    rect clip{};
+    if(!list.clip_rects.empty())
     {
-        //        EGT_BLOCK_PROFILING("draw_list::new_cmd_added")
+        clip = list.clip_rects.back();
+    }
 
-        if(setup_gpu_transform)
+    auto blend = texture.blending;
+    if(col.a < 255)
+    {
+        blend = blending_mode::blend_normal;
+    }
+    if(!list.blend_modes.empty())
+    {
+        blend = list.blend_modes.back();
+    }
+
+    list.commands_requested++;
+
+    program_setup setup{};
+    setup.program = get_program<programs::instanced_sprite>();
+
+    uint64_t hash{0};
+    utils::hash(hash, draw_type::instanced, blend, clip, setup.program.shader);
+
+    const auto instance_idx = uint32_t(list.instances.size());
+    const auto max_slots = get_draw_config().max_textures_per_batch;
+
+    bool track_bounds = get_draw_config().batching_lookback > 0 &&
+                        list.commands_bounds.size() == list.commands.size();
+    frect bounds{};
+    if(track_bounds)
+    {
+        auto min_x = std::min(std::min(points[0].x, points[1].x), std::min(points[2].x, points[3].x));
+        auto min_y = std::min(std::min(points[0].y, points[1].y), std::min(points[2].y, points[3].y));
+        auto max_x = std::max(std::max(points[0].x, points[1].x), std::max(points[2].x, points[3].x));
+        auto max_y = std::max(std::max(points[0].y, points[1].y), std::max(points[2].y, points[3].y));
+        bounds = {min_x, min_y, max_x - min_x, max_y - min_y};
+    }
+
+    uint8_t tex_idx = 0;
+    bool batched = false;
+    if(!list.commands.empty())
+    {
+        const auto& last = list.commands.back();
+        if(last.dr_type == draw_type::instanced && last.hash == hash &&
+           last.vertices_offset + last.vertices_count == instance_idx && last.used_slots <= max_slots)
         {
-            cmd.setup.get_gpu_transform = [transform = list.transforms.back()]()
-            {
-                return transform;
-            };
+            tex_idx = get_texture_idx(list, last, texture);
+            batched = tex_idx < max_slots;
         }
+    }
 
-        cmd.setup.begin = [setup_crop_rects = crop_rects_setup(list),
-                           pixel_snap]
-            (const gpu_context& ctx) mutable
+    if(!batched)
+    {
+        list.commands.emplace_back();
+        auto& command = list.commands.back();
+        command.dr_type = draw_type::instanced;
+        command.format = vertex_format::instance;
+        command.vertices_offset = instance_idx;
+        // the indices of the shared unit quad
+        command.indices_count = 6;
+        command.hash = hash;
+        command.blend = blend;
+        setup_cmd(list, command, std::move(setup), true, false);
+        tex_idx = 0;
+
+        if(track_bounds)
         {
-            if(ctx.cmd.setup.get_gpu_transform)
-            {
-                auto transform = ctx.cmd.setup.get_gpu_transform();
+            list.commands_bounds.emplace_back(bounds);
+        }
+    }
+    else if(track_bounds)
+    {
+        auto& cmd_bounds = list.commands_bounds.back();
+        auto min_x = std::min(cmd_bounds.x, bounds.x);
+        auto min_y = std::min(cmd_bounds.y, bounds.y);
+        auto max_x = std::max(cmd_bounds.x + cmd_bounds.w, bounds.x + bounds.w);
+        auto max_y = std::max(cmd_bounds.y + cmd_bounds.h, bounds.y + bounds.h);
+        cmd_bounds = {min_x, min_y, max_x - min_x, max_y - min_y};
+    }
 
-                auto pos = transform.get_position();
+    auto& command = list.commands.back();
+    if(tex_idx == command.used_slots)
+    {
+        set_texture_idx(list, command, texture, tex_idx);
+    }
+    command.vertices_count++;
+    command.subcount++;
 
-                if(pixel_snap)
-                {
-                    pos.x = float(int(pos.x));
-                }
-                transform.set_position(pos.x, pos.y, 0);
+    list.instances.emplace_back();
+    auto& instance = list.instances.back();
+    instance.pos = points[0];
+    instance.axis_x = points[1] - points[0];
+    instance.axis_y = points[3] - points[0];
+    instance.uv[0] = to_unorm16(min_uv.x);
+    instance.uv[1] = to_unorm16(min_uv.y);
+    instance.uv[2] = to_unorm16(max_uv.x);
+    instance.uv[3] = to_unorm16(max_uv.y);
+    instance.col = col;
+    instance.tex_idx = tex_idx;
+}
 
-                ctx.rend.push_transform(transform);
-            }
+/// Appends the indices of a primitive added without any, relative
+/// to its first vertex. Only triangles and lines are indexed.
+template<typename Index>
+inline void add_primitive_indices(std::vector<Index>& indices, primitive_type type, uint32_t vertices_added)
+{
+    const auto indices_before = indices.size();
+    switch(type)
+    {
+        case primitive_type::triangles:
+        {
+            const uint32_t rect_vertices = 4;
+            const uint32_t rects = vertices_added / rect_vertices;
 
-            if(setup_crop_rects)
+            indices.resize(indices_before + (rects * (rect_vertices - 2)) * 3);
+            auto* out = indices.data() + indices_before;
+            uint32_t index_offset = 0;
+            for(uint32_t r = 0; r < rects; ++r)
             {
-                setup_crop_rects(ctx);
+                for(uint32_t i = 2; i < rect_vertices; ++i)
+                {
+                    *out++ = Index(index_offset);
+                    *out++ = Index(index_offset + i - 1);
+                    *out++ = Index(index_offset + i);
+                }
+                index_offset += rect_vertices;
             }
-
-            if(ctx.program.shader->has_uniform("uTextures[0]"))
+        }
+        break;
+        case primitive_type::lines:
+        case primitive_type::lines_loop:
+        {
+            if(vertices_added >= 2)
             {
-                ctx.program.shader->set_uniform("uTextures[0]", ctx.cmd.texture_slots, ctx.cmd.used_slots);
+                indices.resize(indices_before + (vertices_added - 1) * 2);
+                auto* out = indices.data() + indices_before;
+                for(uint32_t i = 0; i < vertices_added - 1; ++i)
+                {
+                    *out++ = Index(i);
+                    *out++ = Index(i + 1);
+                }
             }
-        };
+        }
+        break;
+        default:
+            break;
     }
+}
+
+/// Replaces the vertices of the primitive at the end of the list with
+/// the vertices its indices refer to, in index order, so that it draws
+/// the same without indices.
+inline void expand_indexed_vertices(draw_list& list, uint32_t vertices_before, const std::vector<uint32_t>& indices)
+{
+    assert(vertices_before <= list.vertices.size() && "invalid primitive");
+    const std::vector<vertex_2d> primitive(list.vertices.begin() + vertices_before, list.vertices.end());
 
-    if(!cmd.setup.end)
+    list.vertices.resize(vertices_before + indices.size());
+    auto* out = list.vertices.data() + vertices_before;
+    for(auto idx : indices)
     {
-        cmd.setup.end = [](const gpu_context& ctx)
-        {
-            if(ctx.cmd.setup.get_gpu_transform)
-            {
-                ctx.rend.pop_transform();
-            }
-        };
+        *out++ = primitive[idx];
     }
 }
 
@@ -287,56 +564,45 @@ inline draw_cmd& add_cmd_impl(draw_list& list, draw_type dr_type, uint32_t verti
                               Setup&& setup, const texture_view& texture = {},
                               bool apply_transform = true, bool pixel_snap = false)
 {
-//    EGT_BLOCK_PROFILING("draw_list::add_cmd_impl")
+    VIDEOPP_PROFILE_ZONE("draw_list::add_cmd_impl")
 
-    if(indices_added == 0)
+    if(indices_added == 0 && dr_type == draw_type::elements)
     {
-        if(dr_type == draw_type::elements)
+        if(vertices_added > draw_list::max_window_vertices)
         {
-            auto index_offset = vertices_before;
-            switch(type)
+            // too many vertices for 16 bit indices, so the primitive
+            // is expanded by wide indices and drawn without any
+            std::vector<uint32_t> primitive_indices;
+            add_primitive_indices(primitive_indices, type, vertices_added);
+            if(!primitive_indices.empty())
             {
-                case primitive_type::triangles:
-                {
-                    const uint32_t rect_vertices = 4;
-                    const uint32_t rects = vertices_added / rect_vertices;
-                    // indices added will be (rects * (rect_vertices - 2)) * 3;
-                    list.indices.resize(indices_before + (rects * (rect_vertices - 2)) * 3);
-                    for(uint32_t r = 0; r < rects; ++r)
-                    {
-                        for(uint32_t i = 2; i < rect_vertices; ++i)
-                        {
-                            draw_list::index_t src_indices[] = {index_offset, index_offset + i - 1, index_offset + i};
-                            std::memcpy(list.indices.data() + indices_before + indices_added, src_indices, sizeof(src_indices));
-                            indices_added += 3;
-                        }
-                        index_offset += rect_vertices;
-                    }
-                }
-                break;
-                case primitive_type::lines:
-                case primitive_type::lines_loop:
-                {
-                    if(vertices_added >= 2)
-                    {
-                        list.indices.resize(indices_before + (vertices_added - 1) * 2);
-
-                        for(uint32_t i = 0; i < vertices_added - 1; ++i)
-                        {
-                            draw_list::index_t src_indices[] = {index_offset + i, index_offset + i + 1};
-                            std::memcpy(list.indices.data() + indices_before + indices_added, src_indices, sizeof(src_indices));
-                            indices_added += 2;
-                        }
-                    }
-                }
-                break;
-                default:
-                    break;
+                expand_indexed_vertices(list, vertices_before, primitive_indices);
+                vertices_added = uint32_t(primitive_indices.size());
             }
+            dr_type = draw_type::array;
+        }
+        else if(type == primitive_type::triangles && vertices_added % 4 == 0)
+        {
+            // whole quads share the renderer's static quad indices
+            // so they don't write any indices at all
+            dr_type = draw_type::quads;
+        }
+        else
+        {
+            add_primitive_indices(list.indices, type, vertices_added);
+            indices_added = uint32_t(list.indices.size()) - indices_before;
         }
     }
 
+    if(dr_type == draw_type::quads)
+    {
+        // the count of the shared quad indices to draw
+        indices_added = (vertices_added / 4) * 6;
+    }
 
+    // a single primitive must fit in a vertex window
+    assert((dr_type == draw_type::array || vertices_added <= draw_list::max_window_vertices) &&
+           "primitive has too many vertices for 16 bit indices");
 
     rect clip{};
     if(!list.clip_rects.empty())
@@ -350,6 +616,25 @@ inline draw_cmd& add_cmd_impl(draw_list& list, draw_type dr_type, uint32_t verti
         blend = list.blend_modes.back();
     }
 
+    list.commands_requested++;
+
+    if(apply_transform)
+    {
+        transform_vertices(list, vertices_before, vertices_added, pixel_snap);
+    }
+
+    // programs which declare a compact layout get their vertices
+    // in the compact stream if that doesn't lose any data
+    auto format = vertex_format::full;
+    if(setup.program.shader && setup.program.shader->get_layout(vertex_format::compact) &&
+       is_compactable(list.vertices.data() + vertices_before, vertices_added))
+    {
+        format = vertex_format::compact;
+    }
+
+    // the position of the primitive in its vertex stream
+    const auto stream_before = format == vertex_format::compact ? uint32_t(list.compact_vertices.size()) : vertices_before;
+
     uint8_t tex_idx = 0;
 
     const auto add_new_command = [&](uint64_t hash) {
@@ -357,61 +642,116 @@ inline draw_cmd& add_cmd_impl(draw_list& list, draw_type dr_type, uint32_t verti
         auto& command = list.commands.back();
         command.type = type;
         command.dr_type = dr_type;
-        command.vertices_offset = vertices_before;
+        command.format = format;
+        command.vertices_offset = stream_before;
         command.indices_offset = indices_before;
-        command.setup = std::forward<Setup>(setup);
         command.hash = hash;
         command.blend = blend;
-        command.clip_rect = clip;
+        setup_cmd(list, command, std::forward<Setup>(setup), apply_transform, pixel_snap);
         tex_idx = command.used_slots;
     };
 
-    list.commands_requested++;
-
     bool should_consider_batching = texture && apply_transform;
 
-    if(setup.uniforms_hash == 0 && !should_consider_batching)
+    // commands with their own gpu transform cannot be batched
+    bool needs_gpu_transform = !apply_transform && !list.transforms.empty();
+
+    bool track_bounds = get_draw_config().batching_lookback > 0 &&
+                        list.commands_bounds.size() == list.commands.size();
+    frect bounds{};
+    if(track_bounds)
+    {
+        bounds = needs_gpu_transform ? get_unbounded() : get_vertices_bounds(list, vertices_before, vertices_added);
+    }
+
+    size_t cmd_idx = list.commands.size();
+    if((setup.uniforms_hash == 0 && !should_consider_batching) || needs_gpu_transform)
     {
         add_new_command(0);
     }
     else
     {
         auto hash = setup.uniforms_hash;
-        utils::hash(hash, dr_type, type, blend, clip, setup.program.shader);
-        if(!can_be_batched(list, hash, texture, tex_idx))
+        utils::hash(hash, dr_type, type, format, blend, clip, setup.program.shader);
+        if(can_be_batched(list, hash, texture, stream_before, vertices_added, tex_idx))
+        {
+            cmd_idx = list.commands.size() - 1;
+        }
+        else
         {
-            add_new_command(hash);
+            auto lookback_idx = dr_type == draw_type::elements ?
+                                find_lookback_cmd(list, hash, texture, stream_before, vertices_added, bounds, tex_idx) : -1;
+            if(lookback_idx >= 0)
+            {
+                cmd_idx = size_t(lookback_idx);
+                move_indices_to_cmd(list, cmd_idx, indices_before, indices_added);
+                list.commands_lookback_batched++;
+            }
+            else
+            {
+                add_new_command(hash);
+            }
         }
     }
 
-    auto& command = list.commands.back();
+    if(track_bounds)
+    {
+        if(cmd_idx == list.commands_bounds.size())
+        {
+            list.commands_bounds.emplace_back(bounds);
+        }
+        else
+        {
+            auto& cmd_bounds = list.commands_bounds[cmd_idx];
+            auto min_x = std::min(cmd_bounds.x, bounds.x);
+            auto min_y = std::min(cmd_bounds.y, bounds.y);
+            auto max_x = std::max(cmd_bounds.x + cmd_bounds.w, bounds.x + bounds.w);
+            auto max_y = std::max(cmd_bounds.y + cmd_bounds.h, bounds.y + bounds.h);
+            cmd_bounds = {min_x, min_y, max_x - min_x, max_y - min_y};
+        }
+    }
+
+    auto& command = list.commands[cmd_idx];
 
-    apply_transform_and_texture(list,
-                                command,
-                                tex_idx,
-                                vertices_before,
-                                vertices_added,
-                                pixel_snap,
-                                texture,
-                                apply_transform);
+    apply_texture(list, command, tex_idx, vertices_before, vertices_added, texture);
+
+    // rebase the primitive's indices to the first vertex of the command
+    if(dr_type == draw_type::elements && command.vertices_offset < stream_before)
+    {
+        const auto base = stream_before - command.vertices_offset;
+        auto* idx = list.indices.data() + command.indices_offset + command.indices_count;
+        for(uint32_t i = 0; i < indices_added; ++i)
+        {
+            idx[i] = draw_list::index_t(idx[i] + base);
+        }
+    }
 
     command.indices_offset = std::min(command.indices_offset, indices_before);
     command.indices_count += indices_added;
-    command.vertices_offset = std::min(command.vertices_offset, vertices_before);
+    command.vertices_offset = std::min(command.vertices_offset, stream_before);
     command.vertices_count += vertices_added;
     command.subcount++;
 
-    setup_cmd(list, command, apply_transform, pixel_snap);
+    // move the finished vertices to the compact stream
+    if(format == vertex_format::compact)
+    {
+        assert(vertices_before + vertices_added == list.vertices.size() && "vertices are not at the end of the list");
+        list.compact_vertices.resize(stream_before + vertices_added);
+        to_compact_vertices(list.vertices.data() + vertices_before, vertices_added,
+                            list.compact_vertices.data() + stream_before);
+        list.vertices.resize(vertices_before);
+    }
 
     return command;
 }
 
 
-inline void prim_resize(draw_list& list, size_t idx_count, size_t vtx_count, size_t& idx_current_idx, size_t& vtx_current_idx)
+template<typename Index>
+inline void prim_resize(draw_list& list, std::vector<Index>& indices, size_t idx_count, size_t vtx_count, size_t& idx_current_idx, size_t& vtx_current_idx)
 {
-    idx_current_idx = list.indices.size();
+    idx_current_idx = indices.size();
     vtx_current_idx = list.vertices.size();
-    list.indices.resize(list.indices.size() + idx_count);
+    indices.resize(indices.size() + idx_count);
     list.vertices.resize(list.vertices.size() + vtx_count);
 }
 
@@ -468,7 +808,7 @@ template<typename Setup>
 inline draw_cmd& add_vertices_impl(draw_list& list, draw_type dr_type, const vertex_2d* verts, size_t count,
                                    primitive_type type, const texture_view& texture, blending_mode blend, Setup&& setup, bool apply_transform = true, bool pixel_snap = false)
 {
-//    EGT_BLOCK_PROFILING("draw_list::add_vertices_impl %d", int(count))
+    VIDEOPP_PROFILE_ZONE("draw_list::add_vertices_impl", int(count))
 
     assert(verts != nullptr && count > 0 && "invalid input for memcpy");
     const auto vtx_offset = uint32_t(list.vertices.size());
@@ -795,6 +1135,8 @@ const program_setup& empty_setup() noexcept
     return setup;
 }
 
+constexpr size_t draw_list::max_window_vertices;
+
 draw_list::draw_list(bool has_debug_info)
 {
     constexpr size_t vertices_reserved = 128;
@@ -807,6 +1149,8 @@ draw_list::draw_list(bool has_debug_info)
     indices.reserve(indices_reserved);
     cache<draw_list>::get(commands, commands_reserved);
     commands.reserve(commands_reserved);
+    cache<draw_list>::get(texture_slots, commands_reserved);
+    texture_slots.reserve(commands_reserved);
 
     clip_rects.reserve(4);
     crop_areas.reserve(4);
@@ -825,18 +1169,30 @@ draw_list::~draw_list()
     cache<draw_list>::add(vertices);
     cache<draw_list>::add(indices);
     cache<draw_list>::add(commands);
+    cache<draw_list>::add(texture_slots);
 }
 void draw_list::clear() noexcept
 {
     vertices.clear();
+    compact_vertices.clear();
+    instances.clear();
     indices.clear();
     commands.clear();
+    texture_slots.clear();
+    clip_sets.clear();
+    gpu_transforms.clear();
+    crop_sets.clear();
+    setups.clear();
+    sub_lists.clear();
+    static_segments.clear();
+    commands_bounds.clear();
     clip_rects.clear();
     crop_areas.clear();
     blend_modes.clear();
     transforms.clear();
     programs.clear();
     commands_requested = 0;
+    commands_lookback_batched = 0;
 
     if(debug)
     {
@@ -981,11 +1337,8 @@ void draw_list::add_movie_images(const texture_view& rgb_texture, const texture_
 
     program_setup setup;
     setup.program = get_program<programs::alphamix>();
-    setup.begin = [rgb_texture, alpha_texture](const auto& ctx)
-    {
-        ctx.program.shader->set_uniform("uTextureRGB", rgb_texture, 0);
-        ctx.program.shader->set_uniform("uTextureAlpha", alpha_texture, 1);
-    };
+    setup.set_uniform("uTextureRGB", rgb_texture, 0);
+    setup.set_uniform("uTextureAlpha", alpha_texture, 1);
 
     push_blend(blending_mode::blend_normal);
     add_image(rgb_texture, src, dst, transform, col, flip, setup);
@@ -1098,7 +1451,7 @@ void draw_list::add_image(const texture_view& texture, const std::array<math::ve
                           const color& col, math::vec2 min_uv, math::vec2 max_uv,
                           flip_format flip, const program_setup& setup)
 {
-//    EGT_BLOCK_PROFILING("draw_list::add_image")
+    VIDEOPP_PROFILE_ZONE("draw_list::add_image")
 
     apply_linear_filtering_correction(texture, min_uv, max_uv);
 
@@ -1163,6 +1516,71 @@ void draw_list::add_image(const texture_view& texture, const std::array<math::ve
     }
 }
 
+void draw_list::add_image_instanced(const texture_view& texture, const rect& src, const rect& dst,
+                                    const math::transformf& transform, const color& col, flip_format flip)
+{
+    const auto rect = texture ? gfx::rect{0, 0, int(texture.width), int(texture.height)} : src;
+    float left = static_cast<float>(src.x) / rect.w;
+    float right = static_cast<float>(src.x + src.w) / rect.w;
+    float top = static_cast<float>(src.y) / rect.h;
+    float bottom = static_cast<float>(src.y + src.h) / rect.h;
+    const math::vec2 min_uv = {left, top};
+    const math::vec2 max_uv = {right, bottom};
+
+    add_image_instanced(texture, transform_rect(dst, transform), col, min_uv, max_uv, flip);
+}
+
+void draw_list::add_image_instanced(const texture_view& texture, const rect& dst, const color& col,
+                                    math::vec2 min_uv, math::vec2 max_uv, flip_format flip)
+{
+    add_image_instanced(texture, transform_rect(dst), col, min_uv, max_uv, flip);
+}
+
+void draw_list::add_image_instanced(const texture_view& texture, const std::array<math::vec2, 4>& points,
+                                    const color& col, math::vec2 min_uv, math::vec2 max_uv, flip_format flip)
+{
+    const auto in_unit_range = [](const math::vec2& uv)
+    {
+        return uv.x >= 0.0f && uv.x <= 1.0f && uv.y >= 0.0f && uv.y <= 1.0f;
+    };
+
+    // the instanced program samples multi channel textures only
+    if(!get_program<programs::instanced_sprite>().shader || !texture || texture.format == pix_type::gray ||
+       !crop_areas.empty() || !programs.empty() || !in_unit_range(min_uv) || !in_unit_range(max_uv))
+    {
+        add_image(texture, points, col, min_uv, max_uv, flip);
+        return;
+    }
+
+    apply_linear_filtering_correction(texture, min_uv, max_uv);
+
+    switch (flip)
+    {
+        case flip_format::horizontal:
+            std::swap(min_uv.x, max_uv.x);
+            break;
+        case flip_format::vertical:
+            std::swap(min_uv.y, max_uv.y);
+            break;
+        case flip_format::both:
+            std::swap(min_uv.x, max_uv.x);
+            std::swap(min_uv.y, max_uv.y);
+            break;
+        default:
+            break;
+    }
+
+    add_instance_impl(*this, texture, points, col, min_uv, max_uv);
+
+    if(debug_draw())
+    {
+        if(debug)
+        {
+            debug->add_rect(points, col, false);
+        }
+    }
+}
+
 void draw_list::add_vertices(draw_type dr_type, const vertex_2d* vertices, size_t count, primitive_type type, const texture_view& texture, const program_setup& setup)
 {
     if(count == 0)
@@ -1177,6 +1595,8 @@ void draw_list::add_list(const draw_list& list, bool transform_verts)
     list.validate_stacks();
 
     auto vtx_offset = vertices.size();
+    auto compact_vtx_offset = compact_vertices.size();
+    auto instances_offset = instances.size();
     auto idx_offset = indices.size();
     auto cmd_offset = commands.size();
     auto vertices_size = list.vertices.size();
@@ -1186,64 +1606,148 @@ void draw_list::add_list(const draw_list& list, bool transform_verts)
                 list.vertices.data(),
                 list.vertices.size() * sizeof(decltype (list.vertices)::value_type));
 
+    compact_vertices.resize(compact_vtx_offset + list.compact_vertices.size());
+    std::memcpy(compact_vertices.data() + compact_vtx_offset,
+                list.compact_vertices.data(),
+                list.compact_vertices.size() * sizeof(decltype (list.compact_vertices)::value_type));
+
+    instances.resize(instances_offset + list.instances.size());
+    std::memcpy(instances.data() + instances_offset,
+                list.instances.data(),
+                list.instances.size() * sizeof(decltype (list.instances)::value_type));
+
     indices.resize(idx_offset + list.indices.size());
     std::memcpy(indices.data() + idx_offset,
                 list.indices.data(),
                 list.indices.size() * sizeof(decltype (list.indices)::value_type));
-    if(vtx_offset != 0)
+    // indices are relative to their commands, so they are copied as is
+
+    auto slots_offset = uint32_t(texture_slots.size());
+    auto clip_sets_offset = int32_t(clip_sets.size());
+    auto transforms_offset = int32_t(gpu_transforms.size());
+    auto crop_sets_offset = int32_t(crop_sets.size());
+    auto setups_offset = int32_t(setups.size());
+    auto sub_lists_offset = uint32_t(sub_lists.size());
+    auto static_segments_offset = uint32_t(static_segments.size());
+
+    texture_slots.insert(std::end(texture_slots), std::begin(list.texture_slots), std::end(list.texture_slots));
+    clip_sets.insert(std::end(clip_sets), std::begin(list.clip_sets), std::end(list.clip_sets));
+    gpu_transforms.insert(std::end(gpu_transforms), std::begin(list.gpu_transforms), std::end(list.gpu_transforms));
+    crop_sets.insert(std::end(crop_sets), std::begin(list.crop_sets), std::end(list.crop_sets));
+    setups.insert(std::end(setups), std::begin(list.setups), std::end(list.setups));
+    sub_lists.insert(std::end(sub_lists), std::begin(list.sub_lists), std::end(list.sub_lists));
+    static_segments.insert(std::end(static_segments), std::begin(list.static_segments), std::end(list.static_segments));
+
+    // commands are trivially copyable, so copy them in bulk
+    auto start_cmd_idx = commands.size();
+    commands.resize(start_cmd_idx + list.commands.size());
+    std::memcpy(commands.data() + start_cmd_idx,
+                list.commands.data(),
+                list.commands.size() * sizeof(decltype (list.commands)::value_type));
+
+    // remap the side table references
+    for(size_t i = start_cmd_idx; i < commands.size(); ++i)
     {
-        // offset the indices from the new list with the current
-        for(size_t i = idx_offset, sz = indices.size(); i < sz; ++i)
+        auto& cmd = commands[i];
+        cmd.slots_offset += slots_offset;
+        if(cmd.clip_idx >= 0)
         {
-            indices[i] += static_cast<index_t>(vtx_offset);
+            cmd.clip_idx += clip_sets_offset;
+        }
+        if(cmd.transform_idx >= 0)
+        {
+            cmd.transform_idx += transforms_offset;
+        }
+        if(cmd.crop_idx >= 0)
+        {
+            cmd.crop_idx += crop_sets_offset;
+        }
+        if(cmd.setup_idx >= 0)
+        {
+            cmd.setup_idx += setups_offset;
+        }
+        if(cmd.dr_type == draw_type::sub_list)
+        {
+            cmd.vertices_offset += sub_lists_offset;
+        }
+        else if(cmd.dr_type == draw_type::static_segment)
+        {
+            cmd.vertices_offset += static_segments_offset;
         }
-
     }
 
-    // These are not trivially copiable. So the memcpy is a no-no
-    auto start_cmd_idx = commands.size();
-    commands.reserve(start_cmd_idx + list.commands.size());
-    std::copy(std::begin(list.commands), std::end(list.commands), std::back_inserter(commands));
+    bool transformed = transform_verts && !transforms.empty();
+
+    // keep the look-back bounds in sync
+    if(commands_bounds.size() == start_cmd_idx)
+    {
+        if(!transformed && list.commands_bounds.size() == list.commands.size())
+        {
+            commands_bounds.insert(std::end(commands_bounds), std::begin(list.commands_bounds), std::end(list.commands_bounds));
+        }
+        else
+        {
+            commands_bounds.resize(commands.size(), get_unbounded());
+        }
+    }
 
     if(transform_verts)
     {
         if(!transforms.empty())
         {
             const auto& stack_transform = transforms.back();
+
+            // the copied transforms may be shared by several commands,
+            // so each of them is composed once rather than per command
+            for(size_t i = size_t(transforms_offset); i < gpu_transforms.size(); ++i)
+            {
+                gpu_transforms[i] = stack_transform * gpu_transforms[i];
+            }
+
+            int32_t stack_transform_idx = -1;
             for(size_t i = start_cmd_idx; i < commands.size(); ++i)
             {
                 auto& cmd = commands[i];
-                if(cmd.setup.get_gpu_transform)
+                // gpu transformed commands must not be batched with the commands
+                // they were copied next to, their transform is applied on the gpu
+                cmd.hash = 0;
+                if(cmd.transform_idx < 0)
                 {
-                    auto cmd_transform = cmd.setup.get_gpu_transform();
-                    auto overwrite_transform = stack_transform * cmd_transform;
-                    cmd.setup.get_gpu_transform = [overwrite_transform]()
+                    // all commands without a transform share the stack one
+                    if(stack_transform_idx < 0)
                     {
-                        return overwrite_transform;
-                    };
-                }
-                else
-                {
-                    cmd.setup.get_gpu_transform = [stack_transform]()
-                    {
-                        return stack_transform;
-                    };
+                        gpu_transforms.emplace_back(stack_transform);
+                        stack_transform_idx = int32_t(gpu_transforms.size()) - 1;
+                    }
+                    cmd.transform_idx = stack_transform_idx;
                 }
             }
         }
     }
 
 
-    if(idx_offset != 0)
+    if(idx_offset != 0 || vtx_offset != 0 || compact_vtx_offset != 0 || instances_offset != 0)
     {
-        // offset the indices from the new list with the current
+        // offset the commands from the new list with the current
         for(size_t i = cmd_offset, sz = commands.size(); i < sz; ++i)
         {
-            commands[i].indices_offset += static_cast<uint32_t>(idx_offset);
+            auto& cmd = commands[i];
+            if(is_reference(cmd.dr_type))
+            {
+                continue;
+            }
+            if(cmd.dr_type == draw_type::instanced)
+            {
+                cmd.vertices_offset += static_cast<uint32_t>(instances_offset);
+                continue;
+            }
+            cmd.indices_offset += static_cast<uint32_t>(idx_offset);
+            cmd.vertices_offset += static_cast<uint32_t>(cmd.format == vertex_format::compact ? compact_vtx_offset : vtx_offset);
         }
     }
 
     commands_requested += list.commands_requested;
+    commands_lookback_batched += list.commands_lookback_batched;
 
     if(debug && list.debug)
     {
@@ -1251,13 +1755,40 @@ void draw_list::add_list(const draw_list& list, bool transform_verts)
     }
 }
 
+void draw_list::add_list_ref(std::shared_ptr<const draw_list> list)
+{
+    if(!list || list->empty())
+    {
+        return;
+    }
+
+    list->validate_stacks();
+
+    add_reference_cmd(*this, draw_type::sub_list, sub_lists.size());
+    sub_lists.emplace_back(std::move(list));
+}
+
+void draw_list::add_static_segment(std::shared_ptr<const static_segment> segment, const color& multiplier)
+{
+    if(!segment)
+    {
+        return;
+    }
+
+    add_reference_cmd(*this, draw_type::static_segment, static_segments.size());
+    static_segments.emplace_back();
+    auto& ref = static_segments.back();
+    ref.segment = std::move(segment);
+    ref.multiplier = multiplier;
+}
+
 void draw_list::add_text(const text& t, const math::transformf& transform)
 {
     if(!t.is_valid())
     {
         return;
     }
-//    EGT_BLOCK_PROFILING("draw_list::add_text")
+    VIDEOPP_PROFILE_ZONE("draw_list::add_text")
 
     const auto& style = t.get_style();
     auto font = style.font;
@@ -1436,13 +1967,24 @@ std::string draw_list::to_string() const
     ss << "\n";
     ss << "[REQUESTED CALLS]: " << commands_requested;
     ss << "\n";
-    ss << "[RENDERED CALLS]: " << commands.size();
+    const auto references = sub_lists.size() + static_segments.size();
+    ss << "[RENDERED CALLS]: " << commands.size() - references;
+    ss << "\n";
+    ss << "[BATCHED CALLS]: " << size_t(commands_requested) - (commands.size() - references);
     ss << "\n";
-    ss << "[BATCHED CALLS]: " << commands_requested - commands.size();
+    ss << "[LOOK-BACK BATCHED CALLS]: " << commands_lookback_batched;
     ss << "\n";
     ss << "[VERTICES]: " << vertices.size();
     ss << "\n";
+    ss << "[COMPACT VERTICES]: " << compact_vertices.size();
+    ss << "\n";
+    ss << "[INSTANCES]: " << instances.size();
+    ss << "\n";
     ss << "[INDICES]: " << indices.size();
+    ss << "\n";
+    ss << "[REFERENCED LISTS]: " << sub_lists.size();
+    ss << "\n";
+    ss << "[STATIC SEGMENTS]: " << static_segments.size();
     return ss.str();
 }
 
@@ -1490,7 +2032,7 @@ void draw_list::add_polyline(const polyline& poly, const color& col, bool closed
 
 void draw_list::add_polyline_gradient(const polyline& poly, const color& coltop, const color& colbot, bool closed, float thickness, float antialias_size)
 {
-//    EGT_BLOCK_PROFILING("draw_list::add_polyline_gradient")
+    VIDEOPP_PROFILE_ZONE("draw_list::add_polyline_gradient")
 
     blending_mode blend = (coltop.a < 255 || colbot.a < 255 || antialias_size != 0.0f) ? blending_mode::blend_normal : blending_mode::blend_none;
 
@@ -1508,198 +2050,225 @@ void draw_list::add_polyline_gradient(const polyline& poly, const color& coltop,
     auto idx_offset = indices.size();
 
     const bool thick_line = thickness > 1.0f;
-    if (antialias_size > 0.0f)
-    {
-        // Anti-aliased stroke
-        const float aa_size = antialias_size;
-        color coltop_trans = coltop;
-        coltop_trans.a = 0;
-        color colbot_trans = colbot;
-        colbot_trans.a = 0;
-        const size_t idx_count = thick_line ? count*18 : count*12;
-        const size_t vtx_count = thick_line ? points_count*4 : points_count*3;
 
-        size_t idx_current_idx{};
-        size_t vtx_current_idx{};
-        prim_resize(*this, idx_count, vtx_count, idx_current_idx, vtx_current_idx);
+    // a stroke with too many vertices for 16 bit indices is built
+    // with wide ones and drawn without any
+    const size_t max_vtx_count = antialias_size > 0.0f ? points_count * (thick_line ? 4 : 3) : count * 4;
+    std::vector<uint32_t> wide_indices;
+    const auto build = [&](auto& out_indices)
+    {
+        using out_index_t = typename std::decay_t<decltype(out_indices)>::value_type;
 
-        auto idx_write_ptr = &indices[idx_current_idx];
-        auto vtx_write_ptr = &vertices[vtx_current_idx];
+        if (antialias_size > 0.0f)
+        {
+            // Anti-aliased stroke
+            const float aa_size = antialias_size;
+            color coltop_trans = coltop;
+            coltop_trans.a = 0;
+            color colbot_trans = colbot;
+            colbot_trans.a = 0;
+            const size_t idx_count = thick_line ? count*18 : count*12;
+            const size_t vtx_count = thick_line ? points_count*4 : points_count*3;
 
+            size_t idx_current_idx{};
+            size_t vtx_current_idx{};
+            prim_resize(*this, out_indices, idx_count, vtx_count, idx_current_idx, vtx_current_idx);
 
-        // Temporary buffer
-        std::vector<math::vec2> temp_normals(points_count * (thick_line ? 5 : 3));
-        math::vec2* temp_points = temp_normals.data() + points_count;
+            auto idx_write_ptr = &out_indices[idx_current_idx];
+            auto vtx_write_ptr = &vertices[vtx_current_idx];
+            // indices are relative to the first vertex of the primitive
+            size_t vtx_local_idx = vtx_current_idx - vtx_offset;
 
-        for (size_t i1 = 0; i1 < count; i1++)
-        {
-            const size_t i2 = (i1+1) == points_count ? 0 : i1+1;
-            float dx = points[i2].x - points[i1].x;
-            float dy = points[i2].y - points[i1].y;
-            normalize2f_over_zero(dx, dy);
-            temp_normals[i1].x = dy;
-            temp_normals[i1].y = -dx;
 
-        }
-        if (!closed)
-            temp_normals[points_count-1] = temp_normals[points_count-2];
-
-        if (!thick_line)
-        {
-            if (!closed)
-            {
-                temp_points[0] = points[0] + temp_normals[0] * aa_size;
-                temp_points[1] = points[0] - temp_normals[0] * aa_size;
-                temp_points[(points_count-1)*2+0] = points[points_count-1] + temp_normals[points_count-1] * aa_size;
-                temp_points[(points_count-1)*2+1] = points[points_count-1] - temp_normals[points_count-1] * aa_size;
-            }
+            // Temporary buffer
+            std::vector<math::vec2> temp_normals(points_count * (thick_line ? 5 : 3));
+            math::vec2* temp_points = temp_normals.data() + points_count;
 
-            // FIXME-OPT: Merge the different loops, possibly remove the temporary buffer.
-            size_t idx1 = vtx_current_idx;
             for (size_t i1 = 0; i1 < count; i1++)
             {
                 const size_t i2 = (i1+1) == points_count ? 0 : i1+1;
-                size_t idx2 = (i1+1) == points_count ? vtx_current_idx : idx1+3;
+                float dx = points[i2].x - points[i1].x;
+                float dy = points[i2].y - points[i1].y;
+                normalize2f_over_zero(dx, dy);
+                temp_normals[i1].x = dy;
+                temp_normals[i1].y = -dx;
 
-                // Average normals
-                float dm_x = (temp_normals[i1].x + temp_normals[i2].x) * 0.5f;
-                float dm_y = (temp_normals[i1].y + temp_normals[i2].y) * 0.5f;
-                fixnormal2f(dm_x, dm_y);
-                dm_x *= aa_size;
-                dm_y *= aa_size;
-
-                // Add temporary vertexes
-                auto* out_vtx = &temp_points[i2*2];
-                out_vtx[0].x = points[i2].x + dm_x;
-                out_vtx[0].y = points[i2].y + dm_y;
-                out_vtx[1].x = points[i2].x - dm_x;
-                out_vtx[1].y = points[i2].y - dm_y;
-
-                // Add indexes
-                idx_write_ptr[0] = index_t(idx2+0); idx_write_ptr[1] = index_t(idx1+0); idx_write_ptr[2] = index_t(idx1+2);
-                idx_write_ptr[3] = index_t(idx1+2); idx_write_ptr[4] = index_t(idx2+2); idx_write_ptr[5] = index_t(idx2+0);
-                idx_write_ptr[6] = index_t(idx2+1); idx_write_ptr[7] = index_t(idx1+1); idx_write_ptr[8] = index_t(idx1+0);
-                idx_write_ptr[9] = index_t(idx1+0); idx_write_ptr[10]= index_t(idx2+0); idx_write_ptr[11]= index_t(idx2+1);
-                idx_write_ptr += 12;
-
-                idx1 = idx2;
             }
+            if (!closed)
+                temp_normals[points_count-1] = temp_normals[points_count-2];
 
-            // Add vertexes
-            for (size_t i = 0; i < points_count; i++)
+            if (!thick_line)
             {
-                vtx_write_ptr[0].pos = points[i];          vtx_write_ptr[0].col = coltop;
-                vtx_write_ptr[1].pos = temp_points[i*2+0]; vtx_write_ptr[1].col = coltop_trans;
-                vtx_write_ptr[2].pos = temp_points[i*2+1]; vtx_write_ptr[2].col = colbot_trans;
-                vtx_write_ptr += 3;
+                if (!closed)
+                {
+                    temp_points[0] = points[0] + temp_normals[0] * aa_size;
+                    temp_points[1] = points[0] - temp_normals[0] * aa_size;
+                    temp_points[(points_count-1)*2+0] = points[points_count-1] + temp_normals[points_count-1] * aa_size;
+                    temp_points[(points_count-1)*2+1] = points[points_count-1] - temp_normals[points_count-1] * aa_size;
+                }
+
+                // FIXME-OPT: Merge the different loops, possibly remove the temporary buffer.
+                size_t idx1 = vtx_local_idx;
+                for (size_t i1 = 0; i1 < count; i1++)
+                {
+                    const size_t i2 = (i1+1) == points_count ? 0 : i1+1;
+                    size_t idx2 = (i1+1) == points_count ? vtx_local_idx : idx1+3;
+
+                    // Average normals
+                    float dm_x = (temp_normals[i1].x + temp_normals[i2].x) * 0.5f;
+                    float dm_y = (temp_normals[i1].y + temp_normals[i2].y) * 0.5f;
+                    fixnormal2f(dm_x, dm_y);
+                    dm_x *= aa_size;
+                    dm_y *= aa_size;
+
+                    // Add temporary vertexes
+                    auto* out_vtx = &temp_points[i2*2];
+                    out_vtx[0].x = points[i2].x + dm_x;
+                    out_vtx[0].y = points[i2].y + dm_y;
+                    out_vtx[1].x = points[i2].x - dm_x;
+                    out_vtx[1].y = points[i2].y - dm_y;
+
+                    // Add indexes
+                    idx_write_ptr[0] = out_index_t(idx2+0); idx_write_ptr[1] = out_index_t(idx1+0); idx_write_ptr[2] = out_index_t(idx1+2);
+                    idx_write_ptr[3] = out_index_t(idx1+2); idx_write_ptr[4] = out_index_t(idx2+2); idx_write_ptr[5] = out_index_t(idx2+0);
+                    idx_write_ptr[6] = out_index_t(idx2+1); idx_write_ptr[7] = out_index_t(idx1+1); idx_write_ptr[8] = out_index_t(idx1+0);
+                    idx_write_ptr[9] = out_index_t(idx1+0); idx_write_ptr[10]= out_index_t(idx2+0); idx_write_ptr[11]= out_index_t(idx2+1);
+                    idx_write_ptr += 12;
+
+                    idx1 = idx2;
+                }
+
+                // Add vertexes
+                for (size_t i = 0; i < points_count; i++)
+                {
+                    vtx_write_ptr[0].pos = points[i];          vtx_write_ptr[0].col = coltop;
+                    vtx_write_ptr[1].pos = temp_points[i*2+0]; vtx_write_ptr[1].col = coltop_trans;
+                    vtx_write_ptr[2].pos = temp_points[i*2+1]; vtx_write_ptr[2].col = colbot_trans;
+                    vtx_write_ptr += 3;
+                }
+            }
+            else
+            {
+                const float half_inner_thickness = (thickness - aa_size) * 0.5f;
+                if (!closed)
+                {
+                    temp_points[0] = points[0] + temp_normals[0] * (half_inner_thickness + aa_size);
+                    temp_points[1] = points[0] + temp_normals[0] * (half_inner_thickness);
+                    temp_points[2] = points[0] - temp_normals[0] * (half_inner_thickness);
+                    temp_points[3] = points[0] - temp_normals[0] * (half_inner_thickness + aa_size);
+                    temp_points[(points_count-1)*4+0] = points[points_count-1] + temp_normals[points_count-1] * (half_inner_thickness + aa_size);
+                    temp_points[(points_count-1)*4+1] = points[points_count-1] + temp_normals[points_count-1] * (half_inner_thickness);
+                    temp_points[(points_count-1)*4+2] = points[points_count-1] - temp_normals[points_count-1] * (half_inner_thickness);
+                    temp_points[(points_count-1)*4+3] = points[points_count-1] - temp_normals[points_count-1] * (half_inner_thickness + aa_size);
+                }
+
+                // FIXME-OPT: Merge the different loops, possibly remove the temporary buffer.
+                size_t idx1 = vtx_local_idx;
+                for (size_t i1 = 0; i1 < count; i1++)
+                {
+                    const size_t i2 = (i1+1) == points_count ? 0 : i1+1;
+                    size_t idx2 = (i1+1) == points_count ? vtx_local_idx : idx1+4;
+
+                    // Average normals
+                    float dm_x = (temp_normals[i1].x + temp_normals[i2].x) * 0.5f;
+                    float dm_y = (temp_normals[i1].y + temp_normals[i2].y) * 0.5f;
+                    fixnormal2f(dm_x, dm_y);
+                    float dm_out_x = dm_x * (half_inner_thickness + aa_size);
+                    float dm_out_y = dm_y * (half_inner_thickness + aa_size);
+                    float dm_in_x = dm_x * half_inner_thickness;
+                    float dm_in_y = dm_y * half_inner_thickness;
+
+                    // Add temporary vertexes
+                    auto* out_vtx = &temp_points[i2*4];
+                    out_vtx[0].x = points[i2].x + dm_out_x;
+                    out_vtx[0].y = points[i2].y + dm_out_y;
+                    out_vtx[1].x = points[i2].x + dm_in_x;
+                    out_vtx[1].y = points[i2].y + dm_in_y;
+                    out_vtx[2].x = points[i2].x - dm_in_x;
+                    out_vtx[2].y = points[i2].y - dm_in_y;
+                    out_vtx[3].x = points[i2].x - dm_out_x;
+                    out_vtx[3].y = points[i2].y - dm_out_y;
+
+                    // Add indexes
+                    idx_write_ptr[0]  = out_index_t(idx2+1); idx_write_ptr[1]  = out_index_t(idx1+1); idx_write_ptr[2]  = out_index_t(idx1+2);
+                    idx_write_ptr[3]  = out_index_t(idx1+2); idx_write_ptr[4]  = out_index_t(idx2+2); idx_write_ptr[5]  = out_index_t(idx2+1);
+                    idx_write_ptr[6]  = out_index_t(idx2+1); idx_write_ptr[7]  = out_index_t(idx1+1); idx_write_ptr[8]  = out_index_t(idx1+0);
+                    idx_write_ptr[9]  = out_index_t(idx1+0); idx_write_ptr[10] = out_index_t(idx2+0); idx_write_ptr[11] = out_index_t(idx2+1);
+                    idx_write_ptr[12] = out_index_t(idx2+2); idx_write_ptr[13] = out_index_t(idx1+2); idx_write_ptr[14] = out_index_t(idx1+3);
+                    idx_write_ptr[15] = out_index_t(idx1+3); idx_write_ptr[16] = out_index_t(idx2+3); idx_write_ptr[17] = out_index_t(idx2+2);
+                    idx_write_ptr += 18;
+
+                    idx1 = idx2;
+                }
+
+                // Add vertexes
+                for (size_t i = 0; i < points_count; i++)
+                {
+                    vtx_write_ptr[0].pos = temp_points[i*4+0]; vtx_write_ptr[0].col = coltop_trans;
+                    vtx_write_ptr[1].pos = temp_points[i*4+1]; vtx_write_ptr[1].col = coltop;
+                    vtx_write_ptr[2].pos = temp_points[i*4+2]; vtx_write_ptr[2].col = colbot;
+                    vtx_write_ptr[3].pos = temp_points[i*4+3]; vtx_write_ptr[3].col = colbot_trans;
+
+                    vtx_write_ptr += 4;
+                }
             }
         }
         else
         {
-            const float half_inner_thickness = (thickness - aa_size) * 0.5f;
-            if (!closed)
-            {
-                temp_points[0] = points[0] + temp_normals[0] * (half_inner_thickness + aa_size);
-                temp_points[1] = points[0] + temp_normals[0] * (half_inner_thickness);
-                temp_points[2] = points[0] - temp_normals[0] * (half_inner_thickness);
-                temp_points[3] = points[0] - temp_normals[0] * (half_inner_thickness + aa_size);
-                temp_points[(points_count-1)*4+0] = points[points_count-1] + temp_normals[points_count-1] * (half_inner_thickness + aa_size);
-                temp_points[(points_count-1)*4+1] = points[points_count-1] + temp_normals[points_count-1] * (half_inner_thickness);
-                temp_points[(points_count-1)*4+2] = points[points_count-1] - temp_normals[points_count-1] * (half_inner_thickness);
-                temp_points[(points_count-1)*4+3] = points[points_count-1] - temp_normals[points_count-1] * (half_inner_thickness + aa_size);
-            }
+            // Non Anti-aliased Stroke
+            const size_t idx_count = count*6;
+            const size_t vtx_count = count*4;      // FIXME-OPT: Not sharing edges
+            size_t idx_current_idx{};
+            size_t vtx_current_idx{};
+            prim_resize(*this, out_indices, idx_count, vtx_count, idx_current_idx, vtx_current_idx);
+
+            auto idx_write_ptr = &out_indices[idx_current_idx];
+            auto vtx_write_ptr = &vertices[vtx_current_idx];
+            // indices are relative to the first vertex of the primitive
+            size_t vtx_local_idx = vtx_current_idx - vtx_offset;
 
-            // FIXME-OPT: Merge the different loops, possibly remove the temporary buffer.
-            size_t idx1 = vtx_current_idx;
             for (size_t i1 = 0; i1 < count; i1++)
             {
                 const size_t i2 = (i1+1) == points_count ? 0 : i1+1;
-                size_t idx2 = (i1+1) == points_count ? vtx_current_idx : idx1+4;
-
-                // Average normals
-                float dm_x = (temp_normals[i1].x + temp_normals[i2].x) * 0.5f;
-                float dm_y = (temp_normals[i1].y + temp_normals[i2].y) * 0.5f;
-                fixnormal2f(dm_x, dm_y);
-                float dm_out_x = dm_x * (half_inner_thickness + aa_size);
-                float dm_out_y = dm_y * (half_inner_thickness + aa_size);
-                float dm_in_x = dm_x * half_inner_thickness;
-                float dm_in_y = dm_y * half_inner_thickness;
-
-                // Add temporary vertexes
-                auto* out_vtx = &temp_points[i2*4];
-                out_vtx[0].x = points[i2].x + dm_out_x;
-                out_vtx[0].y = points[i2].y + dm_out_y;
-                out_vtx[1].x = points[i2].x + dm_in_x;
-                out_vtx[1].y = points[i2].y + dm_in_y;
-                out_vtx[2].x = points[i2].x - dm_in_x;
-                out_vtx[2].y = points[i2].y - dm_in_y;
-                out_vtx[3].x = points[i2].x - dm_out_x;
-                out_vtx[3].y = points[i2].y - dm_out_y;
-
-                // Add indexes
-                idx_write_ptr[0]  = index_t(idx2+1); idx_write_ptr[1]  = index_t(idx1+1); idx_write_ptr[2]  = index_t(idx1+2);
-                idx_write_ptr[3]  = index_t(idx1+2); idx_write_ptr[4]  = index_t(idx2+2); idx_write_ptr[5]  = index_t(idx2+1);
-                idx_write_ptr[6]  = index_t(idx2+1); idx_write_ptr[7]  = index_t(idx1+1); idx_write_ptr[8]  = index_t(idx1+0);
-                idx_write_ptr[9]  = index_t(idx1+0); idx_write_ptr[10] = index_t(idx2+0); idx_write_ptr[11] = index_t(idx2+1);
-                idx_write_ptr[12] = index_t(idx2+2); idx_write_ptr[13] = index_t(idx1+2); idx_write_ptr[14] = index_t(idx1+3);
-                idx_write_ptr[15] = index_t(idx1+3); idx_write_ptr[16] = index_t(idx2+3); idx_write_ptr[17] = index_t(idx2+2);
-                idx_write_ptr += 18;
-
-                idx1 = idx2;
-            }
-
-            // Add vertexes
-            for (size_t i = 0; i < points_count; i++)
-            {
-                vtx_write_ptr[0].pos = temp_points[i*4+0]; vtx_write_ptr[0].col = coltop_trans;
-                vtx_write_ptr[1].pos = temp_points[i*4+1]; vtx_write_ptr[1].col = coltop;
-                vtx_write_ptr[2].pos = temp_points[i*4+2]; vtx_write_ptr[2].col = colbot;
-                vtx_write_ptr[3].pos = temp_points[i*4+3]; vtx_write_ptr[3].col = colbot_trans;
-
+                const auto& p1 = points[i1];
+                const auto& p2 = points[i2];
+
+                float dx = p2.x - p1.x;
+                float dy = p2.y - p1.y;
+                normalize2f_over_zero(dx, dy);
+                dx *= (thickness * 0.5f);
+                dy *= (thickness * 0.5f);
+
+                vtx_write_ptr[0].pos.x = p1.x + dy; vtx_write_ptr[0].pos.y = p1.y - dx; vtx_write_ptr[0].col = coltop;
+                vtx_write_ptr[1].pos.x = p2.x + dy; vtx_write_ptr[1].pos.y = p2.y - dx; vtx_write_ptr[1].col = coltop;
+                vtx_write_ptr[2].pos.x = p2.x - dy; vtx_write_ptr[2].pos.y = p2.y + dx; vtx_write_ptr[2].col = colbot;
+                vtx_write_ptr[3].pos.x = p1.x - dy; vtx_write_ptr[3].pos.y = p1.y + dx; vtx_write_ptr[3].col = colbot;
                 vtx_write_ptr += 4;
+
+                idx_write_ptr[0] = out_index_t(vtx_local_idx); idx_write_ptr[1] = out_index_t(vtx_local_idx+1); idx_write_ptr[2] = out_index_t(vtx_local_idx+2);
+                idx_write_ptr[3] = out_index_t(vtx_local_idx); idx_write_ptr[4] = out_index_t(vtx_local_idx+2); idx_write_ptr[5] = out_index_t(vtx_local_idx+3);
+                idx_write_ptr += 6;
+                vtx_local_idx += 4;
             }
         }
+    };
+
+    auto dr_type = draw_type::elements;
+    if(max_vtx_count <= max_window_vertices)
+    {
+        build(indices);
     }
     else
     {
-        // Non Anti-aliased Stroke
-        const size_t idx_count = count*6;
-        const size_t vtx_count = count*4;      // FIXME-OPT: Not sharing edges
-        size_t idx_current_idx{};
-        size_t vtx_current_idx{};
-        prim_resize(*this, idx_count, vtx_count, idx_current_idx, vtx_current_idx);
-
-        auto idx_write_ptr = &indices[idx_current_idx];
-        auto vtx_write_ptr = &vertices[vtx_current_idx];
-
-        for (size_t i1 = 0; i1 < count; i1++)
-        {
-            const size_t i2 = (i1+1) == points_count ? 0 : i1+1;
-            const auto& p1 = points[i1];
-            const auto& p2 = points[i2];
-
-            float dx = p2.x - p1.x;
-            float dy = p2.y - p1.y;
-            normalize2f_over_zero(dx, dy);
-            dx *= (thickness * 0.5f);
-            dy *= (thickness * 0.5f);
-
-            vtx_write_ptr[0].pos.x = p1.x + dy; vtx_write_ptr[0].pos.y = p1.y - dx; vtx_write_ptr[0].col = coltop;
-            vtx_write_ptr[1].pos.x = p2.x + dy; vtx_write_ptr[1].pos.y = p2.y - dx; vtx_write_ptr[1].col = coltop;
-            vtx_write_ptr[2].pos.x = p2.x - dy; vtx_write_ptr[2].pos.y = p2.y + dx; vtx_write_ptr[2].col = colbot;
-            vtx_write_ptr[3].pos.x = p1.x - dy; vtx_write_ptr[3].pos.y = p1.y + dx; vtx_write_ptr[3].col = colbot;
-            vtx_write_ptr += 4;
-
-            idx_write_ptr[0] = index_t(vtx_current_idx); idx_write_ptr[1] = index_t(vtx_current_idx+1); idx_write_ptr[2] = index_t(vtx_current_idx+2);
-            idx_write_ptr[3] = index_t(vtx_current_idx); idx_write_ptr[4] = index_t(vtx_current_idx+2); idx_write_ptr[5] = index_t(vtx_current_idx+3);
-            idx_write_ptr += 6;
-            vtx_current_idx += 4;
-        }
+        build(wide_indices);
+        expand_indexed_vertices(*this, uint32_t(vtx_offset), wide_indices);
+        dr_type = draw_type::array;
     }
+
     auto vtx_count = vertices.size() - vtx_offset;
     auto idx_count = indices.size() - idx_offset;
     add_cmd_impl(*this,
-                 draw_type::elements,
+                 dr_type,
                  uint32_t(vtx_offset),
                  uint32_t(vtx_count),
                  uint32_t(idx_offset),
@@ -1717,7 +2286,7 @@ void draw_list::add_polyline_filled_convex(const polyline& poly, const color& co
 
 void draw_list::add_polyline_filled_convex_gradient(const polyline& poly, const color& coltop, const color& colbot, float antialias_size)
 {
-//    EGT_BLOCK_PROFILING("draw_list::add_polyline_filled_convex_gradient")
+    VIDEOPP_PROFILE_ZONE("draw_list::add_polyline_filled_convex_gradient")
 
     blending_mode blend = (coltop.a < 255 || colbot.a < 255 || antialias_size != 0.0f) ? blending_mode::blend_normal : blending_mode::blend_none;
 
@@ -1749,105 +2318,130 @@ void draw_list::add_polyline_filled_convex_gradient(const polyline& poly, const
 
     float height = maxy-miny;
 
-    if (antialias_size > 0.0f)
+    // a fill with too many vertices for 16 bit indices is built
+    // with wide ones and drawn without any
+    const size_t max_vtx_count = antialias_size > 0.0f ? points_count * 2 : points_count;
+    std::vector<uint32_t> wide_indices;
+    const auto build = [&](auto& out_indices)
     {
-        // Anti-aliased Fill
-        const float aa_size = antialias_size;
-        color coltop_trans = coltop;
-        coltop_trans.a = 0;
-        color colbot_trans = colbot;
-        colbot_trans.a = 0;
+        using out_index_t = typename std::decay_t<decltype(out_indices)>::value_type;
+
+        if (antialias_size > 0.0f)
+        {
+            // Anti-aliased Fill
+            const float aa_size = antialias_size;
+            color coltop_trans = coltop;
+            coltop_trans.a = 0;
+            color colbot_trans = colbot;
+            colbot_trans.a = 0;
+
+            const size_t idx_count = (points_count-2)*3 + points_count*6;
+            const size_t vtx_count = (points_count*2);
+
+            size_t idx_current_idx{};
+            size_t vtx_current_idx{};
+            prim_resize(*this, out_indices, idx_count, vtx_count, idx_current_idx, vtx_current_idx);
+
+            auto idx_write_ptr = &out_indices[idx_current_idx];
+            auto vtx_write_ptr = &vertices[vtx_current_idx];
+            // indices are relative to the first vertex of the primitive
+            size_t vtx_local_idx = vtx_current_idx - vtx_offset;
+
+            // Add indexes for fill
+            size_t vtx_inner_idx = vtx_local_idx;
+            size_t vtx_outer_idx = vtx_local_idx+1;
+            for (size_t i = 2; i < points_count; i++)
+            {
+                idx_write_ptr[0] = out_index_t(vtx_inner_idx); idx_write_ptr[1] = out_index_t(vtx_inner_idx+((i-1)<<1)); idx_write_ptr[2] = out_index_t(vtx_inner_idx+(i<<1));
+                idx_write_ptr += 3;
+            }
 
-        const size_t idx_count = (points_count-2)*3 + points_count*6;
-        const size_t vtx_count = (points_count*2);
+            // Compute normals
+            std::vector<math::vec2> temp_normals(points_count);
 
-        size_t idx_current_idx{};
-        size_t vtx_current_idx{};
-        prim_resize(*this, idx_count, vtx_count, idx_current_idx, vtx_current_idx);
+            for (size_t i0 = points_count-1, i1 = 0; i1 < points_count; i0 = i1++)
+            {
+                const auto& p0 = points[i0];
+                const auto& p1 = points[i1];
+                float dx = p1.x - p0.x;
+                float dy = p1.y - p0.y;
+                normalize2f_over_zero(dx, dy);
+                temp_normals[i0].x = dy;
+                temp_normals[i0].y = -dx;
+            }
 
-        auto idx_write_ptr = &indices[idx_current_idx];
-        auto vtx_write_ptr = &vertices[vtx_current_idx];
+            for (size_t i0 = points_count-1, i1 = 0; i1 < points_count; i0 = i1++)
+            {
+                // Average normals
+                const auto& n0 = temp_normals[i0];
+                const auto& n1 = temp_normals[i1];
+                float dm_x = (n0.x + n1.x) * 0.5f;
+                float dm_y = (n0.y + n1.y) * 0.5f;
+                fixnormal2f(dm_x, dm_y);
+                dm_x *= aa_size * 0.5f;
+                dm_y *= aa_size * 0.5f;
 
-        // Add indexes for fill
-        size_t vtx_inner_idx = vtx_current_idx;
-        size_t vtx_outer_idx = vtx_current_idx+1;
-        for (size_t i = 2; i < points_count; i++)
-        {
-            idx_write_ptr[0] = index_t(vtx_inner_idx); idx_write_ptr[1] = index_t(vtx_inner_idx+((i-1)<<1)); idx_write_ptr[2] = index_t(vtx_inner_idx+(i<<1));
-            idx_write_ptr += 3;
-        }
+                // Add vertices
+                vtx_write_ptr[0].pos.x = (points[i1].x - dm_x);
+                vtx_write_ptr[0].pos.y = (points[i1].y - dm_y);
 
-        // Compute normals
-        std::vector<math::vec2> temp_normals(points_count);
+                vtx_write_ptr[1].pos.x = (points[i1].x + dm_x);
+                vtx_write_ptr[1].pos.y = (points[i1].y + dm_y);
 
-        for (size_t i0 = points_count-1, i1 = 0; i1 < points_count; i0 = i1++)
-        {
-            const auto& p0 = points[i0];
-            const auto& p1 = points[i1];
-            float dx = p1.x - p0.x;
-            float dy = p1.y - p0.y;
-            normalize2f_over_zero(dx, dy);
-            temp_normals[i0].x = dy;
-            temp_normals[i0].y = -dx;
-        }
+                vtx_write_ptr[0].col = get_vertical_gradient(coltop, colbot, points[i1].y-miny, height);              // Inner
+                vtx_write_ptr[1].col = get_vertical_gradient(coltop_trans, colbot_trans, points[i1].y-miny, height);  // Outer
+                vtx_write_ptr += 2;
 
-        for (size_t i0 = points_count-1, i1 = 0; i1 < points_count; i0 = i1++)
+                // Add indexes for fringes
+                idx_write_ptr[0] = out_index_t(vtx_inner_idx+(i1<<1)); idx_write_ptr[1] = out_index_t(vtx_inner_idx+(i0<<1)); idx_write_ptr[2] = out_index_t(vtx_outer_idx+(i0<<1));
+                idx_write_ptr[3] = out_index_t(vtx_outer_idx+(i0<<1)); idx_write_ptr[4] = out_index_t(vtx_outer_idx+(i1<<1)); idx_write_ptr[5] = out_index_t(vtx_inner_idx+(i1<<1));
+                idx_write_ptr += 6;
+            }
+        }
+        else
         {
-            // Average normals
-            const auto& n0 = temp_normals[i0];
-            const auto& n1 = temp_normals[i1];
-            float dm_x = (n0.x + n1.x) * 0.5f;
-            float dm_y = (n0.y + n1.y) * 0.5f;
-            fixnormal2f(dm_x, dm_y);
-            dm_x *= aa_size * 0.5f;
-            dm_y *= aa_size * 0.5f;
-
-            // Add vertices
-            vtx_write_ptr[0].pos.x = (points[i1].x - dm_x);
-            vtx_write_ptr[0].pos.y = (points[i1].y - dm_y);
-
-            vtx_write_ptr[1].pos.x = (points[i1].x + dm_x);
-            vtx_write_ptr[1].pos.y = (points[i1].y + dm_y);
-
-            vtx_write_ptr[0].col = get_vertical_gradient(coltop, colbot, points[i1].y-miny, height);              // Inner
-            vtx_write_ptr[1].col = get_vertical_gradient(coltop_trans, colbot_trans, points[i1].y-miny, height);  // Outer
-            vtx_write_ptr += 2;
-
-            // Add indexes for fringes
-            idx_write_ptr[0] = index_t(vtx_inner_idx+(i1<<1)); idx_write_ptr[1] = index_t(vtx_inner_idx+(i0<<1)); idx_write_ptr[2] = index_t(vtx_outer_idx+(i0<<1));
-            idx_write_ptr[3] = index_t(vtx_outer_idx+(i0<<1)); idx_write_ptr[4] = index_t(vtx_outer_idx+(i1<<1)); idx_write_ptr[5] = index_t(vtx_inner_idx+(i1<<1));
-            idx_write_ptr += 6;
+            // Non Anti-aliased Fill
+            const size_t idx_count = (points_count-2)*3;
+            const size_t vtx_count = points_count;
+            size_t idx_current_idx{};
+            size_t vtx_current_idx{};
+            prim_resize(*this, out_indices, idx_count, vtx_count, idx_current_idx, vtx_current_idx);
+
+            auto idx_write_ptr = &out_indices[idx_current_idx];
+            auto vtx_write_ptr = &vertices[vtx_current_idx];
+            // indices are relative to the first vertex of the primitive
+            size_t vtx_local_idx = vtx_current_idx - vtx_offset;
+            for (size_t i = 0; i < vtx_count; i++)
+            {
+                vtx_write_ptr[0].pos = points[i];
+                vtx_write_ptr[0].col = get_vertical_gradient(coltop, colbot, vtx_write_ptr[0].pos.y-miny,height);
+
+                vtx_write_ptr++;
+            }
+            for (size_t i = 2; i < points_count; i++)
+            {
+                idx_write_ptr[0] = out_index_t(vtx_local_idx); idx_write_ptr[1] = out_index_t(vtx_local_idx+i-1); idx_write_ptr[2] = out_index_t(vtx_local_idx+i);
+                idx_write_ptr += 3;
+            }
         }
+    };
+
+    auto dr_type = draw_type::elements;
+    if(max_vtx_count <= max_window_vertices)
+    {
+        build(indices);
     }
     else
     {
-        // Non Anti-aliased Fill
-        const size_t idx_count = (points_count-2)*3;
-        const size_t vtx_count = points_count;
-        size_t idx_current_idx{};
-        size_t vtx_current_idx{};
-        prim_resize(*this, idx_count, vtx_count, idx_current_idx, vtx_current_idx);
-
-        auto idx_write_ptr = &indices[idx_current_idx];
-        auto vtx_write_ptr = &vertices[vtx_current_idx];
-        for (size_t i = 0; i < vtx_count; i++)
-        {
-            vtx_write_ptr[0].pos = points[i];
-            vtx_write_ptr[0].col = get_vertical_gradient(coltop, colbot, vtx_write_ptr[0].pos.y-miny,height);
-
-            vtx_write_ptr++;
-        }
-        for (size_t i = 2; i < points_count; i++)
-        {
-            idx_write_ptr[0] = index_t(vtx_current_idx); idx_write_ptr[1] = index_t(vtx_current_idx+i-1); idx_write_ptr[2] = index_t(vtx_current_idx+i);
-            idx_write_ptr += 3;
-        }
+        build(wide_indices);
+        expand_indexed_vertices(*this, uint32_t(vtx_offset), wide_indices);
+        dr_type = draw_type::array;
     }
 
     auto vtx_count = vertices.size() - vtx_offset;
     auto idx_count = indices.size() - idx_offset;
     add_cmd_impl(*this,
-                 draw_type::elements,
+                 dr_type,
                  uint32_t(vtx_offset),
                  uint32_t(vtx_count),
                  uint32_t(idx_offset),
@@ -5,8 +5,21 @@
 #include "polyline.h"
 #include "rich_text.h"
 
+#include <limits>
+
 namespace gfx
 {
+class static_segment;
+
+/// What the gpu timer queries measure
+enum class gpu_timing_mode : uint8_t
+{
+    none,
+    /// each drawn list (master, fbo, blur)
+    passes,
+    /// each command of the drawn lists
+    commands
+};
 
 struct draw_config
 {
@@ -14,10 +27,12 @@ struct draw_config
     /// that can be batched in one draw call.
     size_t max_textures_per_batch{32};
 
-    /// cpu_batching is disabled for text rendering with more than X vertices
-    /// because there are too many vertices and their matrix multiplication
-    /// on the cpu dominates the batching benefits.
-    size_t max_cpu_transformed_glyhps{24};
+    /// cpu_batching is disabled for text rendering with more than X glyphs
+    /// because there are too many vertices and their transformation
+    /// on the cpu dominates the batching benefits. Affine transforms
+    /// are vectorized, so this can be much higher than for full
+    /// matrix multiplication (see the transform benchmarks).
+    size_t max_cpu_transformed_glyhps{128};
 
     /// when linear filtering, we need to shift uv coords to the
     /// center of the texels, otherwise for outermost pixels
@@ -29,9 +44,27 @@ struct draw_config
     /// text is scaled down, at the cost of some gpu performance.
     bool sdf_supersample{true};
 
+    /// How many commands back to search for a command with the same
+    /// state when the last one cannot be batched with. A primitive is
+    /// merged into an earlier command only when it does not overlap
+    /// anything drawn after it. 0 disables look-back batching.
+    size_t batching_lookback{0};
+
     /// Internally uses mapped buffers for vertices/indices update.
     bool mapped_buffers{false};
 
+    /// Stream vertices/indices into persistently mapped ring buffers
+    /// when the context supports them (GL 4.4 or ARB_buffer_storage).
+    bool persistent_buffers{true};
+
+    /// Submit consecutive commands which differ only in the
+    /// ranges they draw with a single glMultiDrawElements call.
+    bool multi_draw{true};
+
+    /// Measure gpu times with timer queries (GL 3.3 or ARB_timer_query).
+    /// The results are reported by gpu_stats a few frames later.
+    gpu_timing_mode gpu_timing{gpu_timing_mode::none};
+
     /// Enable/Disable debug draw.
     bool debug{};
 };
@@ -104,9 +137,19 @@ using source_data = std::tuple<texture_view, rect>;
 /// A draw list. Contains draw commands. Can be reused.
 struct draw_list
 {
-    using index_t = uint32_t;
+    /// Indices are relative to the first vertex of their command,
+    /// so 16 bits are enough. Commands are split into new vertex
+    /// windows before they would overflow it.
+    using index_t = uint16_t;
+    static constexpr size_t max_window_vertices = size_t(std::numeric_limits<index_t>::max()) + 1;
     using crop_area_t = std::vector<rect>;
 
+    struct static_segment_ref
+    {
+        std::shared_ptr<const static_segment> segment;
+        color multiplier;
+    };
+
     draw_list(bool has_debug_info = true);
     draw_list(draw_list&&) = default;
     draw_list& operator=(draw_list&&) = default;
@@ -332,6 +375,35 @@ struct draw_list
                    flip_format flip = flip_format::none,
                    const program_setup& setup = empty_setup());
 
+    //-----------------------------------------------------------------------------
+    /// Adds an image drawn as an instance of the shared unit quad. An image
+    /// costs one 40 byte sprite_instance instead of 4 vertices, which pays
+    /// off for particle and tile layers with many sprites. The points must
+    /// form a parallelogram. Falls back to add_image when instancing is not
+    /// supported, or the image needs crop rects, a pushed program or
+    /// texture coordinates outside of [0, 1].
+    //-----------------------------------------------------------------------------
+    void add_image_instanced(const texture_view& texture,
+                             const rect& src,
+                             const rect& dst,
+                             const math::transformf& transform,
+                             const color& col = color::white(),
+                             flip_format flip = flip_format::none);
+
+    void add_image_instanced(const texture_view& texture,
+                             const rect& dst,
+                             const color& col = color::white(),
+                             math::vec2 min_uv = {0.0f, 0.0f},
+                             math::vec2 max_uv = {1.0f, 1.0f},
+                             flip_format flip = flip_format::none);
+
+    void add_image_instanced(const texture_view& texture,
+                             const std::array<math::vec2, 4>& points,
+                             const color& col = color::white(),
+                             math::vec2 min_uv = {0.0f, 0.0f},
+                             math::vec2 max_uv = {1.0f, 1.0f},
+                             flip_format flip = flip_format::none);
+
     void add_vertices(draw_type dr_type,
                       const vertex_2d* vertices,
                       size_t count,
@@ -343,6 +415,23 @@ struct draw_list
     //-----------------------------------------------------------------------------
     void add_list(const draw_list& list, bool transform_verts = true);
 
+    //-----------------------------------------------------------------------------
+    /// Adds a reference to another draw_list without copying its data.
+    /// The renderer uploads the referenced streams as they are and draws
+    /// them with base vertex offsets. The current clip rect and transform
+    /// are applied to the whole referenced list on the gpu.
+    /// The referenced list must not change until this list is drawn.
+    //-----------------------------------------------------------------------------
+    void add_list_ref(std::shared_ptr<const draw_list> list);
+
+    //-----------------------------------------------------------------------------
+    /// Adds a static segment which is already resident on the gpu.
+    /// The current clip rect and transform, and the color multiplier
+    /// are applied to the whole segment.
+    //-----------------------------------------------------------------------------
+    void add_static_segment(std::shared_ptr<const static_segment> segment,
+                            const color& multiplier = color::white());
+
     //-----------------------------------------------------------------------------
     /// Adds a text which will be fitted into the destination rect.
     /// Position inside the rect is affected by the text's alignment and transform.
@@ -472,16 +561,37 @@ struct draw_list
                                            math::vec2& min_uv,
                                            math::vec2& max_uv);
 
-    bool empty() const noexcept { return commands_requested == 0; }
+    bool empty() const noexcept { return commands_requested == 0 && sub_lists.empty() && static_segments.empty(); }
     //-----------------------------------------------------------------------------
     /// Data members
     //-----------------------------------------------------------------------------
     /// vertices to draw
     std::vector<vertex_2d> vertices;
+    /// vertices to draw by commands in the compact format
+    std::vector<vertex_2d_compact> compact_vertices;
+    /// sprites drawn by the instanced commands
+    std::vector<sprite_instance> instances;
     /// indices to draw
     std::vector<index_t> indices;
     /// draw commands
     std::vector<draw_cmd> commands;
+    /// texture slots referenced by the commands
+    std::vector<texture_view> texture_slots;
+    /// clip rects referenced by the commands
+    std::vector<rect> clip_sets;
+    /// gpu transforms referenced by the commands
+    std::vector<math::transformf> gpu_transforms;
+    /// crop sets referenced by the commands
+    std::vector<crop_area_t> crop_sets;
+    /// setups with plain data uniforms or custom callbacks
+    /// referenced by the commands
+    std::vector<program_setup> setups;
+    /// lists referenced by the sub_list commands, in command order
+    std::vector<std::shared_ptr<const draw_list>> sub_lists;
+    /// static segments referenced by the static_segment commands
+    std::vector<static_segment_ref> static_segments;
+    /// screen bounds of the commands, recorded only for look-back batching
+    std::vector<frect> commands_bounds;
     /// clip rects stack
     std::vector<rect> clip_rects;
     /// crop rects stack
@@ -494,6 +604,8 @@ struct draw_list
     std::vector<gpu_program> programs;
     /// total commands requested
     int commands_requested = 0;
+    /// commands merged into an earlier (not the last) command
+    int commands_lookback_batched = 0;
 
     std::unique_ptr<draw_list> debug;
 };
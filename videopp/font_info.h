@@ -2,6 +2,8 @@
 
 #include "surface.h"
 #include "logger.h"
+#include "kerning_lookup.h"
+#include "paged_glyph_index.h"
 #include <fontpp/font.h>
 
 #include <cstdint>
@@ -22,37 +24,42 @@ struct font_info
 {
     const glyph& get_glyph(uint32_t codepoint) const
     {
-        if (codepoint >= uint32_t(glyph_index.size()) || glyph_index[codepoint] == char_t(-1))
+        const auto index = glyph_index.get(codepoint);
+        if (index == char_t(-1))
         {
             return fallback_glyph;
         }
 
-        return glyphs[size_t(glyph_index[codepoint])];
+        return glyphs[size_t(index)];
     }
 
     float get_kerning(uint32_t codepoint1, uint32_t codepoint2) const
     {
-        auto it = kernings.find({char_t(codepoint1), char_t(codepoint2)});
-
-        if(it != std::end(kernings))
-        {
-            return it->second;
-        }
+        return kerning_pairs.get(char_t(codepoint1), char_t(codepoint2));
+    }
 
-        return 0.0f;
+    /// Compiles the kernings into the flat lookup used by get_kerning.
+    /// Call it after modifying the kernings.
+    void compile_kernings()
+    {
+        kerning_pairs.build(kernings);
     }
 
     std::string get_info() const
     {
-        auto glyphs_mem_bytes = glyphs.size() * sizeof(glyph) + glyph_index.size() * sizeof(char_t);
+        auto index_mem_bytes = glyph_index.get_memory_bytes();
+        auto dense_index_mem_bytes = glyph_index.get_dense_memory_bytes();
+        auto glyphs_mem_bytes = glyphs.size() * sizeof(glyph) + index_mem_bytes;
         auto glyphs_mem_mb =  float(glyphs_mem_bytes) / float(1024 * 1024);
         std::stringstream ss{};
         ss << "\n";
         ss << "face       : " << face_name << "\n";
         ss << "size       : " << size << "\n";
         ss << "glyphs     : " << glyphs.size() << "\n";
-        ss << "kerning    : " << kernings.size() << " pairs\n";
+        ss << "kerning    : " << kernings.size() << " pairs (" << kerning_pairs.get_memory_bytes() << "b lookup)\n";
         ss << "glyphs mem : " << glyphs_mem_bytes << "b (" << std::setprecision(2) << glyphs_mem_mb << "mb)\n";
+        ss << "index mem  : " << index_mem_bytes << "b (" << dense_index_mem_bytes << "b as a dense index, "
+           << dense_index_mem_bytes - std::min(index_mem_bytes, dense_index_mem_bytes) << "b saved)\n";
         if(surface)
         {
             auto atlas_mem_bytes =  surface->get_width() * surface->get_height();
@@ -74,12 +81,15 @@ struct font_info
     /// all loaded glyphs
     std::vector<glyph> glyphs;
 
-    /// sparse vector of indices per codepoint
-    std::vector<char_t> glyph_index;
+    /// paged indices into the glyphs per codepoint
+    paged_glyph_index<char_t> glyph_index;
 
     /// kerning lookup table per codepoint
     kerning_table_t kernings{};
 
+    /// the kernings compiled for fast lookups
+    kerning_lookup kerning_pairs{};
+
     /// glyph to be used when requesting a non-existent one
     glyph fallback_glyph{};
 
@@ -0,0 +1,81 @@
+#include "kerning_lookup.h"
+
+namespace gfx
+{
+constexpr uint32_t kerning_lookup::dense_first;
+constexpr uint32_t kerning_lookup::dense_last;
+constexpr uint64_t kerning_lookup::empty_key;
+
+void kerning_lookup::build(const std::vector<std::pair<uint64_t, float>>& pairs)
+{
+    dense_.clear();
+    dense_size_ = 0;
+    size_ = 0;
+
+    const auto is_dense = [](uint64_t key)
+    {
+        const auto codepoint1 = uint32_t(key >> 32);
+        const auto codepoint2 = uint32_t(key);
+        return codepoint1 >= dense_first && codepoint1 <= dense_last &&
+               codepoint2 >= dense_first && codepoint2 <= dense_last;
+    };
+
+    size_t sparse_count = 0;
+    for(const auto& pair : pairs)
+    {
+        if(is_dense(pair.first))
+        {
+            dense_size_ = dense_last - dense_first + 1;
+        }
+        else
+        {
+            sparse_count++;
+        }
+    }
+
+    if(dense_size_ > 0)
+    {
+        dense_.resize(size_t(dense_size_) * dense_size_, 0.0f);
+    }
+
+    // at most half full, there is always an empty slot to end the probing
+    size_t capacity = 1;
+    while(capacity < sparse_count * 2)
+    {
+        capacity *= 2;
+    }
+
+    keys_.assign(capacity, empty_key);
+    values_.assign(capacity, 0.0f);
+    mask_ = capacity - 1;
+
+    for(const auto& pair : pairs)
+    {
+        const auto key = pair.first;
+        if(key == empty_key)
+        {
+            continue;
+        }
+
+        if(is_dense(key))
+        {
+            const auto dense1 = uint32_t(key >> 32) - dense_first;
+            const auto dense2 = uint32_t(key) - dense_first;
+            dense_[dense1 * dense_size_ + dense2] = pair.second;
+            size_++;
+            continue;
+        }
+
+        auto slot = get_slot(key);
+        while(keys_[slot] != empty_key && keys_[slot] != key)
+        {
+            slot = (slot + 1) & mask_;
+        }
+
+        size_ += keys_[slot] == empty_key ? 1 : 0;
+        keys_[slot] = key;
+        values_[slot] = pair.second;
+    }
+}
+
+}
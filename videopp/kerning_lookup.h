@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace gfx
+{
+
+/// Flat kerning table compiled from the ordered kerning map of a font.
+/// Pairs of printable ascii characters are looked up in a dense matrix,
+/// all the other pairs in an open addressing hash table with linear probing.
+/// Lookups never allocate and a missing pair costs a probe or two.
+class kerning_lookup
+{
+public:
+    template<typename Table>
+    void build(const Table& kernings)
+    {
+        std::vector<std::pair<uint64_t, float>> pairs;
+        pairs.reserve(kernings.size());
+        for(const auto& kerning : kernings)
+        {
+            pairs.emplace_back(pack(uint32_t(kerning.first.first), uint32_t(kerning.first.second)), kerning.second);
+        }
+        build(pairs);
+    }
+
+    float get(uint32_t codepoint1, uint32_t codepoint2) const noexcept
+    {
+        const auto dense1 = codepoint1 - dense_first;
+        const auto dense2 = codepoint2 - dense_first;
+        if(dense1 < dense_size_ && dense2 < dense_size_)
+        {
+            return dense_[dense1 * dense_size_ + dense2];
+        }
+
+        // empty slots hold 0, so a missing pair needs no extra branch
+        const auto key = pack(codepoint1, codepoint2);
+        auto slot = get_slot(key);
+        while(keys_[slot] != key && keys_[slot] != empty_key)
+        {
+            slot = (slot + 1) & mask_;
+        }
+        return values_[slot];
+    }
+
+    /// Number of compiled pairs
+    size_t size() const noexcept
+    {
+        return size_;
+    }
+
+    size_t get_memory_bytes() const noexcept
+    {
+        return dense_.size() * sizeof(float) + keys_.size() * sizeof(uint64_t) + values_.size() * sizeof(float);
+    }
+
+private:
+    static constexpr uint32_t dense_first = 0x20;
+    static constexpr uint32_t dense_last = 0x7e;
+    static constexpr uint64_t empty_key = ~uint64_t(0);
+
+    static uint64_t pack(uint32_t codepoint1, uint32_t codepoint2) noexcept
+    {
+        return (uint64_t(codepoint1) << 32) | uint64_t(codepoint2);
+    }
+
+    size_t get_slot(uint64_t key) const noexcept
+    {
+        return size_t((key * 0x9e3779b97f4a7c15ull) >> 32) & mask_;
+    }
+
+    void build(const std::vector<std::pair<uint64_t, float>>& pairs);
+
+    /// Rows of the first character, columns of the second one.
+    /// Empty when the font has no ascii pairs.
+    std::vector<float> dense_;
+    uint32_t dense_size_{};
+
+    /// Power of two sized, at most half full. A single empty
+    /// slot when there are no pairs, so that lookups always end.
+    std::vector<uint64_t> keys_{empty_key};
+    std::vector<float> values_{0.0f};
+    size_t mask_{};
+
+    size_t size_{};
+};
+
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gfx
+{
+
+/// Two level table mapping codepoints to glyph indices.
+/// Codepoints are split into pages of 256. Pages without any glyph are
+/// not stored, they all refer to the shared empty page. A lookup reads
+/// the page table and then the page.
+template<typename T>
+class paged_glyph_index
+{
+public:
+    static constexpr T invalid = T(-1);
+
+    T get(uint32_t codepoint) const noexcept
+    {
+        const auto page = size_t(codepoint >> page_bits);
+        if(page >= pages_.size())
+        {
+            return invalid;
+        }
+
+        return entries_[(size_t(pages_[page]) << page_bits) | (codepoint & page_mask)];
+    }
+
+    void set(uint32_t codepoint, T index)
+    {
+        const auto page = size_t(codepoint >> page_bits);
+        if(page >= pages_.size())
+        {
+            pages_.resize(page + 1, empty_page);
+        }
+
+        if(pages_[page] == empty_page)
+        {
+            if(index == invalid)
+            {
+                return;
+            }
+            pages_[page] = uint32_t(entries_.size() >> page_bits);
+            entries_.resize(entries_.size() + page_size, invalid);
+        }
+
+        entries_[(size_t(pages_[page]) << page_bits) | (codepoint & page_mask)] = index;
+        size_ = std::max(size_, size_t(codepoint) + 1);
+    }
+
+    /// Replace the content with a dense vector indexed by codepoint
+    void assign(const std::vector<T>& dense)
+    {
+        clear();
+        append(dense);
+    }
+
+    /// Continue with a dense vector indexed by codepoint, starting at size()
+    void append(const std::vector<T>& dense)
+    {
+        const auto offset = size_;
+        for(size_t i = 0; i < dense.size(); ++i)
+        {
+            if(dense[i] != invalid)
+            {
+                set(uint32_t(offset + i), dense[i]);
+            }
+        }
+        size_ = offset + dense.size();
+
+        pages_.shrink_to_fit();
+        entries_.shrink_to_fit();
+    }
+
+    void clear()
+    {
+        pages_.clear();
+        entries_.assign(page_size, invalid);
+        size_ = 0;
+    }
+
+    /// One past the highest codepoint set
+    size_t size() const noexcept
+    {
+        return size_;
+    }
+
+    size_t get_memory_bytes() const noexcept
+    {
+        return pages_.capacity() * sizeof(uint32_t) + entries_.capacity() * sizeof(T);
+    }
+
+    /// Memory of a dense vector indexed by codepoint
+    size_t get_dense_memory_bytes() const noexcept
+    {
+        return size_ * sizeof(T);
+    }
+
+private:
+    static constexpr uint32_t page_bits = 8;
+    static constexpr uint32_t page_size = 1u << page_bits;
+    static constexpr uint32_t page_mask = page_size - 1;
+    static constexpr uint32_t empty_page = 0;
+
+    /// page of every block of 256 codepoints
+    std::vector<uint32_t> pages_;
+    /// the pages one after the other, the first one is the empty page
+    std::vector<T> entries_ = std::vector<T>(page_size, invalid);
+    size_t size_{};
+};
+
+template<typename T>
+constexpr T paged_glyph_index<T>::invalid;
+template<typename T>
+constexpr uint32_t paged_glyph_index<T>::page_bits;
+template<typename T>
+constexpr uint32_t paged_glyph_index<T>::page_size;
+template<typename T>
+constexpr uint32_t paged_glyph_index<T>::page_mask;
+template<typename T>
+constexpr uint32_t paged_glyph_index<T>::empty_page;
+
+}
@@ -89,15 +89,12 @@ font_info create_font_from_cyan_sep_png(const std::string& name, std::unique_ptr
     f.ascent = f.line_height;
     f.descent = 0;
 
-    char_t max_char = 0;
     size_t total_glyphs = 0;
     for (auto& range : codepoint_ranges)
     {
         total_glyphs += range.second - range.first + 1;
-        max_char = std::max(max_char, char_t(range.second + 1));
     }
 
-    f.glyph_index.resize(max_char, char_t(-1));
     f.glyphs.reserve(total_glyphs);
     for (auto& range : codepoint_ranges)
     {
@@ -113,7 +110,7 @@ font_info create_font_from_cyan_sep_png(const std::string& name, std::unique_ptr
                 }
             }
 
-            f.glyph_index[c] = char_t(f.glyphs.size());
+            f.glyph_index.set(uint32_t(c), char_t(f.glyphs.size()));
             f.glyphs.emplace_back();
             auto& g = f.glyphs.back();
 
@@ -0,0 +1,278 @@
+#include "profiling.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <unordered_map>
+
+namespace gfx
+{
+namespace profiling
+{
+namespace
+{
+struct event
+{
+    const char* name{};
+    int64_t value{};
+    /// nanoseconds since the profiling epoch
+    int64_t begin{};
+    int64_t end{};
+};
+
+constexpr uint64_t ring_capacity = 1 << 15;
+
+/// Single producer ring of the events of one thread.
+/// Readers copy the events and drop the ones the producer
+/// may have overwritten while they were copied.
+struct thread_ring
+{
+    std::array<event, ring_capacity> events{};
+    /// events written so far, stored by the owning thread only
+    std::atomic<uint64_t> head{0};
+    /// events consumed by end_frame
+    uint64_t aggregated{};
+    /// rings of finished threads are reused by new ones
+    std::atomic<bool> in_use{false};
+    uint32_t id{};
+    thread_ring* next{};
+};
+
+/// Rings are never freed, the list only grows
+std::atomic<thread_ring*> rings{nullptr};
+std::atomic<uint32_t> rings_count{0};
+
+const profile_clock::time_point epoch = profile_clock::now();
+
+thread_ring* acquire_ring()
+{
+    for(auto ring = rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next)
+    {
+        bool expected = false;
+        if(ring->in_use.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+        {
+            return ring;
+        }
+    }
+
+    auto ring = new thread_ring();
+    ring->in_use.store(true, std::memory_order_relaxed);
+    ring->id = rings_count.fetch_add(1, std::memory_order_relaxed);
+
+    auto head = rings.load(std::memory_order_relaxed);
+    do
+    {
+        ring->next = head;
+    }
+    while(!rings.compare_exchange_weak(head, ring, std::memory_order_release, std::memory_order_relaxed));
+
+    return ring;
+}
+
+struct ring_owner
+{
+    ring_owner() : ring(acquire_ring()) {}
+    ~ring_owner()
+    {
+        ring->in_use.store(false, std::memory_order_release);
+    }
+
+    thread_ring* ring{};
+};
+
+thread_ring& get_thread_ring() noexcept
+{
+    thread_local ring_owner owner;
+    return *owner.ring;
+}
+
+/// Copy the events of a ring starting at 'from' into 'out'.
+/// Returns the index after the last copied event.
+uint64_t read_ring(const thread_ring& ring, uint64_t from, std::vector<event>& out, size_t& dropped)
+{
+    const auto head = ring.head.load(std::memory_order_acquire);
+    auto first = std::max(from, head > ring_capacity ? head - ring_capacity : 0);
+
+    const auto offset = out.size();
+    for(auto i = first; i < head; ++i)
+    {
+        out.emplace_back(ring.events[i % ring_capacity]);
+    }
+
+    // the producer may have lapped the copied events meanwhile,
+    // the slot of the event being written counts as overwritten too
+    const auto new_head = ring.head.load(std::memory_order_acquire);
+    const auto valid_first = new_head + 1 > ring_capacity ? new_head + 1 - ring_capacity : 0;
+    if(valid_first > first)
+    {
+        const auto torn = std::min(valid_first, head) - first;
+        out.erase(out.begin() + std::ptrdiff_t(offset), out.begin() + std::ptrdiff_t(offset + torn));
+        first += torn;
+    }
+
+    dropped += size_t(first - std::min(from, first));
+    return head;
+}
+
+void write_escaped(std::ostream& os, const char* str)
+{
+    for(; *str != 0; ++str)
+    {
+        const auto c = *str;
+        if(c == '"' || c == '\\')
+        {
+            os << '\\' << c;
+        }
+        else if(static_cast<unsigned char>(c) < 0x20)
+        {
+            os << ' ';
+        }
+        else
+        {
+            os << c;
+        }
+    }
+}
+
+struct frame_state
+{
+    frame_profile last{};
+    profile_clock::time_point last_end{profile_clock::now()};
+    std::vector<event> events;
+    std::unordered_map<const char*, size_t> zones_by_name;
+};
+
+frame_state& get_frame_state()
+{
+    static frame_state state;
+    return state;
+}
+
+}
+
+void record(const char* name, int64_t value, profile_clock::time_point begin, profile_clock::time_point end) noexcept
+{
+    auto& ring = get_thread_ring();
+    const auto head = ring.head.load(std::memory_order_relaxed);
+
+    auto& e = ring.events[head % ring_capacity];
+    e.name = name;
+    e.value = value;
+    e.begin = std::chrono::duration_cast<std::chrono::nanoseconds>(begin - epoch).count();
+    e.end = std::chrono::duration_cast<std::chrono::nanoseconds>(end - epoch).count();
+
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+const frame_profile& end_frame() noexcept
+{
+    auto& state = get_frame_state();
+    auto& profile = state.last;
+
+    const auto now = profile_clock::now();
+    profile.frame++;
+    profile.duration = now - state.last_end;
+    profile.zones.clear();
+    profile.dropped_events = 0;
+    state.last_end = now;
+
+    state.events.clear();
+    for(auto ring = rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next)
+    {
+        ring->aggregated = read_ring(*ring, ring->aggregated, state.events, profile.dropped_events);
+    }
+
+    // the same literal may have different addresses in different
+    // translation units, so the zones are merged by name afterwards
+    state.zones_by_name.clear();
+    for(const auto& e : state.events)
+    {
+        auto it = state.zones_by_name.find(e.name);
+        if(it == state.zones_by_name.end())
+        {
+            auto found = std::find_if(profile.zones.begin(), profile.zones.end(), [&](const zone_stats& zone)
+            {
+                return std::strcmp(zone.name, e.name) == 0;
+            });
+
+            auto idx = size_t(std::distance(profile.zones.begin(), found));
+            if(found == profile.zones.end())
+            {
+                zone_stats stats{};
+                stats.name = e.name;
+                profile.zones.emplace_back(stats);
+            }
+            it = state.zones_by_name.emplace(e.name, idx).first;
+        }
+
+        auto& zone = profile.zones[it->second];
+        const auto duration = std::chrono::nanoseconds(e.end - e.begin);
+        zone.count++;
+        zone.total += duration;
+        zone.max = std::max(zone.max, duration);
+    }
+
+    std::sort(profile.zones.begin(), profile.zones.end(), [](const zone_stats& lhs, const zone_stats& rhs)
+    {
+        return lhs.total > rhs.total;
+    });
+
+    return profile;
+}
+
+const frame_profile& get_last_frame() noexcept
+{
+    return get_frame_state().last;
+}
+
+std::string to_chrome_trace()
+{
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(3);
+    ss << "{\"traceEvents\":[";
+
+    bool first = true;
+    std::vector<event> events;
+    for(auto ring = rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next)
+    {
+        size_t dropped = 0;
+        events.clear();
+        read_ring(*ring, 0, events, dropped);
+
+        for(const auto& e : events)
+        {
+            ss << (first ? "\n" : ",\n");
+            first = false;
+
+            // complete events, timestamps in microseconds
+            ss << "{\"name\":\"";
+            write_escaped(ss, e.name);
+            ss << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << ring->id
+               << ",\"ts\":" << double(e.begin) / 1000.0
+               << ",\"dur\":" << double(e.end - e.begin) / 1000.0
+               << ",\"args\":{\"value\":" << e.value << "}}";
+        }
+    }
+
+    ss << "\n],\"displayTimeUnit\":\"ns\"}\n";
+    return ss.str();
+}
+
+bool save_chrome_trace(const std::string& file_name)
+{
+    std::ofstream file(file_name, std::ios::out | std::ios::trunc);
+    if(!file)
+    {
+        return false;
+    }
+
+    file << to_chrome_trace();
+    return bool(file);
+}
+
+}
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gfx
+{
+namespace profiling
+{
+
+/// Aggregated zones with the same name
+struct zone_stats
+{
+    const char* name{};
+    size_t count{};
+    std::chrono::nanoseconds total{};
+    std::chrono::nanoseconds max{};
+};
+
+/// Zones recorded by all threads between two end_frame calls
+struct frame_profile
+{
+    uint64_t frame{};
+    std::chrono::nanoseconds duration{};
+    /// sorted by total time, the most expensive first
+    std::vector<zone_stats> zones;
+    /// events overwritten in the rings before they were aggregated
+    size_t dropped_events{};
+};
+
+using profile_clock = std::chrono::steady_clock;
+
+/// Store a finished zone into the ring of the calling thread.
+/// Recording never locks, a full ring overwrites its oldest events.
+void record(const char* name, int64_t value, profile_clock::time_point begin, profile_clock::time_point end) noexcept;
+
+/// Aggregate the zones recorded since the previous call. Called once per frame.
+const frame_profile& end_frame() noexcept;
+const frame_profile& get_last_frame() noexcept;
+
+/// The events still held by the rings in the chrome trace event format.
+/// Open it in chrome://tracing or any viewer of the format.
+std::string to_chrome_trace();
+bool save_chrome_trace(const std::string& file_name);
+
+/// Times the enclosing scope. Use it through VIDEOPP_PROFILE_ZONE.
+class zone
+{
+public:
+    /// @param name - a string literal, it is referenced and not copied
+    /// @param value - an optional value shown with the zone (e.g. a count)
+    explicit zone(const char* name, int64_t value = 0) noexcept
+        : name_(name)
+        , value_(value)
+        , begin_(profile_clock::now())
+    {
+    }
+
+    ~zone()
+    {
+        record(name_, value_, begin_, profile_clock::now());
+    }
+
+    zone(const zone&) = delete;
+    zone& operator=(const zone&) = delete;
+
+private:
+    const char* name_{};
+    int64_t value_{};
+    profile_clock::time_point begin_{};
+};
+
+}
+}
+
+/// Profiling is compiled in only with VIDEOPP_PROFILING defined
+/// (the BUILD_VIDEOPP_WITH_PROFILING cmake option). Otherwise the
+/// macros expand to nothing and their arguments are not evaluated.
+#ifdef VIDEOPP_PROFILING
+#define VIDEOPP_PROFILE_CONCAT_IMPL(a, b) a##b
+#define VIDEOPP_PROFILE_CONCAT(a, b) VIDEOPP_PROFILE_CONCAT_IMPL(a, b)
+#define VIDEOPP_PROFILE_ZONE(...) ::gfx::profiling::zone VIDEOPP_PROFILE_CONCAT(videopp_zone_, __LINE__){__VA_ARGS__};
+#define VIDEOPP_PROFILE_FRAME() ::gfx::profiling::end_frame();
+#else
+#define VIDEOPP_PROFILE_ZONE(...)
+#define VIDEOPP_PROFILE_FRAME()
+#endif
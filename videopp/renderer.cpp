@@ -4,9 +4,14 @@
 #include "ttf_font.h"
 #include "texture.h"
 #include "logger.h"
+#include "profiling.h"
 #include "detail/shaders.h"
 #include "detail/utils.h"
+#include "detail/gl_state.h"
 #include <set>
+#include <cassert>
+#include <cstring>
+#include <utility>
 
 #ifdef WGL_CONTEXT
 #include "detail/wgl/context_wgl.h"
@@ -17,6 +22,10 @@
 #else
 #endif
 
+#ifdef VIDEOPP_HEADLESS
+#include "detail/egl/offscreen_egl.h"
+#endif
+
 
 namespace gfx
 {
@@ -183,13 +192,119 @@ namespace
                 return GL_TRIANGLES;
         }
     }
+
+    /// Draws indices relative to the base vertex. Without GL 3.2
+    /// the vertex layout is rebound at the base vertex instead.
+    inline void draw_elements_base_vertex(gl_state& state, const gpu_program& program, vertex_format format,
+                                          size_t stream_offset, GLenum mode, GLsizei count, GLenum type,
+                                          uintptr_t indices_offset, uint32_t base_vertex)
+    {
+        const auto indices = reinterpret_cast<const GLvoid*>(indices_offset);
+        if(GLAD_GL_VERSION_3_2)
+        {
+            gl_call(glDrawElementsBaseVertex(mode, count, type, indices, GLint(base_vertex)));
+        }
+        else
+        {
+            if(program.shader)
+            {
+                state.bind_layout(program.shader->get_layout(format), stream_offset + base_vertex * get_vertex_stride(format));
+            }
+            gl_call(glDrawElements(mode, count, type, indices));
+        }
+    }
+
+    /// Commands which differ only in the index ranges
+    /// they draw can be submitted with one multi draw call.
+    inline bool can_be_multi_drawn(const draw_list& list, const draw_cmd& lhs, const draw_cmd& rhs) noexcept
+    {
+        if(lhs.dr_type != rhs.dr_type ||
+           (lhs.dr_type != draw_type::elements && lhs.dr_type != draw_type::quads))
+        {
+            return false;
+        }
+
+        if(lhs.program.shader != rhs.program.shader ||
+           lhs.format != rhs.format ||
+           lhs.type != rhs.type ||
+           lhs.blend != rhs.blend ||
+           lhs.clip_idx != rhs.clip_idx ||
+           lhs.transform_idx != rhs.transform_idx ||
+           lhs.crop_idx != rhs.crop_idx ||
+           lhs.setup_idx != rhs.setup_idx ||
+           lhs.pixel_snap != rhs.pixel_snap ||
+           lhs.used_slots != rhs.used_slots)
+        {
+            return false;
+        }
+
+        // callbacks may change the state between the commands
+        if(lhs.setup_idx >= 0)
+        {
+            const auto& setup = list.setups[size_t(lhs.setup_idx)];
+            if(setup.begin || setup.end)
+            {
+                return false;
+            }
+        }
+
+        if(lhs.slots_offset != rhs.slots_offset)
+        {
+            for(size_t slot = 0; slot < lhs.used_slots; ++slot)
+            {
+                if(!(list.texture_slots[lhs.slots_offset + slot] == list.texture_slots[rhs.slots_offset + slot]))
+                {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    /// Number of consecutive commands, starting from the given one,
+    /// which can be drawn with a single multi draw call.
+    inline size_t get_multi_draw_count(const draw_list& list, size_t first) noexcept
+    {
+        if(!GLAD_GL_VERSION_3_2 || !get_draw_config().multi_draw)
+        {
+            return 1;
+        }
+
+        const auto& commands = list.commands;
+        size_t last = first + 1;
+        while(last < commands.size() && can_be_multi_drawn(list, commands[first], commands[last]))
+        {
+            last++;
+        }
+
+        return last - first;
+    }
+
+    /// Busy wait for a flag set by the other side of the frame hand-off.
+    /// Yields first and then sleeps, a frame rarely takes less than a few spins.
+    template<typename F>
+    void spin_wait(F&& ready) noexcept
+    {
+        for(size_t spins = 0; !ready(); ++spins)
+        {
+            if(spins < 64)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+    }
 }
 
 /// Construct the renderer and initialize default rendering states
 ///	@param win - the window handle
 ///	@param vsync - true to enable vsync
 renderer::renderer(os::window& win, bool vsync, frame_callbacks fn)
-    : win_(win)
+    : win_(&win)
 #ifdef WGL_CONTEXT
     , context_(std::make_unique<context_wgl>(win.get_native_handle()))
 #elif GLX_CONTEXT
@@ -197,13 +312,40 @@ renderer::renderer(os::window& win, bool vsync, frame_callbacks fn)
 #elif EGL_CONTEXT
     , context_(std::make_unique<context_egl>(win.get_native_handle(), win.get_native_display()/*, 3*/))
 #endif
-    , rect_({0, 0, int(win.get_size().w), int(win_.get_size().h)})
+    , rect_({0, 0, int(win.get_size().w), int(win.get_size().h)})
 {
     if(!gladLoadGL())
     {
         throw exception("Cannot load glad.");
     }
 
+    init(vsync, std::move(fn));
+}
+
+/// Construct a renderer drawing into an offscreen target
+///	@param offscreen_size - the size of the target
+renderer::renderer(const size& offscreen_size, frame_callbacks fn)
+    : rect_({0, 0, int(offscreen_size.w), int(offscreen_size.h)})
+{
+#ifdef VIDEOPP_HEADLESS
+    context_ = create_offscreen_context(offscreen_size);
+    if(!load_offscreen_gl())
+    {
+        throw exception("Cannot load glad.");
+    }
+
+    init(false, std::move(fn));
+#else
+    (void)fn;
+    throw exception("The offscreen renderer requires a build with BUILD_VIDEOPP_HEADLESS.");
+#endif
+}
+
+/// Initialize the default rendering states
+///	@param vsync - true to enable vsync
+void renderer::init(bool vsync, frame_callbacks fn)
+{
+
     GLint max_tex_units{};
     gl_call(glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &max_tex_units));
 
@@ -260,10 +402,26 @@ renderer::renderer(os::window& win, bool vsync, frame_callbacks fn)
         ibo.unbind();
     }
 
+    quad_ibo_.create();
+    reserve_quad_indices(1024);
+
+    // The rings grow when needed. Their high-water marks tell the sizes to start with.
+    stream_vertex_ring_.create(sizeof(vertex_2d) * 65536);
+    stream_index_ring_.create(sizeof(draw_list::index_t) * 131072);
+
+    if(!win_)
+    {
+        offscreen_target_ = create_texture(rect_.w, rect_.h, pix_type::rgba, texture::format_type::streaming);
+        if(!offscreen_target_)
+        {
+            throw exception("Cannot create the offscreen target.");
+        }
+    }
+
     reset_transform();
     set_model_view(0, rect_);
 
-    auto create_program = [&](auto& program, auto fs, auto vs)
+    auto create_program = [&](auto& program, auto fs, auto vs, bool compact = true)
     {
         if(!program.shader)
         {
@@ -279,6 +437,17 @@ renderer::renderer(os::window& win, bool vsync, frame_callbacks fn)
             layout.template add<float>(2, offsetof(vertex_2d, extra_data), "aExtraData", stride);
             layout.template add<uint32_t>(1, offsetof(vertex_2d, tex_idx), "aTexIndex", stride);
 
+            // programs that don't use the extra color and data can read compact vertices
+            if(compact)
+            {
+                auto& compact_layout = shader->get_layout(vertex_format::compact);
+                constexpr auto compact_stride = sizeof(vertex_2d_compact);
+                compact_layout.template add<float>(2, offsetof(vertex_2d_compact, pos), "aPosition", compact_stride);
+                compact_layout.template add<uint16_t>(2, offsetof(vertex_2d_compact, uv), "aTexCoord", compact_stride, true);
+                compact_layout.template add<uint8_t>(4, offsetof(vertex_2d_compact, col), "aColor", compact_stride, true);
+                compact_layout.template add<uint8_t>(1, offsetof(vertex_2d_compact, tex_idx), "aTexIndex", compact_stride);
+            }
+
         }
     };
 
@@ -331,7 +500,8 @@ renderer::renderer(os::window& win, bool vsync, frame_callbacks fn)
                        .append(common_funcs)
                        .append(fs_distance_field).c_str(),
                    std::string(glsl_version)
-                       .append(vs_simple).c_str());
+                       .append(vs_simple).c_str(),
+                   false);
 
     create_program(get_program<programs::distance_field_crop>(),
                    std::string(glsl_version)
@@ -341,7 +511,8 @@ renderer::renderer(os::window& win, bool vsync, frame_callbacks fn)
                        .append(user_defines)
                        .append(fs_distance_field).c_str(),
                    std::string(glsl_version)
-                       .append(vs_simple).c_str());
+                       .append(vs_simple).c_str(),
+                   false);
 
 
     create_program(get_program<programs::distance_field_supersample>(),
@@ -352,7 +523,8 @@ renderer::renderer(os::window& win, bool vsync, frame_callbacks fn)
                        .append(supersample)
                        .append(fs_distance_field).c_str(),
                    std::string(glsl_version)
-                       .append(vs_simple).c_str());
+                       .append(vs_simple).c_str(),
+                   false);
 
     create_program(get_program<programs::distance_field_crop_supersample>(),
                    std::string(glsl_version)
@@ -363,7 +535,8 @@ renderer::renderer(os::window& win, bool vsync, frame_callbacks fn)
                        .append(supersample)
                        .append(fs_distance_field).c_str(),
                    std::string(glsl_version)
-                       .append(vs_simple).c_str());
+                       .append(vs_simple).c_str(),
+                   false);
 
     create_program(get_program<programs::alphamix>(),
                     std::string(glsl_version)
@@ -413,6 +586,33 @@ renderer::renderer(os::window& win, bool vsync, frame_callbacks fn)
                    std::string(glsl_version)
                        .append(vs_simple).c_str());
 
+    // The instanced sprites need instanced arrays and gl_VertexID.
+    // Without them draw_list::add_image_instanced falls back to plain quads.
+#if defined(GLX_CONTEXT) || defined(WGL_CONTEXT)
+    auto& instanced_program = get_program<programs::instanced_sprite>();
+    if(!instanced_program.shader && GLAD_GL_VERSION_3_3)
+    {
+        auto shader = create_shader(std::string(glsl_version)
+                                        .append(glsl_precision)
+                                        .append(common_funcs)
+                                        .append(fs_multi_channel).c_str(),
+                                    std::string(glsl_version)
+                                        .append(vs_instanced).c_str());
+        embedded_shaders_.emplace_back(shader);
+        instanced_program.shader = shader.get();
+
+        auto& layout = shader->get_layout(vertex_format::instance);
+        constexpr auto stride = sizeof(sprite_instance);
+        layout.add<float>(2, offsetof(sprite_instance, pos), "aPosition", stride);
+        layout.add<float>(2, offsetof(sprite_instance, axis_x), "aAxisX", stride);
+        layout.add<float>(2, offsetof(sprite_instance, axis_y), "aAxisY", stride);
+        layout.add<uint16_t>(4, offsetof(sprite_instance, uv), "aTexRect", stride, true);
+        layout.add<uint8_t>(4, offsetof(sprite_instance, col), "aColor", stride, true);
+        layout.add<uint8_t>(1, offsetof(sprite_instance, tex_idx), "aTexIndex", stride);
+        layout.set_divisor(1);
+    }
+#endif
+
     if(!font_default())
     {
         font_default() = create_font(create_default_font(13), true);
@@ -476,7 +676,9 @@ void renderer::setup_sampler(texture::wrap_type wrap, texture::interpolation_typ
 
 renderer::~renderer()
 {
+    set_render_thread(false);
     set_current_context();
+    offscreen_target_.reset();
     delete_textures();
     embedded_fonts_.clear();
     embedded_shaders_.clear();
@@ -510,6 +712,11 @@ renderer::transform_stack& renderer::get_transform_stack() const noexcept
 {
     if (fbo_stack_.empty())
     {
+        // the recording thread keeps pushing transforms meanwhile
+        if(is_render_thread())
+        {
+            return render_transforms_;
+        }
         return master_transforms_;
     }
 
@@ -518,7 +725,7 @@ renderer::transform_stack& renderer::get_transform_stack() const noexcept
 
 void renderer::flush() const noexcept
 {
-    draw_cmd_list(get_list());
+    draw_cmd_list(get_list(), is_with_fbo() ? gpu_pass::fbo : gpu_pass::master);
     get_list().clear();
 }
 
@@ -547,23 +754,35 @@ void renderer::queue_to_delete_texture(pixmap pixmap_id, uint32_t fbo_id, uint32
 
 void renderer::delete_textures() noexcept
 {
-    for (auto& pixmap_id : pixmap_to_delete_)
+    if(!set_current_context())
+    {
+        return;
+    }
+
+    delete_resources(pixmap_to_delete_, fbo_to_delete_, textures_to_delete_);
+}
+
+void renderer::delete_resources(std::vector<pixmap>& pixmaps,
+                                std::vector<uint32_t>& fbos,
+                                std::vector<uint32_t>& textures) const noexcept
+{
+    for (auto& pixmap_id : pixmaps)
     {
         context_->destroy_pixmap(pixmap_id);
     }
-    pixmap_to_delete_.clear();
+    pixmaps.clear();
 
-    if (!fbo_to_delete_.empty())
+    if (!fbos.empty())
     {
-        gl_call(glDeleteFramebuffers(GLsizei(fbo_to_delete_.size()), fbo_to_delete_.data()));
-        fbo_to_delete_.clear();
+        gl_call(glDeleteFramebuffers(GLsizei(fbos.size()), fbos.data()));
+        fbos.clear();
     }
 
-    if (!textures_to_delete_.empty())
+    if (!textures.empty())
     {
         // Destroy texture
-        gl_call(glDeleteTextures(GLsizei(textures_to_delete_.size()), textures_to_delete_.data()));
-        textures_to_delete_.clear();
+        gl_call(glDeleteTextures(GLsizei(textures.size()), textures.data()));
+        textures.clear();
     }
 }
 
@@ -573,7 +792,7 @@ void renderer::delete_textures() noexcept
 void renderer::set_model_view(uint32_t fbo, const rect& rect) const noexcept
 {
     // Bind the FBO or backbuffer if 0
-    gl_call(glBindFramebuffer(GL_FRAMEBUFFER, fbo));
+    gl_call(glBindFramebuffer(GL_FRAMEBUFFER, fbo == 0 ? get_backbuffer() : fbo));
 
     // Set the viewport
     gl_call(glViewport(0, 0, rect.w, rect.h));
@@ -598,15 +817,170 @@ void renderer::set_model_view(uint32_t fbo, const rect& rect) const noexcept
 ///	@return true on success
 bool renderer::set_current_context() const noexcept
 {
+    // the context can be current on one thread only,
+    // so take it back once the frame in flight is presented
+    if(render_thread_.joinable() && !is_render_thread())
+    {
+        wait_frame();
+    }
+
     return context_->make_current();
 }
 
+bool renderer::is_render_thread() const noexcept
+{
+    return render_thread_.joinable() && std::this_thread::get_id() == render_thread_.get_id();
+}
+
+/// The backbuffer rect to draw into. The window may be resized while
+/// a frame is in flight, so the render thread uses the submitted one.
+const rect& renderer::get_viewport() const noexcept
+{
+    return is_render_thread() ? frame_.viewport : rect_;
+}
+
+void renderer::wait_frame() const noexcept
+{
+    spin_wait([&]()
+    {
+        return frame_state_.load(std::memory_order_acquire) == frame_state::idle;
+    });
+}
+
+bool renderer::set_render_thread(bool enabled) noexcept
+{
+    if(enabled == render_thread_.joinable())
+    {
+        return true;
+    }
+
+    if(enabled)
+    {
+        // the render thread takes the context when the first frame is submitted.
+        // With GLX this requires XInitThreads(), see set_render_thread in renderer.h
+        if(!set_current_context() || !context_->release_current())
+        {
+            log("ERROR: Cannot release the context for the render thread.");
+            return false;
+        }
+
+        render_thread_stop_.store(false, std::memory_order_relaxed);
+        render_thread_ = std::thread([this]()
+        {
+            render_thread_main();
+        });
+        return true;
+    }
+
+    wait_frame();
+    render_thread_stop_.store(true, std::memory_order_release);
+    render_thread_.join();
+
+    return set_current_context();
+}
+
+bool renderer::is_render_thread_enabled() const noexcept
+{
+    return render_thread_.joinable();
+}
+
+bool renderer::is_frame_in_flight() const noexcept
+{
+    return frame_state_.load(std::memory_order_acquire) == frame_state::submitted;
+}
+
+bool renderer::wait_render_thread() const noexcept
+{
+    return set_current_context();
+}
+
+void renderer::render_thread_main() noexcept
+{
+    while(true)
+    {
+        spin_wait([&]()
+        {
+            return frame_state_.load(std::memory_order_acquire) == frame_state::submitted ||
+                   render_thread_stop_.load(std::memory_order_acquire);
+        });
+
+        // stopping is requested only while idle
+        if(frame_state_.load(std::memory_order_acquire) != frame_state::submitted)
+        {
+            break;
+        }
+
+        render_frame();
+
+        context_->release_current();
+        frame_state_.store(frame_state::idle, std::memory_order_release);
+    }
+}
+
+/// Draw, swap and clean up after the submitted frame. Runs on the render thread.
+void renderer::render_frame() noexcept
+{
+    if(!set_current_context())
+    {
+        log("ERROR: Cannot make the context current on the render thread.");
+        frame_.list.clear();
+        return;
+    }
+
+    reset_transform();
+    set_model_view(0, frame_.viewport);
+
+    if(frame_.list.empty())
+    {
+        // due to bug in the driver
+        // we must keep it busy
+        draw_cmd_list(dummy_list_, gpu_pass::master);
+    }
+    else
+    {
+        draw_cmd_list(frame_.list, gpu_pass::master);
+        frame_.list.clear();
+    }
+
+    stats_.gpu_timings = gpu_timer_.end_frame();
+
+    context_->swap_buffers();
+
+    // Resources released while this frame was recorded may still
+    // have been used by it, so they are deleted only after it is drawn.
+    delete_resources(frame_.pixmap_to_delete, frame_.fbo_to_delete, frame_.textures_to_delete);
+
+    frame_.stats = stats_;
+    stats_ = {};
+}
+
+/// Hand the recorded frame to the render thread. Runs on the recording thread.
+void renderer::submit_frame() noexcept
+{
+    // the packet is ours again once the previous frame is presented
+    wait_frame();
+
+    last_stats_ = frame_.stats;
+
+    std::swap(master_list_, frame_.list);
+    frame_.viewport = rect_;
+    frame_.pixmap_to_delete.swap(pixmap_to_delete_);
+    frame_.fbo_to_delete.swap(fbo_to_delete_);
+    frame_.textures_to_delete.swap(textures_to_delete_);
+
+    reset_transform();
+
+    // gl work done after the submit takes the context back from the render thread
+    context_->release_current();
+    frame_state_.store(frame_state::submitted, std::memory_order_release);
+}
+
 ///
 void renderer::set_old_framebuffer() const noexcept
 {
     if (fbo_stack_.empty())
     {
-        gl_call(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+        gl_call(glBindFramebuffer(GL_FRAMEBUFFER, get_backbuffer()));
         return;
     }
 
@@ -614,6 +988,52 @@ void renderer::set_old_framebuffer() const noexcept
     gl_call(glBindFramebuffer(GL_FRAMEBUFFER, top_texture.fbo->get_FBO()));
 }
 
+/// The framebuffer presented frames are drawn into
+uint32_t renderer::get_backbuffer() const noexcept
+{
+    // a headless renderer draws like into a backbuffer, without flipping
+    return offscreen_target_ ? offscreen_target_->get_FBO() : 0;
+}
+
+bool renderer::is_headless() const noexcept
+{
+    return win_ == nullptr;
+}
+
+/// Read back the last presented frame (from VRAM - slow!)
+///	@param pixels - [out] rgba rows from top to bottom
+///	@return true on success
+bool renderer::read_back(std::vector<uint8_t>& pixels) const noexcept
+{
+    if(!offscreen_target_ || !set_current_context())
+    {
+        return false;
+    }
+
+    const auto width = size_t(rect_.w);
+    const auto height = size_t(rect_.h);
+    const auto pitch = width * 4;
+    pixels.resize(pitch * height);
+
+    gl_call(glBindFramebuffer(GL_FRAMEBUFFER, get_backbuffer()));
+    gl_call(glPixelStorei(GL_PACK_ALIGNMENT, 1));
+    gl_call(glReadPixels(0, 0, GLsizei(width), GLsizei(height), GL_RGBA, GL_UNSIGNED_BYTE, pixels.data()));
+    set_old_framebuffer();
+
+    // gl reads the rows bottom to top
+    std::vector<uint8_t> row(pitch);
+    for(size_t y = 0; y < height / 2; ++y)
+    {
+        auto top = pixels.data() + y * pitch;
+        auto bottom = pixels.data() + (height - 1 - y) * pitch;
+        std::memcpy(row.data(), top, pitch);
+        std::memcpy(top, bottom, pitch);
+        std::memcpy(bottom, row.data(), pitch);
+    }
+
+    return true;
+}
+
 /// Resize the dirty rectangle
 /// @param new_width - the new width
 /// @param new_height - the new height
@@ -756,6 +1176,98 @@ shader_ptr renderer::create_shader(const char* fragment_code, const char* vertex
     return {};
 }
 
+/// Create a static segment
+///	@param list - list to upload
+///	@return a shared pointer to the segment
+static_segment_ptr renderer::create_static_segment(const draw_list& list) const noexcept
+{
+    if(!set_current_context())
+    {
+        return {};
+    }
+
+    auto segment = static_segment_ptr(new static_segment());
+    segment->vao_.create();
+    segment->vbo_.create();
+    segment->ibo_.create();
+
+    if(!update_static_segment(*segment, list))
+    {
+        return {};
+    }
+
+    return segment;
+}
+
+/// Upload new content into a static segment. This is the way to
+/// refresh a segment after its content changed or it was invalidated.
+///	@param segment - segment to update
+///	@param list - list to upload
+///	@return true on success
+bool renderer::update_static_segment(static_segment& segment, const draw_list& list) const noexcept
+{
+    if(!set_current_context())
+    {
+        return false;
+    }
+
+    if(!list.sub_lists.empty() || !list.static_segments.empty())
+    {
+        log("ERROR: Cannot create static segment. Referenced lists are not supported.");
+        return false;
+    }
+
+    list.validate_stacks();
+
+    const auto vertices_mem_size = list.vertices.size() * sizeof(decltype(list.vertices)::value_type);
+    const auto compact_vertices_mem_size = list.compact_vertices.size() * sizeof(decltype(list.compact_vertices)::value_type);
+    const auto instances_mem_size = list.instances.size() * sizeof(decltype(list.instances)::value_type);
+    const auto indices_mem_size = list.indices.size() * sizeof(decltype(list.indices)::value_type);
+
+    size_t max_quads = 0;
+    for(const auto& cmd : list.commands)
+    {
+        if(cmd.dr_type == draw_type::quads)
+        {
+            max_quads = std::max(max_quads, size_t(cmd.indices_count / 6));
+        }
+    }
+
+    // done here, so drawing the segment does not touch the quad indices
+    reserve_quad_indices(max_quads);
+
+    segment.vao_.bind();
+
+    segment.vbo_.bind();
+    segment.vbo_.reserve(nullptr, vertices_mem_size + compact_vertices_mem_size + instances_mem_size, false);
+    segment.vbo_.update(list.vertices.data(), 0, vertices_mem_size);
+    segment.vbo_.update(list.compact_vertices.data(), vertices_mem_size, compact_vertices_mem_size);
+    segment.vbo_.update(list.instances.data(), vertices_mem_size + compact_vertices_mem_size, instances_mem_size);
+
+    segment.ibo_.bind();
+    segment.ibo_.reserve(list.indices.data(), indices_mem_size, false);
+
+    segment.vao_.unbind();
+    segment.vbo_.unbind();
+    segment.ibo_.unbind();
+
+    // keep only the commands and their side tables
+    segment.list_.clear();
+    segment.list_.add_list(list);
+    segment.list_.vertices = {};
+    segment.list_.compact_vertices = {};
+    segment.list_.instances = {};
+    segment.list_.indices = {};
+
+    segment.compact_vertices_offset_ = vertices_mem_size;
+    segment.instances_offset_ = vertices_mem_size + compact_vertices_mem_size;
+    segment.uploaded_bytes_ = vertices_mem_size + compact_vertices_mem_size + instances_mem_size + indices_mem_size;
+    segment.max_quads_ = max_quads;
+    segment.valid_ = true;
+
+    return true;
+}
+
 /// Create a font
 ///	@param info - description of font
 ///	@return a shared pointer to the font
@@ -772,6 +1284,12 @@ font_ptr renderer::create_font(font_info&& info, bool embedded) const noexcept
         font_info& slice = *r;
         slice = std::move(info);
 
+        // fonts filled by hand may not have compiled their kernings
+        if(slice.kerning_pairs.size() != slice.kernings.size())
+        {
+            slice.compile_kernings();
+        }
+
         r->texture = texture_ptr(new texture(*this, *r->surface));
         if(r->sdf_spread == 0)
         {
@@ -805,6 +1323,11 @@ bool renderer::set_blending_mode(blending_mode mode) const noexcept
         return false;
     }
 
+    if(!gl_state_.change_blending_mode(mode))
+    {
+        return true;
+    }
+
     switch(mode)
     {
         case blending_mode::blend_none:
@@ -873,11 +1396,8 @@ blending_mode renderer::get_apropriate_blend_mode(blending_mode mode, const gpu_
 ///     @param interp_type - interpolation type
 bool renderer::set_texture(texture_view texture, uint32_t id) const noexcept
 {
-    // Activate texture for shader
-    gl_call(glActiveTexture(GL_TEXTURE0 + id));
-
-    // Bind texture to the pipeline, and the currently active texture
-    gl_call(glBindTexture(GL_TEXTURE_2D, texture.id));
+    // Bind texture to the pipeline, and the texture unit
+    gl_state_.bind_texture(id, texture.id);
     return true;
 }
 
@@ -885,8 +1405,7 @@ bool renderer::set_texture(texture_view texture, uint32_t id) const noexcept
 ///     @param id - the texture to reset
 void renderer::reset_texture(uint32_t id) const noexcept
 {
-    gl_call(glActiveTexture(GL_TEXTURE0 + id));
-    gl_call(glBindTexture(GL_TEXTURE_2D, 0));
+    gl_state_.bind_texture(id, 0);
 }
 
 void renderer::set_texture_sampler(texture_view texture, uint32_t id) const noexcept
@@ -894,7 +1413,7 @@ void renderer::set_texture_sampler(texture_view texture, uint32_t id) const noex
     auto sampler = samplers_[size_t(texture.wrap_type)][size_t(texture.interp_type)];
     if(sampler != 0)
     {
-        gl_call(glBindSampler(id, sampler));
+        gl_state_.bind_sampler(id, sampler);
     }
     else
     {
@@ -905,7 +1424,7 @@ void renderer::set_texture_sampler(texture_view texture, uint32_t id) const noex
 void renderer::reset_texture_sampler(uint32_t id) const noexcept
 {
     // Unbind active sampler
-    gl_call(glBindSampler(id, 0));
+    gl_state_.bind_sampler(id, 0);
 }
 
 bool renderer::bind_pixmap(const pixmap& p) const noexcept
@@ -947,16 +1466,13 @@ texture_ptr renderer::blur(const texture_ptr& texture, uint32_t passes)
 
         program_setup setup;
         setup.program = get_program<programs::blur>();
-        setup.begin = [=](const gpu_context& ctx)
-        {
-            ctx.program.shader->set_uniform("uTexture", input);
-            ctx.program.shader->set_uniform("uTextureSize", input_size);
-            ctx.program.shader->set_uniform("uDirection", direction);
-        };
+        setup.set_uniform("uTexture", input);
+        setup.set_uniform("uTextureSize", input_size);
+        setup.set_uniform("uDirection", direction);
 
         list.add_image(input, input->get_rect(), fbo->get_rect(), {}, color::white(), flip_format::none, setup);
 
-        draw_cmd_list(list);
+        draw_cmd_list(list, gpu_pass::blur);
 
         if (!pop_fbo())
         {
@@ -1030,8 +1546,6 @@ bool renderer::push_clip(const rect& rect) const noexcept
         return false;
     }
 
-    gl_call(glEnable(GL_SCISSOR_TEST));
-
     auto mod_clip = rect;
     const auto& transforms = get_transform_stack();
     if (transforms.size() > 1)
@@ -1048,13 +1562,13 @@ bool renderer::push_clip(const rect& rect) const noexcept
     if (fbo_stack_.empty())
     {
         // If we have no fbo_target_ it is a back buffer
-        gl_call(glScissor(mod_clip.x, rect_.h - mod_clip.y - mod_clip.h, mod_clip.w, mod_clip.h));
-    }
-    else
-    {
-        gl_call(glScissor(mod_clip.x, mod_clip.y, mod_clip.w, mod_clip.h));
+        mod_clip.y = get_viewport().h - mod_clip.y - mod_clip.h;
     }
 
+    // applied right before drawing, so consecutive
+    // commands with the same clip do not toggle it
+    scissors_.emplace_back(mod_clip);
+
     return true;
 }
 
@@ -1065,11 +1579,29 @@ bool renderer::pop_clip() const noexcept
         return false;
     }
 
-    gl_call(glDisable(GL_SCISSOR_TEST));
+    if(scissors_.empty())
+    {
+        return false;
+    }
+
+    scissors_.pop_back();
 
     return true;
 }
 
+/// Apply the top clip rect, or disable clipping without one
+void renderer::apply_clip() const noexcept
+{
+    if(scissors_.empty())
+    {
+        gl_state_.set_scissor_test(false);
+        return;
+    }
+
+    gl_state_.set_scissor_test(true);
+    gl_state_.set_scissor(scissors_.back());
+}
+
 /// Set FBO target for drawing
 ///	@param texture - texture to draw to
 ///	@return true on success
@@ -1108,7 +1640,7 @@ bool renderer::pop_fbo()
         return false;
     }
 
-    draw_cmd_list(fbo_stack_.top().list);
+    draw_cmd_list(fbo_stack_.top().list, gpu_pass::fbo);
     fbo_stack_.pop();
 
     if (fbo_stack_.empty())
@@ -1133,7 +1665,7 @@ bool renderer::reset_fbo()
 
     while (!fbo_stack_.empty())
     {
-        draw_cmd_list(fbo_stack_.top().list);
+        draw_cmd_list(fbo_stack_.top().list, gpu_pass::fbo);
         fbo_stack_.pop();
     }
 
@@ -1149,8 +1681,14 @@ bool renderer::is_with_fbo() const
 /// Swap buffers
 void renderer::present() noexcept
 {
-    auto sz = win_.get_size();
-    resize(int(sz.w), int(sz.h));
+    VIDEOPP_PROFILE_FRAME()
+
+    // the offscreen target keeps its size
+    if(win_)
+    {
+        auto sz = win_->get_size();
+        resize(int(sz.w), int(sz.h));
+    }
 
 //    {
 //        const auto& stats = get_stats();
@@ -1171,27 +1709,36 @@ void renderer::present() noexcept
         frame_callbacks_.on_end_frame(*this);
     }
 
-    if(!master_list_.commands_requested)
+    if(render_thread_.joinable())
     {
-        // due to bug in the driver
-        // we must keep it busy
-        draw_cmd_list(dummy_list_);
+        submit_frame();
     }
     else
     {
-        draw_cmd_list(master_list_);
-        master_list_.clear();
-    }
+        if(master_list_.empty())
+        {
+            // due to bug in the driver
+            // we must keep it busy
+            draw_cmd_list(dummy_list_, gpu_pass::master);
+        }
+        else
+        {
+            draw_cmd_list(master_list_, gpu_pass::master);
+            master_list_.clear();
+        }
 
-    last_stats_ = stats_;
-    stats_ = {};
+        stats_.gpu_timings = gpu_timer_.end_frame();
 
-    context_->swap_buffers();
+        last_stats_ = stats_;
+        stats_ = {};
 
-    set_current_context();
-    delete_textures();
-    reset_transform();
-    set_model_view(0, rect_);
+        context_->swap_buffers();
+
+        set_current_context();
+        delete_textures();
+        reset_transform();
+        set_model_view(0, rect_);
+    }
 
     if (frame_callbacks_.on_start_frame)
     {
@@ -1203,8 +1750,8 @@ void renderer::present() noexcept
 ///	@param color - color to clear with
 void renderer::clear(const color& color) const noexcept
 {
-    set_current_context();
-
+    // only recorded, so it must not take the context back from the
+    // render thread and wait for the frame in flight
     if (fbo_stack_.empty())
     {
         master_list_.push_blend(blending_mode::blend_none);
@@ -1219,6 +1766,71 @@ void renderer::clear(const color& color) const noexcept
     fbo_info.list.pop_blend();
 }
 
+/// Upload the crop rects of a command, transformed into window space
+///	@param program - the program to upload to
+///	@param crop - the crop set of the command
+void renderer::set_crop_rects(const gpu_program& program, const draw_list::crop_area_t& crop) const noexcept
+{
+    if(!program.shader->has_uniform(builtin_uniform::rects))
+    {
+        return;
+    }
+
+    // reuse the scratch storage to avoid allocations per command
+    auto& rects = crop_rects_;
+    rects = crop;
+
+    if (!is_with_fbo())
+    {
+        for (auto& area : rects)
+        {
+            area.y = get_rect().h - (area.y + area.h);
+        }
+    }
+
+    auto transform = get_transform();
+    const auto& scale = transform.get_scale();
+    const auto& pos = transform.get_position();
+    for (auto& area : rects)
+    {
+        area.x = int(float(area.x) * scale.x + pos.x);
+        area.y = int(float(area.y) * scale.y + pos.y);
+        area.w = int(float(area.w) * scale.x);
+        area.h = int(float(area.h) * scale.y);
+    }
+
+    program.shader->set_uniform(builtin_uniform::rects, rects);
+    program.shader->set_uniform(builtin_uniform::rects_count, int(rects.size()));
+}
+
+/// Upload plain data uniforms
+///	@param program - the program to upload to
+///	@param uniforms - the uniform values
+void renderer::set_uniforms(const gpu_program& program, const std::vector<uniform_value>& uniforms) const noexcept
+{
+    for(const auto& uniform : uniforms)
+    {
+        switch(uniform.type)
+        {
+            case uniform_value::value_type::int1:
+                program.shader->set_uniform(uniform.name, int(uniform.data.x));
+            break;
+            case uniform_value::value_type::float1:
+                program.shader->set_uniform(uniform.name, uniform.data.x);
+            break;
+            case uniform_value::value_type::vec2:
+                program.shader->set_uniform(uniform.name, math::vec2(uniform.data.x, uniform.data.y));
+            break;
+            case uniform_value::value_type::vec4:
+                program.shader->set_uniform(uniform.name, uniform.data);
+            break;
+            case uniform_value::value_type::texture:
+                program.shader->set_uniform(uniform.name, uniform.tex, uniform.slot);
+            break;
+        }
+    }
+}
+
 constexpr uint16_t get_index_type()
 {
     if(sizeof(draw_list::index_t) == sizeof(uint32_t))
@@ -1228,10 +1840,59 @@ constexpr uint16_t get_index_type()
 
     return GL_UNSIGNED_SHORT;
 }
+/// Grow the shared quad index buffer
+///	@param quads - number of quads the buffer should be able to draw
+void renderer::reserve_quad_indices(size_t quads) const noexcept
+{
+    if(quads <= quad_ibo_quads_)
+    {
+        return;
+    }
+
+    // every quad command addresses its own vertex window
+    assert(quads <= draw_list::max_window_vertices / 4 && "quad command exceeds the vertex window");
+    auto capacity = std::min(std::max(quad_ibo_quads_ * 2, quads), draw_list::max_window_vertices / 4);
+
+    std::vector<draw_list::index_t> indices(capacity * 6);
+    for(size_t q = 0; q < capacity; ++q)
+    {
+        const auto v = static_cast<draw_list::index_t>(q * 4);
+        auto* dst = indices.data() + q * 6;
+        dst[0] = v;
+        dst[1] = v + 1;
+        dst[2] = v + 2;
+        dst[3] = v;
+        dst[4] = v + 2;
+        dst[5] = v + 3;
+    }
+
+    quad_ibo_.bind();
+    quad_ibo_.reserve(indices.data(), indices.size() * sizeof(draw_list::index_t), false);
+    quad_ibo_.unbind();
+
+    quad_ibo_quads_ = capacity;
+}
+
+/// Collect the list and the lists it references in drawing order
+///	@param list - list to collect
+void renderer::gather_segments(const draw_list& list) const
+{
+    segments_.emplace_back();
+    segments_.back().list = &list;
+
+    for(const auto& sub_list : list.sub_lists)
+    {
+        gather_segments(*sub_list);
+    }
+}
+
 /// Render a draw list
 ///	@param list - list to draw
 ///	@return true on success
-bool renderer::draw_cmd_list(const draw_list& list) const noexcept
+/// Draw a list into the bound target
+///	@param list - the list to draw
+///	@param pass - the kind of target, used to label the gpu timings
+bool renderer::draw_cmd_list(const draw_list& list, gpu_pass pass) const noexcept
 {
     if (list.empty())
     {
@@ -1243,181 +1904,785 @@ bool renderer::draw_cmd_list(const draw_list& list) const noexcept
         return false;
     }
 
-    stats_.record(list);
-
     list.validate_stacks();
 
-//    EGT_BLOCK_PROFILING("renderer::draw_cmd_list - %d commands", int(list.commands.size()))
+    VIDEOPP_PROFILE_ZONE("renderer::draw_cmd_list", int(list.commands.size()))
+
+    // the state may have been changed outside the renderer (e.g. texture uploads)
+    gl_state_.invalidate();
+
+    gpu_timer_.begin_pass(pass);
+
+    // Referenced lists are not copied into the list, their
+    // streams are uploaded next to it and drawn with offsets
+    segments_.clear();
+    gather_segments(list);
 
     const auto vtx_stride = sizeof(decltype(list.vertices)::value_type);
-    const auto vertices_mem_size = list.vertices.size() * vtx_stride;
+    const auto compact_vtx_stride = sizeof(decltype(list.compact_vertices)::value_type);
+    const auto instance_stride = sizeof(decltype(list.instances)::value_type);
     const auto idx_stride = sizeof(decltype(list.indices)::value_type);
-    const auto indices_mem_size = list.indices.size() * idx_stride;
+
+    size_t vertices_mem_size = 0;
+    size_t indices_mem_size = 0;
+    size_t max_quads = 0;
+    for(auto& segment : segments_)
+    {
+        const auto& seg_list = *segment.list;
+        stats_.record(seg_list);
+
+        segment.vertices_offset = vertices_mem_size;
+        vertices_mem_size += seg_list.vertices.size() * vtx_stride;
+        // the compact stream follows the full one
+        segment.compact_vertices_offset = vertices_mem_size;
+        vertices_mem_size += seg_list.compact_vertices.size() * compact_vtx_stride;
+        // followed by the sprite instances
+        segment.instances_offset = vertices_mem_size;
+        vertices_mem_size += seg_list.instances.size() * instance_stride;
+        segment.indices_offset = indices_mem_size;
+        indices_mem_size += seg_list.indices.size() * idx_stride;
+
+        for(const auto& cmd : seg_list.commands)
+        {
+            if(cmd.dr_type == draw_type::quads)
+            {
+                max_quads = std::max(max_quads, size_t(cmd.indices_count / 6));
+            }
+        }
+    }
+
+    auto& vao = stream_vaos_[current_vao_idx_];
+    current_vao_idx_ = (current_vao_idx_ + 1) % stream_vaos_.size();
+
+    reserve_quad_indices(max_quads);
+
+    // Bind the vertex array object
+    gl_state_.bind_vertex_array(vao);
+
+    // Fingerprint the finished streams. Vertices are still rewritten after
+    // they are recorded, so they cannot be hashed while recording.
+    using clock = std::chrono::steady_clock;
+    auto fingerprint_start = clock::now();
+    uint64_t fingerprint = 0;
+    for(const auto& segment : segments_)
+    {
+        const auto& seg_list = *segment.list;
+        fingerprint = utils::hash_bytes(seg_list.vertices.data(), seg_list.vertices.size() * vtx_stride, fingerprint);
+        fingerprint = utils::hash_bytes(seg_list.compact_vertices.data(), seg_list.compact_vertices.size() * compact_vtx_stride, fingerprint);
+        fingerprint = utils::hash_bytes(seg_list.instances.data(), seg_list.instances.size() * instance_stride, fingerprint);
+        fingerprint = utils::hash_bytes(seg_list.indices.data(), seg_list.indices.size() * idx_stride, fingerprint);
+        fingerprint = utils::hash_bytes(seg_list.commands.data(), seg_list.commands.size() * sizeof(draw_cmd), fingerprint);
+    }
+    const bool unchanged = is_last_upload(fingerprint, vertices_mem_size, indices_mem_size);
+    stats_.fingerprint_time += clock::now() - fingerprint_start;
+
+    const vertex_buffer* vbo = nullptr;
+    const index_buffer* ibo = nullptr;
+    const bool ring = get_draw_config().persistent_buffers &&
+                      stream_to_rings(vbo, ibo, vertices_mem_size, indices_mem_size, unchanged);
+    if(!ring)
+    {
+        stream_to_buffers(vbo, ibo, vertices_mem_size, indices_mem_size, unchanged);
+    }
+    last_upload_.fingerprint = fingerprint;
+
+    {
+        draw_state state{vao, *vbo, *ibo};
+        set_blending_mode(state.last_blend);
+
+        size_t segment_idx = 0;
+        draw_segment(segment_idx, state);
+
+        set_blending_mode(blending_mode::blend_none);
+    }
+
+    if(ring)
+    {
+        // the regions are reused once the gpu is done with these draws
+        stream_vertex_ring_.fence();
+        stream_index_ring_.fence();
+        stats_.vertex_ring_high_water_mark = stream_vertex_ring_.get_high_water_mark();
+        stats_.index_ring_high_water_mark = stream_index_ring_.get_high_water_mark();
+    }
+
+    // leave a clean state for the code outside the renderer
+    gl_state_.reset();
+    stats_.redundant_gl_calls += gl_state_.get_redundant_calls();
+    gl_state_.reset_redundant_calls();
+
+    vbo->unbind();
+    ibo->unbind();
+
+    vao.unbind();
+    gl_state_.invalidate();
+
+    gpu_timer_.end_pass();
+
+    if(list.debug)
+    {
+        draw_cmd_list(*list.debug, pass);
+    }
+
+    return true;
+}
+
+/// Whether the gathered segments hold the same streams as the last upload.
+/// A fingerprint match is confirmed against the cpu copies of the streams.
+///	@param fingerprint - fingerprint of the gathered streams
+///	@param vertices_mem_size - bytes of all vertices
+///	@param indices_mem_size - bytes of all indices
+bool renderer::is_last_upload(uint64_t fingerprint, size_t vertices_mem_size, size_t indices_mem_size) const noexcept
+{
+    if(!last_upload_.valid ||
+       last_upload_.fingerprint != fingerprint ||
+       last_upload_.vertices_size != vertices_mem_size ||
+       last_upload_.indices_size != indices_mem_size)
+    {
+        return false;
+    }
+
+    const auto vtx_stride = sizeof(decltype(draw_list::vertices)::value_type);
+    const auto compact_vtx_stride = sizeof(decltype(draw_list::compact_vertices)::value_type);
+    const auto instance_stride = sizeof(decltype(draw_list::instances)::value_type);
+    const auto idx_stride = sizeof(decltype(draw_list::indices)::value_type);
+
+    const auto equal = [](const uint8_t* last, const void* data, size_t size)
+    {
+        return size == 0 || std::memcmp(last, data, size) == 0;
+    };
+
+    for(const auto& segment : segments_)
+    {
+        const auto& seg_list = *segment.list;
+        if(!equal(last_vertices_.data() + segment.vertices_offset, seg_list.vertices.data(),
+                  seg_list.vertices.size() * vtx_stride) ||
+           !equal(last_vertices_.data() + segment.compact_vertices_offset, seg_list.compact_vertices.data(),
+                  seg_list.compact_vertices.size() * compact_vtx_stride) ||
+           !equal(last_vertices_.data() + segment.instances_offset, seg_list.instances.data(),
+                  seg_list.instances.size() * instance_stride) ||
+           !equal(last_indices_.data() + segment.indices_offset, seg_list.indices.data(),
+                  seg_list.indices.size() * idx_stride))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// Copy the streams of the gathered segments at their offsets
+///	@param vertices_dst - memory for all vertices
+///	@param indices_dst - memory for all indices
+void renderer::copy_streams(uint8_t* vertices_dst, uint8_t* indices_dst) const noexcept
+{
+    const auto vtx_stride = sizeof(decltype(draw_list::vertices)::value_type);
+    const auto compact_vtx_stride = sizeof(decltype(draw_list::compact_vertices)::value_type);
+    const auto instance_stride = sizeof(decltype(draw_list::instances)::value_type);
+    const auto idx_stride = sizeof(decltype(draw_list::indices)::value_type);
+
+    for(const auto& segment : segments_)
+    {
+        const auto& seg_list = *segment.list;
+        if(!seg_list.vertices.empty())
+        {
+            std::memcpy(vertices_dst + segment.vertices_offset, seg_list.vertices.data(),
+                        seg_list.vertices.size() * vtx_stride);
+        }
+        if(!seg_list.compact_vertices.empty())
+        {
+            std::memcpy(vertices_dst + segment.compact_vertices_offset, seg_list.compact_vertices.data(),
+                        seg_list.compact_vertices.size() * compact_vtx_stride);
+        }
+        if(!seg_list.instances.empty())
+        {
+            std::memcpy(vertices_dst + segment.instances_offset, seg_list.instances.data(),
+                        seg_list.instances.size() * instance_stride);
+        }
+        if(!seg_list.indices.empty())
+        {
+            std::memcpy(indices_dst + segment.indices_offset, seg_list.indices.data(),
+                        seg_list.indices.size() * idx_stride);
+        }
+    }
+}
+
+/// Upload the streams of the gathered segments into the rotating stream buffers
+///	@param out_vbo - the vertex buffer holding the vertices
+///	@param out_ibo - the index buffer holding the indices
+///	@param vertices_mem_size - bytes of all vertices
+///	@param indices_mem_size - bytes of all indices
+///	@param unchanged - the streams are the same as the last uploaded ones
+void renderer::stream_to_buffers(const vertex_buffer*& out_vbo, const index_buffer*& out_ibo,
+                                 size_t vertices_mem_size, size_t indices_mem_size, bool unchanged) const noexcept
+{
+    if(unchanged && !last_upload_.ring)
+    {
+        // the last written buffers still hold the streams,
+        // the rotation has not come back to them yet
+        out_vbo = last_upload_.vbo;
+        out_ibo = last_upload_.ibo;
+        gl_state_.bind_vertex_buffer(*out_vbo);
+        out_ibo->bind();
+
+        stats_.skipped_upload_bytes += vertices_mem_size + indices_mem_size;
+        stats_.skipped_uploads++;
+        return;
+    }
+
+    const auto vtx_stride = sizeof(decltype(draw_list::vertices)::value_type);
+    const auto compact_vtx_stride = sizeof(decltype(draw_list::compact_vertices)::value_type);
+    const auto instance_stride = sizeof(decltype(draw_list::instances)::value_type);
+    const auto idx_stride = sizeof(decltype(draw_list::indices)::value_type);
 
     // We are using several stream buffers to avoid syncs caused by
     // uploading new data while the old one is still processing
-    auto& vao = stream_vaos_[current_vao_idx_];
     auto& vbo = stream_vbos_[current_vbo_idx_];
     auto& ibo = stream_ibos_[current_ibo_idx_];
+    out_vbo = &vbo;
+    out_ibo = &ibo;
 
-    current_vao_idx_ = (current_vao_idx_ + 1) % stream_vaos_.size();
     current_vbo_idx_ = (current_vbo_idx_ + 1) % stream_vbos_.size();
     current_ibo_idx_ = (current_ibo_idx_ + 1) % stream_ibos_.size();
 
 
     bool mapped = get_draw_config().mapped_buffers;
     {
-//        EGT_BLOCK_PROFILING("draw_cmd_list::vao/vbo/ibo")
+        VIDEOPP_PROFILE_ZONE("draw_cmd_list::vao/vbo/ibo")
 
-        // Bind the vertex array object
-        vao.bind();
+        using clock = std::chrono::steady_clock;
+        auto upload_start = clock::now();
 
         // Bind the vertex buffer
-        vbo.bind();
+        gl_state_.bind_vertex_buffer(vbo);
 
         // Upload vertices to VRAM
-        if (!vbo.update(list.vertices.data(), 0, vertices_mem_size, mapped))
+        const auto upload_vertices = [&]()
+        {
+            for(const auto& segment : segments_)
+            {
+                const auto& seg_list = *segment.list;
+                if(!seg_list.vertices.empty() &&
+                   !vbo.update(seg_list.vertices.data(), segment.vertices_offset,
+                               seg_list.vertices.size() * vtx_stride, mapped))
+                {
+                    return false;
+                }
+                if(!seg_list.compact_vertices.empty() &&
+                   !vbo.update(seg_list.compact_vertices.data(), segment.compact_vertices_offset,
+                               seg_list.compact_vertices.size() * compact_vtx_stride, mapped))
+                {
+                    return false;
+                }
+                if(!seg_list.instances.empty() &&
+                   !vbo.update(seg_list.instances.data(), segment.instances_offset,
+                               seg_list.instances.size() * instance_stride, mapped))
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        if (!upload_vertices())
         {
             // We're out of vertex budget. Allocate a new vertex buffer
-            vbo.reserve(list.vertices.data(), vertices_mem_size, true);
+            vbo.reserve(nullptr, vertices_mem_size, true);
+            upload_vertices();
         }
+        stats_.uploaded_bytes += vertices_mem_size;
 
         // Bind the index buffer
         ibo.bind();
 
-        // Upload indices to VRAM
-        if (!ibo.update(list.indices.data(), 0, indices_mem_size, mapped))
+        // Upload indices to VRAM. Quads use the shared quad indices.
+        const auto upload_indices = [&]()
+        {
+            for(const auto& segment : segments_)
+            {
+                const auto& seg_list = *segment.list;
+                if(!seg_list.indices.empty() &&
+                   !ibo.update(seg_list.indices.data(), segment.indices_offset,
+                               seg_list.indices.size() * idx_stride, mapped))
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        if (!upload_indices())
         {
             // We're out of index budget. Allocate a new index buffer
-            ibo.reserve(list.indices.data(), indices_mem_size, true);
+            ibo.reserve(nullptr, indices_mem_size, true);
+            upload_indices();
+        }
+        stats_.uploaded_bytes += indices_mem_size;
+
+        // keep a copy to compare the next streams against
+        last_vertices_.resize(vertices_mem_size);
+        last_indices_.resize(indices_mem_size);
+        copy_streams(last_vertices_.data(), last_indices_.data());
+
+        stats_.upload_time += clock::now() - upload_start;
+    }
+
+    last_upload_.vertices_size = vertices_mem_size;
+    last_upload_.indices_size = indices_mem_size;
+    last_upload_.vbo = &vbo;
+    last_upload_.ibo = &ibo;
+    last_upload_.ring = false;
+    last_upload_.valid = true;
+}
+
+/// Write the streams of the gathered segments straight into the persistently mapped rings
+///	@param out_vbo - the vertex buffer holding the vertices
+///	@param out_ibo - the index buffer holding the indices
+///	@param vertices_mem_size - bytes of all vertices
+///	@param indices_mem_size - bytes of all indices
+///	@param unchanged - the streams are the same as the last uploaded ones
+///	@return false if the rings are not available
+bool renderer::stream_to_rings(const vertex_buffer*& out_vbo, const index_buffer*& out_ibo,
+                               size_t vertices_mem_size, size_t indices_mem_size, bool unchanged) const noexcept
+{
+    if(!stream_vertex_ring_ || !stream_index_ring_)
+    {
+        return false;
+    }
+
+    size_t vertices_base = 0;
+    size_t indices_base = 0;
+
+    // Draw again from the regions written last time, unless they
+    // were reclaimed in the meantime or the rings have grown since.
+    const bool reuse = unchanged && last_upload_.ring &&
+                       stream_vertex_ring_.retain(last_upload_.vertices_base, vertices_mem_size) &&
+                       stream_index_ring_.retain(last_upload_.indices_base, indices_mem_size);
+    if(reuse)
+    {
+        vertices_base = last_upload_.vertices_base;
+        indices_base = last_upload_.indices_base;
+
+        stats_.skipped_upload_bytes += vertices_mem_size + indices_mem_size;
+        stats_.skipped_uploads++;
+    }
+    else
+    {
+        using clock = std::chrono::steady_clock;
+        auto upload_start = clock::now();
+
+        auto* vertices_dst = stream_vertex_ring_.allocate(vertices_mem_size, vertices_base);
+        auto* indices_dst = stream_index_ring_.allocate(indices_mem_size, indices_base);
+        if(!vertices_dst || !indices_dst)
+        {
+            return false;
         }
+
+        copy_streams(vertices_dst, indices_dst);
+
+        // keep a copy to compare the next streams against
+        last_vertices_.resize(vertices_mem_size);
+        last_indices_.resize(indices_mem_size);
+        copy_streams(last_vertices_.data(), last_indices_.data());
+
+        stats_.uploaded_bytes += vertices_mem_size + indices_mem_size;
+        stats_.upload_time += clock::now() - upload_start;
+
+        last_upload_.vertices_size = vertices_mem_size;
+        last_upload_.indices_size = indices_mem_size;
+        last_upload_.vertices_base = vertices_base;
+        last_upload_.indices_base = indices_base;
+        last_upload_.ring = true;
+        last_upload_.valid = true;
+    }
+
+    for(auto& segment : segments_)
+    {
+        segment.vertices_offset += vertices_base;
+        segment.compact_vertices_offset += vertices_base;
+        segment.instances_offset += vertices_base;
+        segment.indices_offset += indices_base;
     }
 
+    out_vbo = &stream_vertex_ring_.get_buffer();
+    out_ibo = &stream_index_ring_.get_buffer();
+    last_upload_.vbo = out_vbo;
+    last_upload_.ibo = out_ibo;
+    gl_state_.bind_vertex_buffer(*out_vbo);
+    out_ibo->bind();
+
+    return true;
+}
 
+/// Draw the commands of a segment and the segments it references
+///	@param segment_idx - index of the segment to draw, advanced past its references
+///	@param state - state shared by all segments
+void renderer::draw_segment(size_t& segment_idx, draw_state& state) const noexcept
+{
+    const auto& segment = segments_[segment_idx++];
+    const auto& list = *segment.list;
+    size_t sub_list_idx = 0;
 
+    // Draw commands
+    for (size_t i = 0; i < list.commands.size(); ++i)
     {
-        blending_mode last_blend{blending_mode::blend_none};
-        set_blending_mode(last_blend);
+        VIDEOPP_PROFILE_ZONE("draw_cmd_list::cmd")
 
-        // Draw commands
-        for (const auto& cmd : list.commands)
+        const auto& cmd = list.commands[i];
+        if(is_reference(cmd.dr_type))
         {
-//            EGT_BLOCK_PROFILING("draw_cmd_list::cmd")
+            if(cmd.clip_idx >= 0)
+            {
+                push_clip(list.clip_sets[size_t(cmd.clip_idx)]);
+            }
 
+            if(cmd.transform_idx >= 0)
             {
-                if(cmd.setup.program.shader)
-                {
-//                    EGT_BLOCK_PROFILING("draw_cmd_list::shader.enable")
+                push_transform(list.gpu_transforms[size_t(cmd.transform_idx)]);
+            }
 
-                    cmd.setup.program.shader->enable();
-                }
+            if(cmd.dr_type == draw_type::sub_list)
+            {
+                // the segments were gathered in the same order
+                assert(cmd.vertices_offset == sub_list_idx && "sub list references are out of order");
+                sub_list_idx++;
 
-                if (cmd.clip_rect)
-                {
-                    push_clip(cmd.clip_rect);
-                }
+                draw_segment(segment_idx, state);
+            }
+            else
+            {
+                const auto& ref = list.static_segments[cmd.vertices_offset];
+                draw_static_segment(*ref.segment, ref.multiplier, state);
+            }
 
-                if(cmd.setup.begin)
-                {
-//                    EGT_BLOCK_PROFILING("draw_cmd_list::cmd.setup.begin")
+            if(cmd.transform_idx >= 0)
+            {
+                pop_transform();
+            }
 
-                    cmd.setup.begin(gpu_context{cmd, *this, cmd.setup.program});
-                }
+            if(cmd.clip_idx >= 0)
+            {
+                pop_clip();
+            }
+            continue;
+        }
 
-                if(cmd.setup.program.shader && cmd.setup.program.shader->has_uniform("uProjection"))
-                {
-                    const auto& projection = current_ortho_ * get_transform_stack().top();
-                    cmd.setup.program.shader->set_uniform("uProjection", projection);
-                }
+        const auto count = get_multi_draw_count(list, i);
+        draw_command(list, cmd, count, segment, state);
+        i += count - 1;
+    }
+}
 
-                if (cmd.blend != last_blend)
-                {
-                    auto mode = get_apropriate_blend_mode(cmd.blend, cmd.setup.program);
-                    set_blending_mode(mode);
-                    last_blend = mode;
-                }
+/// Draw a static segment from its own gpu buffers
+///	@param segment - segment to draw
+///	@param multiplier - color multiplier applied to the whole segment
+///	@param state - state shared by all segments
+void renderer::draw_static_segment(const static_segment& segment, const color& multiplier,
+                                   draw_state& state) const noexcept
+{
+    if(!segment.is_valid())
+    {
+        return;
+    }
+
+    const auto& list = segment.list_;
+
+    draw_segment_info info{};
+    info.list = &list;
+    info.compact_vertices_offset = segment.compact_vertices_offset_;
+    info.instances_offset = segment.instances_offset_;
+
+    draw_state segment_state{segment.vao_, segment.vbo_, segment.ibo_};
+    segment_state.last_blend = state.last_blend;
+    segment_state.multiplier = multiplier;
+
+    gl_state_.bind_vertex_array(segment.vao_);
+    gl_state_.bind_vertex_buffer(segment.vbo_);
+    segment.ibo_.bind();
+
+    for(size_t i = 0; i < list.commands.size(); ++i)
+    {
+        const auto count = get_multi_draw_count(list, i);
+        draw_command(list, list.commands[i], count, info, segment_state);
+        i += count - 1;
+    }
+
+    state.last_blend = segment_state.last_blend;
+
+    // back to the stream buffers
+    gl_state_.bind_vertex_array(state.vao);
+    gl_state_.bind_vertex_buffer(state.vbo);
+    state.ibo.bind();
+    state.bound_ibo = &state.ibo;
+
+    stats_.static_segments++;
+    stats_.static_segment_calls += list.commands.size();
+    stats_.static_bytes_saved += segment.get_uploaded_bytes();
+}
+
+/// Draw a command, together with the state identical commands following it
+///	@param list - list owning the command
+///	@param cmd - first command to draw
+///	@param count - number of consecutive commands to draw, see can_be_multi_drawn
+///	@param segment - stream offsets of the list
+///	@param state - state shared by all segments
+void renderer::draw_command(const draw_list& list, const draw_cmd& cmd, size_t count,
+                            const draw_segment_info& segment, draw_state& state) const noexcept
+{
+    const auto idx_stride = sizeof(decltype(list.indices)::value_type);
+
+    const auto& program = cmd.program;
+    const program_setup* setup = nullptr;
+    if(cmd.setup_idx >= 0)
+    {
+        setup = &list.setups[size_t(cmd.setup_idx)];
+    }
+
+    size_t stream_offset = segment.vertices_offset;
+    if(cmd.format == vertex_format::compact)
+    {
+        stream_offset = segment.compact_vertices_offset;
+    }
+    else if(cmd.format == vertex_format::instance)
+    {
+        // there is no base instance before GL 4.2, so the
+        // attributes start at the first instance instead
+        stream_offset = segment.instances_offset + cmd.vertices_offset * sizeof(sprite_instance);
+    }
+
+    // multi drawn commands are timed together, under the index of the first one
+    gpu_timer_.begin_command(size_t(&cmd - list.commands.data()));
+
+    {
+        if(program.shader)
+        {
+            VIDEOPP_PROFILE_ZONE("draw_cmd_list::shader.enable")
+
+            program.shader->enable(cmd.format, stream_offset);
+        }
+
+        if(cmd.clip_idx >= 0)
+        {
+            push_clip(list.clip_sets[size_t(cmd.clip_idx)]);
+        }
+
+        if(cmd.transform_idx >= 0)
+        {
+            auto transform = list.gpu_transforms[size_t(cmd.transform_idx)];
+            if(cmd.pixel_snap)
+            {
+                auto pos = transform.get_position();
+                transform.set_position(float(int(pos.x)), pos.y, 0);
             }
 
-            switch(cmd.dr_type)
+            push_transform(transform);
+        }
+
+        if(program.shader)
+        {
+            if(cmd.crop_idx >= 0)
             {
-                case draw_type::elements:
-                {
-//                    EGT_BLOCK_PROFILING("draw_cmd_list::glDrawElements - %d indices", int(cmd.indices_count))
+                set_crop_rects(program, list.crop_sets[size_t(cmd.crop_idx)]);
+            }
 
-                    gl_call(glDrawElements(to_gl_primitive(cmd.type), GLsizei(cmd.indices_count), get_index_type(),
-                                           reinterpret_cast<const GLvoid*>(uintptr_t(cmd.indices_offset * idx_stride))));
-                }
-                break;
+            if(program.shader->has_uniform(builtin_uniform::textures))
+            {
+                program.shader->set_uniform(builtin_uniform::textures, list.texture_slots.data() + cmd.slots_offset, cmd.used_slots);
+            }
 
-                case draw_type::array:
-                {
-//                    EGT_BLOCK_PROFILING("draw_cmd_list::glDrawArrays")
+            if(setup)
+            {
+                set_uniforms(program, setup->uniforms);
+            }
+        }
 
-                    gl_call(glDrawArrays(to_gl_primitive(cmd.type), GLint(cmd.vertices_offset), GLsizei(cmd.vertices_count)));
-                }
+        if(setup && setup->begin)
+        {
+            VIDEOPP_PROFILE_ZONE("draw_cmd_list::cmd.setup.begin")
+
+            setup->begin(gpu_context{cmd, *this, program});
+        }
+
+        if(program.shader && program.shader->has_uniform(builtin_uniform::projection))
+        {
+            const auto& projection = current_ortho_ * get_transform_stack().top();
+            program.shader->set_uniform(builtin_uniform::projection, projection);
+        }
+
+        if(program.shader && program.shader->has_uniform(builtin_uniform::color_multiplier))
+        {
+            program.shader->set_uniform(builtin_uniform::color_multiplier, state.multiplier);
+        }
+
+        if (cmd.blend != state.last_blend)
+        {
+            auto mode = get_apropriate_blend_mode(cmd.blend, program);
+            set_blending_mode(mode);
+            state.last_blend = mode;
+        }
+    }
+
+    apply_clip();
+
+    switch(cmd.dr_type)
+    {
+        case draw_type::elements:
+        {
+            VIDEOPP_PROFILE_ZONE("draw_cmd_list::glDrawElements", int(cmd.indices_count))
+
+            if(state.bound_ibo != &state.ibo)
+            {
+                state.ibo.bind();
+                state.bound_ibo = &state.ibo;
+            }
+
+            if(count > 1)
+            {
+                multi_draw_elements(&cmd, count, segment.indices_offset);
                 break;
+            }
+
+            draw_elements_base_vertex(gl_state_, program, cmd.format, stream_offset,
+                                      to_gl_primitive(cmd.type), GLsizei(cmd.indices_count), get_index_type(),
+                                      uintptr_t(segment.indices_offset + cmd.indices_offset * idx_stride),
+                                      cmd.vertices_offset);
+        }
+        break;
+
+        case draw_type::quads:
+        {
+            VIDEOPP_PROFILE_ZONE("draw_cmd_list::glDrawElements(quads)", int(cmd.indices_count))
 
-                default:
+            if(state.bound_ibo != &quad_ibo_)
+            {
+                quad_ibo_.bind();
+                state.bound_ibo = &quad_ibo_;
+            }
+
+            if(count > 1)
+            {
+                multi_draw_elements(&cmd, count, 0);
                 break;
             }
 
+            // the shared quad indices start from vertex 0
+            draw_elements_base_vertex(gl_state_, program, cmd.format, stream_offset,
+                                      to_gl_primitive(cmd.type), GLsizei(cmd.indices_count), get_index_type(),
+                                      0, cmd.vertices_offset);
+        }
+        break;
 
+        case draw_type::instanced:
+        {
+            VIDEOPP_PROFILE_ZONE("draw_cmd_list::glDrawElementsInstanced", int(cmd.vertices_count))
+
+            if(state.bound_ibo != &quad_ibo_)
             {
+                quad_ibo_.bind();
+                state.bound_ibo = &quad_ibo_;
+            }
 
-                if (cmd.setup.end)
-                {
-//                    EGT_BLOCK_PROFILING("draw_cmd_list::cmd.setup.end")
+            // the first quad of the shared quad indices is the unit quad
+            gl_call(glDrawElementsInstanced(GL_TRIANGLES, GLsizei(cmd.indices_count), get_index_type(),
+                                            nullptr, GLsizei(cmd.vertices_count)));
+        }
+        break;
 
-                    cmd.setup.end(gpu_context{cmd, *this, cmd.setup.program});
-                }
+        case draw_type::array:
+        {
+            VIDEOPP_PROFILE_ZONE("draw_cmd_list::glDrawArrays")
 
-                if (cmd.clip_rect)
-                {
-                    pop_clip();
-                }
+            gl_call(glDrawArrays(to_gl_primitive(cmd.type), GLint(cmd.vertices_offset), GLsizei(cmd.vertices_count)));
+        }
+        break;
 
-                if(cmd.setup.program.shader)
-                {
-//                    EGT_BLOCK_PROFILING("draw_cmd_list::shader.disable")
+        default:
+        break;
+    }
 
-                    cmd.setup.program.shader->disable();
-                }
-            }
+
+    {
+
+        if (setup && setup->end)
+        {
+            VIDEOPP_PROFILE_ZONE("draw_cmd_list::cmd.setup.end")
+
+            setup->end(gpu_context{cmd, *this, program});
         }
 
-        set_blending_mode(blending_mode::blend_none);
+        if(cmd.transform_idx >= 0)
+        {
+            pop_transform();
+        }
+
+        if(cmd.clip_idx >= 0)
+        {
+            pop_clip();
+        }
+
+        if(program.shader)
+        {
+            VIDEOPP_PROFILE_ZONE("draw_cmd_list::shader.disable")
+
+            program.shader->disable();
+        }
     }
 
-    vbo.unbind();
-    ibo.unbind();
+    gpu_timer_.end_command();
+}
+
+/// Submit consecutive state identical commands with a single call
+///	@param cmds - commands to draw
+///	@param count - number of commands
+///	@param indices_offset - byte offset of the list's indices in the bound index buffer
+void renderer::multi_draw_elements(const draw_cmd* cmds, size_t count, size_t indices_offset) const noexcept
+{
+    VIDEOPP_PROFILE_ZONE("draw_cmd_list::glMultiDrawElementsBaseVertex", int(count))
 
-    vao.unbind();
+    const auto idx_stride = sizeof(draw_list::index_t);
 
-    if(list.debug)
+    multi_draw_counts_.resize(count);
+    multi_draw_indices_.resize(count);
+    multi_draw_base_vertices_.resize(count);
+    for(size_t i = 0; i < count; ++i)
     {
-        draw_cmd_list(*list.debug);
+        const auto& cmd = cmds[i];
+        // the shared quad indices start from vertex 0
+        const size_t offset = cmd.dr_type == draw_type::quads ? 0 : indices_offset + cmd.indices_offset * idx_stride;
+
+        multi_draw_counts_[i] = GLsizei(cmd.indices_count);
+        multi_draw_indices_[i] = reinterpret_cast<const GLvoid*>(offset);
+        multi_draw_base_vertices_[i] = GLint(cmd.vertices_offset);
     }
 
-    return true;
+    gl_call(glMultiDrawElementsBaseVertex(to_gl_primitive(cmds[0].type), multi_draw_counts_.data(), get_index_type(),
+                                          multi_draw_indices_.data(), GLsizei(count),
+                                          multi_draw_base_vertices_.data()));
+
+    stats_.multi_draws++;
+    stats_.multi_drawn_calls += count;
 }
 
 /// Enable vertical synchronization to avoid tearing
 ///     @return true on success
 bool renderer::enable_vsync() noexcept
 {
-    return context_->set_vsync(true);
+    return set_vsync(true);
 }
 
 /// Disable vertical synchronization
 ///     @return true on success
 bool renderer::disable_vsync() noexcept
 {
-    return context_->set_vsync(false);
+    return set_vsync(false);
 }
 
 
 bool renderer::set_vsync(bool vsync) noexcept
 {
+    if(!set_current_context())
+    {
+        return false;
+    }
     return context_->set_vsync(vsync);
 }
 
@@ -1425,16 +2690,19 @@ bool renderer::set_vsync(bool vsync) noexcept
 ///     @return the currently used rect
 const rect& renderer::get_rect() const
 {
+    // each thread transforms into its own rect
+    auto& transformed_rect = is_render_thread() ? render_transformed_rect_ : transformed_rect_;
     if (fbo_stack_.empty())
     {
+        const auto& viewport = get_viewport();
         const auto& transforms = get_transform_stack();
         if (transforms.size() > 1) // skip identity matrix
         {
-            transformed_rect_ = inverse_and_tranfrom_rect(rect_, math::transformf{transforms.top()});
-            return transformed_rect_;
+            transformed_rect = inverse_and_tranfrom_rect(viewport, math::transformf{transforms.top()});
+            return transformed_rect;
         }
 
-        return rect_;
+        return viewport;
     }
 
     const auto& top_stack = fbo_stack_.top();
@@ -1443,8 +2711,8 @@ const rect& renderer::get_rect() const
     if (transforms.size() > 1) // skip identity matrix
     {
         const auto& rect = fbo->get_rect();
-        transformed_rect_ = inverse_and_tranfrom_rect(rect, math::transformf{transforms.top()});
-        return transformed_rect_;
+        transformed_rect = inverse_and_tranfrom_rect(rect, math::transformf{transforms.top()});
+        return transformed_rect;
     }
 
     return fbo->get_rect();
@@ -1457,10 +2725,16 @@ const gpu_stats& renderer::get_stats() const
 
 void gpu_stats::record(const draw_list& list)
 {
+    // references to other lists are not draw calls
+    const auto list_rendered_calls = list.commands.size() - list.sub_lists.size() - list.static_segments.size();
     requested_calls += size_t(list.commands_requested);
-    rendered_calls += list.commands.size();
-    batched_calls += size_t(list.commands_requested) - list.commands.size();
+    rendered_calls += list_rendered_calls;
+    batched_calls += size_t(list.commands_requested) - list_rendered_calls;
+    referenced_lists += list.sub_lists.size();
+    lookback_batched_calls += size_t(list.commands_lookback_batched);
     vertices += list.vertices.size();
+    compact_vertices += list.compact_vertices.size();
+    instances += list.instances.size();
     indices += list.indices.size();
 
     size_t req_opaque_calls = 0;
@@ -1469,6 +2743,11 @@ void gpu_stats::record(const draw_list& list)
     size_t rend_blended_calls = 0;
     for(const auto& cmd : list.commands)
     {
+        if(is_reference(cmd.dr_type))
+        {
+            continue;
+        }
+
         if(cmd.blend == blending_mode::blend_none)
         {
             req_opaque_calls += cmd.subcount;
@@ -1501,7 +2780,50 @@ std::string gpu_stats::to_string() const
        << "   - Blended: " << rendered_blended_calls << "\n"
        << "Batched:" << batched_calls << "\n"
        << "   - Opaque: " << batched_opaque_calls << "\n"
-       << "   - Blended: " << batched_blended_calls;
+       << "   - Blended: " << batched_blended_calls << "\n"
+       << "   - Look-back: " << lookback_batched_calls
+       << " (" << (requested_calls > 0 ? lookback_batched_calls * 100 / requested_calls : 0) << "% merge rate)" << "\n"
+       << "Referenced lists:" << referenced_lists << "\n"
+       << "Static segments:" << static_segments << "\n"
+       << "   - Calls: " << static_segment_calls << "\n"
+       << "   - Bytes saved: " << static_bytes_saved << "\n"
+       << "Sprite instances:" << instances << "\n"
+       << "Uploaded bytes:" << uploaded_bytes
+       << " (" << std::chrono::duration_cast<std::chrono::microseconds>(upload_time).count() << "us)" << "\n"
+       << "Skipped uploads:" << skipped_uploads << "\n"
+       << "   - Bytes: " << skipped_upload_bytes << "\n"
+       << "   - Fingerprint time: " << std::chrono::duration_cast<std::chrono::microseconds>(fingerprint_time).count() << "us" << "\n"
+       << "Ring high-water mark:" << "\n"
+       << "   - Vertices: " << vertex_ring_high_water_mark << "\n"
+       << "   - Indices: " << index_ring_high_water_mark << "\n"
+       << "Redundant gl calls skipped:" << redundant_gl_calls << "\n"
+       << "Multi draws:" << multi_draws << " (" << multi_drawn_calls << " calls)";
+
+    if(!gpu_timings.passes.empty())
+    {
+        auto to_us = [](std::chrono::nanoseconds time)
+        {
+            return std::chrono::duration_cast<std::chrono::microseconds>(time).count();
+        };
+
+        ss << "\n"
+           << "Gpu time:" << to_us(gpu_timings.frame_time) << "us"
+           << " (" << gpu_timings.latency << " frames ago)" << "\n"
+           << "   - p50/p90/p99: " << to_us(gpu_timings.frame_time_p50) << "/"
+           << to_us(gpu_timings.frame_time_p90) << "/"
+           << to_us(gpu_timings.frame_time_p99) << "us" << "\n"
+           << "   - Dropped frames: " << gpu_timings.dropped_frames;
+
+        for(const auto& pass : gpu_timings.passes)
+        {
+            ss << "\n" << "   - " << gfx::to_string(pass.pass) << ": " << to_us(pass.time) << "us";
+            if(pass.timed_commands > 0)
+            {
+                ss << " (" << pass.timed_commands << " commands, slowest #" << pass.slowest_command
+                   << " " << to_us(pass.slowest_command_time) << "us)";
+            }
+        }
+    }
 
     return ss.str();
 }
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <string>
 #include <stack>
+#include <thread>
 
 #include "color.h"
 #include "draw_list.h"
@@ -10,6 +13,9 @@
 #include "surface.h"
 #include "texture.h"
 #include "font_ptr.h"
+#include "static_segment.h"
+#include "detail/gl_state.h"
+#include "detail/gpu_timer.h"
 
 #include <ospp/window.h>
 
@@ -33,9 +39,45 @@ struct gpu_stats
     size_t batched_calls{};
     size_t batched_opaque_calls{};
     size_t batched_blended_calls{};
+    /// calls merged into an earlier, non overlapping command
+    size_t lookback_batched_calls{};
+    /// lists drawn by reference, without copying
+    size_t referenced_lists{};
+    /// static segments drawn from their own gpu buffers
+    size_t static_segments{};
+    size_t static_segment_calls{};
+    /// vertex and index bytes which were not uploaded thanks to static segments
+    size_t static_bytes_saved{};
 
     size_t vertices{};
+    size_t compact_vertices{};
+    size_t instances{};
     size_t indices{};
+
+    /// vertex and index bytes uploaded to the stream buffers
+    size_t uploaded_bytes{};
+    std::chrono::nanoseconds upload_time{};
+    /// bytes not uploaded because the streams were the same as the last uploaded ones
+    size_t skipped_upload_bytes{};
+    size_t skipped_uploads{};
+    /// time spent fingerprinting and comparing the streams
+    std::chrono::nanoseconds fingerprint_time{};
+
+    /// most bytes in flight in the persistently mapped rings.
+    /// Rings of these sizes never need to grow.
+    size_t vertex_ring_high_water_mark{};
+    size_t index_ring_high_water_mark{};
+
+    /// gl calls skipped by the state tracker
+    size_t redundant_gl_calls{};
+
+    /// multi draw calls and the commands submitted through them
+    size_t multi_draws{};
+    size_t multi_drawn_calls{};
+
+    /// gpu times measured when draw_config::gpu_timing is enabled.
+    /// They belong to an earlier frame, see gpu_frame_timings::latency.
+    gpu_frame_timings gpu_timings{};
 };
 
 class renderer;
@@ -57,6 +99,15 @@ public:
 
     renderer(os::window& win, bool vsync, frame_callbacks fn = {});
 
+    // Render without a window into an offscreen target of the given size, e.g. on
+    // build agents without a display or a gpu. Requires BUILD_VIDEOPP_HEADLESS.
+    renderer(const size& offscreen_size, frame_callbacks fn = {});
+    bool is_headless() const noexcept;
+
+    // Read the pixels of the last presented frame of a headless renderer.
+    // The rows are top to bottom in rgba order.
+    bool read_back(std::vector<uint8_t>& pixels) const noexcept;
+
     texture_ptr create_texture(const surface& surface, bool empty = false) const noexcept;
     texture_ptr create_texture(const surface& surface, size_t level_id, size_t layer_id = 0, size_t face_id = 0) const noexcept;
     texture_ptr create_texture(const std::string& file_name) const noexcept;
@@ -66,6 +117,11 @@ public:
     // Create shader for unique use with these functions
     shader_ptr create_shader(const char* fragment_code , const char* vertex_code) const noexcept;
 
+    // Upload a list once into gpu buffers to be drawn by reference every frame.
+    // The list must not reference other lists or segments.
+    static_segment_ptr create_static_segment(const draw_list& list) const noexcept;
+    bool update_static_segment(static_segment& segment, const draw_list& list) const noexcept;
+
     // comsumes font_info
     font_ptr create_font(font_info&& info, bool embedded = false) const noexcept;
 
@@ -94,6 +150,21 @@ public:
 
     void present() noexcept;
     void present(const size& new_win_size) noexcept;
+
+    // Render thread
+    // When enabled present() hands the recorded frame to a thread owned by the renderer
+    // which uploads, draws and swaps it while the next frame is recorded.
+    // Gl work done on the calling thread (texture uploads, fbos, flush) waits
+    // for the frame in flight and takes the context back.
+    // With GLX the context is made current and swapped from both threads, so Xlib
+    // must be thread safe: call XInitThreads() before the window opens its display.
+    bool set_render_thread(bool enabled) noexcept;
+    bool is_render_thread_enabled() const noexcept;
+    // True while the render thread still draws the last presented frame
+    bool is_frame_in_flight() const noexcept;
+    // Wait for the frame in flight and make the context current on the calling thread.
+    // Call it before destroying gpu objects such as shaders and static segments.
+    bool wait_render_thread() const noexcept;
     void clear(const color& color = {}) const noexcept;
 
     // VSync
@@ -123,9 +194,76 @@ private:
     bool set_blending_mode(blending_mode mode) const noexcept;
     blending_mode get_apropriate_blend_mode(blending_mode mode, const gpu_program& program) const noexcept;
 
-    bool draw_cmd_list(const draw_list& list) const noexcept;
+    /// A list drawn as part of a draw_cmd_list call and
+    /// the byte offsets of its streams in the stream buffers.
+    struct draw_segment_info
+    {
+        const draw_list* list{};
+        size_t vertices_offset{};
+        size_t compact_vertices_offset{};
+        size_t instances_offset{};
+        size_t indices_offset{};
+    };
+
+    /// State shared while drawing the segments of a list
+    struct draw_state
+    {
+        const vertex_array_object& vao;
+        const vertex_buffer& vbo;
+        const index_buffer& ibo;
+        const index_buffer* bound_ibo{&ibo};
+        blending_mode last_blend{blending_mode::blend_none};
+        color multiplier{255, 255, 255, 255};
+    };
+
+    /// A recorded frame and the resources to delete after it is presented
+    struct frame_packet
+    {
+        draw_list list;
+        std::vector<pixmap> pixmap_to_delete;
+        std::vector<uint32_t> fbo_to_delete;
+        std::vector<uint32_t> textures_to_delete;
+        /// the backbuffer rect the frame was recorded for
+        rect viewport{};
+        /// stats of the last frame presented by the render thread
+        gpu_stats stats;
+    };
+
+    enum class frame_state : uint32_t
+    {
+        idle,
+        submitted
+    };
+
+    void submit_frame() noexcept;
+    void render_thread_main() noexcept;
+    void render_frame() noexcept;
+    void wait_frame() const noexcept;
+    bool is_render_thread() const noexcept;
+    const rect& get_viewport() const noexcept;
+    void delete_resources(std::vector<pixmap>& pixmaps,
+                          std::vector<uint32_t>& fbos,
+                          std::vector<uint32_t>& textures) const noexcept;
+
+    bool draw_cmd_list(const draw_list& list, gpu_pass pass) const noexcept;
+    void gather_segments(const draw_list& list) const;
+    bool is_last_upload(uint64_t fingerprint, size_t vertices_mem_size, size_t indices_mem_size) const noexcept;
+    void copy_streams(uint8_t* vertices_dst, uint8_t* indices_dst) const noexcept;
+    void stream_to_buffers(const vertex_buffer*& out_vbo, const index_buffer*& out_ibo,
+                           size_t vertices_mem_size, size_t indices_mem_size, bool unchanged) const noexcept;
+    bool stream_to_rings(const vertex_buffer*& out_vbo, const index_buffer*& out_ibo,
+                         size_t vertices_mem_size, size_t indices_mem_size, bool unchanged) const noexcept;
+    void draw_segment(size_t& segment_idx, draw_state& state) const noexcept;
+    void draw_static_segment(const static_segment& segment, const color& multiplier, draw_state& state) const noexcept;
+    void draw_command(const draw_list& list, const draw_cmd& cmd, size_t count,
+                      const draw_segment_info& segment, draw_state& state) const noexcept;
+    void multi_draw_elements(const draw_cmd* cmds, size_t count, size_t indices_offset) const noexcept;
+    void reserve_quad_indices(size_t quads) const noexcept;
+    void set_crop_rects(const gpu_program& program, const draw_list::crop_area_t& crop) const noexcept;
+    void set_uniforms(const gpu_program& program, const std::vector<uniform_value>& uniforms) const noexcept;
     bool push_clip(const rect& rect) const noexcept;
     bool pop_clip() const noexcept;
+    void apply_clip() const noexcept;
 
     friend class texture;
     friend class shader;
@@ -137,21 +275,44 @@ private:
         transform_stack transforms;
     };
 
-    os::window& win_;
+    os::window* win_{};
     std::unique_ptr<context> context_;
     rect rect_;
+    /// stands in for the backbuffer of a headless renderer
+    texture_ptr offscreen_target_;
 
     mutable rect transformed_rect_ {};
     mutable std::vector<pixmap> pixmap_to_delete_ {};
     mutable std::vector<uint32_t> fbo_to_delete_ {};
     mutable std::vector<uint32_t> textures_to_delete_ {};
 
+    mutable draw_list::crop_area_t crop_rects_ {};
+    mutable std::vector<draw_segment_info> segments_ {};
+    /// scissor rects of the pushed clips in framebuffer coordinates
+    mutable std::vector<rect> scissors_ {};
+    mutable gl_state gl_state_ {};
+    mutable gpu_timer gpu_timer_ {};
+    /// scratch storage for the multi draw arguments
+    mutable std::vector<int32_t> multi_draw_counts_ {};
+    mutable std::vector<const void*> multi_draw_indices_ {};
+    mutable std::vector<int32_t> multi_draw_base_vertices_ {};
+
     mutable math::mat4x4 current_ortho_;
     mutable std::stack<fbo_context> fbo_stack_;
     mutable transform_stack master_transforms_;
     mutable draw_list master_list_;
     draw_list dummy_list_;
 
+    /// The frame handed to the render thread. Owned by the render thread
+    /// while submitted and by the recording thread while idle.
+    frame_packet frame_;
+    std::atomic<frame_state> frame_state_{frame_state::idle};
+    std::atomic<bool> render_thread_stop_{false};
+    std::thread render_thread_;
+    /// transforms used while the render thread draws a frame
+    mutable transform_stack render_transforms_;
+    mutable rect render_transformed_rect_ {};
+
     bool vsync_enabled_ {false};
 
     static constexpr size_t max_buffers{3};
@@ -162,6 +323,36 @@ private:
     mutable size_t current_ibo_idx_{};
     std::array<index_buffer, max_buffers> stream_ibos_;
 
+    /// Persistently mapped rings used instead of the
+    /// stream buffers when the context supports them.
+    mutable ring_buffer<vertex_buffer> stream_vertex_ring_;
+    mutable ring_buffer<index_buffer> stream_index_ring_;
+
+    /// Where the streams of the last draw were uploaded. The same
+    /// streams are drawn from there again without uploading them.
+    struct stream_upload
+    {
+        uint64_t fingerprint{};
+        size_t vertices_size{};
+        size_t indices_size{};
+        const vertex_buffer* vbo{};
+        const index_buffer* ibo{};
+        /// offsets of the streams when they were written to the rings
+        size_t vertices_base{};
+        size_t indices_base{};
+        bool ring{};
+        bool valid{};
+    };
+    mutable stream_upload last_upload_{};
+    /// cpu copies of the last uploaded streams. A fingerprint
+    /// match is confirmed against them before skipping an upload.
+    mutable std::vector<uint8_t> last_vertices_{};
+    mutable std::vector<uint8_t> last_indices_{};
+
+    /// Static indices shared by all quad commands. Grows on demand.
+    index_buffer quad_ibo_;
+    mutable size_t quad_ibo_quads_{};
+
     mutable std::vector<shader_ptr> embedded_shaders_;
     mutable std::vector<font_ptr> embedded_fonts_;
 
@@ -175,6 +366,8 @@ private:
 
     std::array<std::array<uint32_t, interp_count>, wrap_count> samplers_{{}};
 
+    void init(bool vsync, frame_callbacks fn);
+    uint32_t get_backbuffer() const noexcept;
     void setup_sampler(texture::wrap_type wrap, texture::interpolation_type interp) noexcept;
     void set_model_view(uint32_t model, const rect& rect) const noexcept;
     bool set_current_context() const noexcept;
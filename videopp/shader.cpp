@@ -2,10 +2,23 @@
 #include "renderer.h"
 #include "detail/utils.h"
 
+#include <cstring>
+
 namespace gfx
 {
     namespace
     {
+        const char* builtin_uniform_names[] =
+        {
+            "uProjection",
+            "uColorMultiplier",
+            "uTextures[0]",
+            "uRects[0]",
+            "uRectsCount",
+        };
+        static_assert(sizeof(builtin_uniform_names) / sizeof(builtin_uniform_names[0]) == size_t(builtin_uniform::count),
+                      "missing builtin uniform name");
+
         void get_log(uint32_t id)
         {
             GLint info_len = 0;
@@ -46,7 +59,10 @@ namespace gfx
 
         cache_uniform_locations();
 
-        layout_.set_program_id(program_id_);
+        for(auto& layout : layouts_)
+        {
+            layout.set_program_id(program_id_);
+        }
     }
 
     shader::~shader() noexcept
@@ -130,30 +146,33 @@ namespace gfx
                 locations_[uniform] = location;
             }
         }
+
+        for(size_t idx = 0; idx < builtin_locations_.size(); ++idx)
+        {
+            auto it = locations_.find(builtin_uniform_names[idx]);
+            builtin_locations_[idx] = it != std::end(locations_) ? it->second : -1;
+        }
     }
 
-    void shader::enable() const
+    void shader::enable(vertex_format format, std::size_t base_offset) const
     {
-        gl_call(glUseProgram(program_id_));
+        rend_.gl_state_.use_program(program_id_);
 
-        layout_.bind();
+        bound_format_ = format;
+        rend_.gl_state_.bind_layout(get_layout(format), base_offset);
     }
 
     void shader::disable() const
     {
-        layout_.unbind();
-
-        gl_call(glUseProgram(0));
-        clear_textures();
+        // The program, the attributes and the textures stay bound. The
+        // renderer's state tracker skips them when the next command reuses them.
+        release_textures();
     }
 
+
     void shader::set_uniform(const char* uniform, const math::transform_t<float>::mat4_t &data) const
     {
-        auto location = get_uniform_location(uniform);
-        if(location >= 0)
-        {
-            gl_call(glUniformMatrix4fv(location, 1, false, math::value_ptr(data)));
-        }
+        set_uniform_value(get_uniform_location(uniform), data);
     }
 
     void shader::set_uniform(const char* uniform, const texture_view& tex, uint32_t slot) const
@@ -168,14 +187,162 @@ namespace gfx
 
         rend_.bind_pixmap(tex.pixmap);
         bound_textures_[slot] = tex;
-        auto location = get_uniform_location(uniform);
-        if(location >= 0)
+        set_uniform_value(get_uniform_location(uniform), int(slot));
+    }
+
+    void shader::set_uniform(const char* uniform, const texture_view* tex, uint32_t used_slots) const
+    {
+        set_uniform_value(get_uniform_location(uniform), tex, used_slots);
+    }
+
+    void shader::set_uniform(const char* uniform, const math::vec<2, int>& data) const
+    {
+        set_uniform_value(get_uniform_location(uniform), data);
+    }
+
+    void shader::set_uniform(const char* uniform, const math::vec<2, float>& data) const
+    {
+        set_uniform_value(get_uniform_location(uniform), data);
+    }
+
+    void shader::set_uniform(const char* uniform, const math::vec<3, int>& data) const
+    {
+        set_uniform_value(get_uniform_location(uniform), data);
+    }
+
+    void shader::set_uniform(const char* uniform, const math::vec<3, float>& data) const
+    {
+        set_uniform_value(get_uniform_location(uniform), data);
+    }
+
+    void shader::set_uniform(const char* uniform, const math::vec<4, int>& data) const
+    {
+        set_uniform_value(get_uniform_location(uniform), data);
+    }
+
+    void shader::set_uniform(const char* uniform, const math::vec<4, float>& data) const
+    {
+        set_uniform_value(get_uniform_location(uniform), data);
+    }
+
+    void shader::set_uniform(const char* uniform, const std::vector<math::vec<4, float>>& data) const
+    {
+        set_uniform_value(get_uniform_location(uniform), data);
+    }
+
+    void shader::set_uniform(const char* uniform, const std::vector<rect>& data) const
+    {
+        set_uniform_value(get_uniform_location(uniform), data);
+    }
+
+    void shader::set_uniform(const char* uniform, const color& data) const
+    {
+        set_uniform_value(get_uniform_location(uniform), data);
+    }
+
+    void shader::set_uniform(const char* uniform, float data) const
+    {
+        set_uniform_value(get_uniform_location(uniform), data);
+    }
+
+    void shader::set_uniform(const char* uniform, int data) const
+    {
+        set_uniform_value(get_uniform_location(uniform), data);
+    }
+
+    void shader::set_uniform(builtin_uniform uniform, const texture_view* tex, uint32_t used_slots) const
+    {
+        set_uniform_value(builtin_locations_[size_t(uniform)], tex, used_slots);
+    }
+
+    void shader::set_uniform(builtin_uniform uniform, int data) const
+    {
+        set_uniform_value(builtin_locations_[size_t(uniform)], data);
+    }
+
+    void shader::set_uniform(builtin_uniform uniform, const math::transform_t<float>::mat4_t &data) const
+    {
+        set_uniform_value(builtin_locations_[size_t(uniform)], data);
+    }
+
+    void shader::set_uniform(builtin_uniform uniform, const std::vector<rect>& data) const
+    {
+        set_uniform_value(builtin_locations_[size_t(uniform)], data);
+    }
+
+    void shader::set_uniform(builtin_uniform uniform, const color& data) const
+    {
+        set_uniform_value(builtin_locations_[size_t(uniform)], data);
+    }
+
+    bool shader::has_uniform(const char* uniform) const
+    {
+        return locations_.find(uniform) != std::end(locations_);
+    }
+
+    void shader::clear_textures() const
+    {
+        for(int32_t slot = 0; slot <= max_bound_slot_; ++slot)
+        {
+            rend_.unbind_pixmap(bound_textures_[size_t(slot)].pixmap);
+            rend_.reset_texture(uint32_t(slot));
+            if ( bound_textures_[size_t(slot)].custom_sampler )
+            {
+                rend_.reset_texture_sampler(uint32_t(slot));
+            }
+            bound_textures_[size_t(slot)] = {};
+        }
+        // activate just 1 texture
+        rend_.reset_texture(0);
+        max_bound_slot_ = -1;
+    }
+
+    void shader::release_textures() const
+    {
+        for(int32_t slot = 0; slot <= max_bound_slot_; ++slot)
+        {
+            rend_.unbind_pixmap(bound_textures_[size_t(slot)].pixmap);
+            if ( bound_textures_[size_t(slot)].custom_sampler )
+            {
+                rend_.reset_texture_sampler(uint32_t(slot));
+            }
+            bound_textures_[size_t(slot)] = {};
+        }
+        max_bound_slot_ = -1;
+    }
+
+    int shader::get_uniform_location(const char* uniform) const
+    {
+        auto it = locations_.find(uniform);
+        if(it != std::end(locations_))
+        {
+            return it->second;
+        }
+
+        log("ERROR, could not find uniform: " + std::string(uniform));
+
+        return -1;
+    }
+
+    bool shader::update_shadow_value(int location, const void* data, size_t size) const
+    {
+        if(size_t(location) >= shadow_values_.size())
         {
-            gl_call(glUniform1i(location, GLint(slot)));
+            shadow_values_.resize(size_t(location) + 1);
         }
+
+        auto& value = shadow_values_[size_t(location)];
+        if(value.size() == size && std::memcmp(value.data(), data, size) == 0)
+        {
+            return false;
+        }
+
+        const auto bytes = reinterpret_cast<const uint8_t*>(data);
+        value.assign(bytes, bytes + size);
+        return true;
     }
 
-    void shader::set_uniform(const char* uniform, const std::array<texture_view, 32>& tex, uint32_t used_slots) const
+    void shader::set_uniform_value(int location, const texture_view* tex, uint32_t used_slots) const
     {
         assert(used_slots <= bound_textures_.size() && "shader::set_uniform - index out of bounds");
 
@@ -198,140 +365,102 @@ namespace gfx
             }
         }
 
-        auto location = get_uniform_location(uniform);
-        if(location >= 0)
+        if(location >= 0 && update_shadow_value(location, samplers, sizeof(samplers)))
         {
             gl_call(glUniform1iv(location, GLsizei(32), samplers));
         }
     }
 
-    void shader::set_uniform(const char* uniform, const math::vec<2, int>& data) const
+    void shader::set_uniform_value(int location, int data) const
     {
-        auto location = get_uniform_location(uniform);
-        if(location >= 0)
+        if(location >= 0 && update_shadow_value(location, &data, sizeof(data)))
         {
-            gl_call(glUniform2i(location, data.x, data.y));
+            gl_call(glUniform1i(location, data));
         }
     }
 
-    void shader::set_uniform(const char* uniform, const math::vec<2, float>& data) const
+    void shader::set_uniform_value(int location, float data) const
     {
-        auto location = get_uniform_location(uniform);
-        if(location >= 0)
+        if(location >= 0 && update_shadow_value(location, &data, sizeof(data)))
         {
-            gl_call(glUniform2f(location, data.x, data.y));
+            gl_call(glUniform1f(location, data));
         }
     }
 
-    void shader::set_uniform(const char* uniform, const math::vec<3, int>& data) const
+    void shader::set_uniform_value(int location, const math::transform_t<float>::mat4_t &data) const
     {
-        auto location = get_uniform_location(uniform);
-        if(location >= 0)
+        if(location >= 0 && update_shadow_value(location, math::value_ptr(data), sizeof(data)))
         {
-            gl_call(glUniform3i(location, data.x, data.y, data.z));
+            gl_call(glUniformMatrix4fv(location, 1, false, math::value_ptr(data)));
         }
     }
 
-    void shader::set_uniform(const char* uniform, const math::vec<3, float>& data) const
+    void shader::set_uniform_value(int location, const math::vec<2, int>& data) const
     {
-        auto location = get_uniform_location(uniform);
-        if(location >= 0)
+        if(location >= 0 && update_shadow_value(location, &data, sizeof(data)))
         {
-            gl_call(glUniform3f(location, data.x, data.y, data.z));
+            gl_call(glUniform2i(location, data.x, data.y));
         }
     }
 
-    void shader::set_uniform(const char* uniform, const math::vec<4, int>& data) const
+    void shader::set_uniform_value(int location, const math::vec<2, float>& data) const
     {
-        auto location = get_uniform_location(uniform);
-        if(location >= 0)
+        if(location >= 0 && update_shadow_value(location, &data, sizeof(data)))
         {
-            gl_call(glUniform4i(location, data.x, data.y, data.z, data.w));
+            gl_call(glUniform2f(location, data.x, data.y));
         }
     }
 
-    void shader::set_uniform(const char* uniform, const math::vec<4, float>& data) const
+    void shader::set_uniform_value(int location, const math::vec<3, int>& data) const
     {
-        auto location = get_uniform_location(uniform);
-        if(location >= 0)
+        if(location >= 0 && update_shadow_value(location, &data, sizeof(data)))
         {
-            gl_call(glUniform4f(location, data.x, data.y, data.z, data.w));
+            gl_call(glUniform3i(location, data.x, data.y, data.z));
         }
     }
 
-    void shader::set_uniform(const char* uniform, const std::vector<math::vec<4, float>>& data) const
+    void shader::set_uniform_value(int location, const math::vec<3, float>& data) const
     {
-        auto location = get_uniform_location(uniform);
-        if(location >= 0 && !data.empty())
+        if(location >= 0 && update_shadow_value(location, &data, sizeof(data)))
         {
-            gl_call(glUniform4fv(location, GLsizei(data.size()), math::value_ptr(data[0])));
+            gl_call(glUniform3f(location, data.x, data.y, data.z));
         }
     }
 
-    void shader::set_uniform(const char* uniform, const std::vector<rect>& data) const
+    void shader::set_uniform_value(int location, const math::vec<4, int>& data) const
     {
-        auto location = get_uniform_location(uniform);
-        if(location >= 0 && !data.empty())
+        if(location >= 0 && update_shadow_value(location, &data, sizeof(data)))
         {
-            gl_call(glUniform4iv(location, GLsizei(data.size()), &data[0].x));
+            gl_call(glUniform4i(location, data.x, data.y, data.z, data.w));
         }
     }
 
-    void shader::set_uniform(const char* uniform, const color& data) const
-    {
-        set_uniform(uniform, math::vec4{float(data.r) / 255.0f, float(data.g) / 255.0f, float(data.b) / 255.0f, float(data.a) / 255.0f});
-    }
-
-    bool shader::has_uniform(const char* uniform) const
-    {
-        return locations_.find(uniform) != std::end(locations_);
-    }
-
-    void shader::clear_textures() const
+    void shader::set_uniform_value(int location, const math::vec<4, float>& data) const
     {
-        for(int32_t slot = 0; slot <= max_bound_slot_; ++slot)
+        if(location >= 0 && update_shadow_value(location, &data, sizeof(data)))
         {
-            rend_.unbind_pixmap(bound_textures_[size_t(slot)].pixmap);
-            rend_.reset_texture(uint32_t(slot));
-            if ( bound_textures_[size_t(slot)].custom_sampler )
-            {
-                rend_.reset_texture_sampler(uint32_t(slot));
-            }
-            bound_textures_[size_t(slot)] = {};
+            gl_call(glUniform4f(location, data.x, data.y, data.z, data.w));
         }
-        // activate just 1 texture
-        rend_.reset_texture(0);
-        max_bound_slot_ = -1;
     }
 
-    int shader::get_uniform_location(const char* uniform) const
+    void shader::set_uniform_value(int location, const std::vector<math::vec<4, float>>& data) const
     {
-        auto it = locations_.find(uniform);
-        if(it != std::end(locations_))
+        if(location >= 0 && !data.empty() && update_shadow_value(location, data.data(), data.size() * sizeof(data[0])))
         {
-            return it->second;
+            gl_call(glUniform4fv(location, GLsizei(data.size()), math::value_ptr(data[0])));
         }
-
-        log("ERROR, could not find uniform: " + std::string(uniform));
-
-        return -1;
     }
 
-    void shader::set_uniform(const char* uniform, float data) const
+    void shader::set_uniform_value(int location, const std::vector<rect>& data) const
     {
-        auto location = get_uniform_location(uniform);
-        if(location >= 0)
+        if(location >= 0 && !data.empty() && update_shadow_value(location, data.data(), data.size() * sizeof(data[0])))
         {
-            gl_call(glUniform1f(location, data));
+            gl_call(glUniform4iv(location, GLsizei(data.size()), &data[0].x));
         }
     }
 
-    void shader::set_uniform(const char* uniform, int data) const
+    void shader::set_uniform_value(int location, const color& data) const
     {
-        auto location = get_uniform_location(uniform);
-        if(location >= 0)
-        {
-            gl_call(glUniform1i(location, data));
-        }
+        set_uniform_value(location, math::vec4{float(data.r) / 255.0f, float(data.g) / 255.0f, float(data.b) / 255.0f, float(data.a) / 255.0f});
     }
 }
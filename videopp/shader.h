@@ -13,16 +13,32 @@ namespace gfx
 {
     class renderer;
 
+    /// Uniforms set by the renderer for every command.
+    /// Their locations are resolved once, when the program is linked.
+    enum class builtin_uniform : uint8_t
+    {
+        projection,
+        color_multiplier,
+        textures,
+        rects,
+        rects_count,
+
+        count
+    };
+
     class shader
     {
     public:
         ~shader() noexcept;
 
-        void enable() const;
+        /// Binds the program and the vertex layout of the given format.
+        /// The base offset (in bytes) is where the vertices of that
+        /// format start in the bound vertex buffer.
+        void enable(vertex_format format = vertex_format::full, std::size_t base_offset = 0) const;
         void disable() const;
 
         void set_uniform(const char* uniform, const texture_view& tex, uint32_t slot = 0) const;
-        void set_uniform(const char* uniform, const std::array<texture_view, 32>& tex, uint32_t used_slots) const;
+        void set_uniform(const char* uniform, const texture_view* tex, uint32_t used_slots) const;
 
 
         void set_uniform(const char* uniform, int data) const;
@@ -44,26 +60,59 @@ namespace gfx
 
         void set_uniform(const char* uniform, const color& data) const;
 
+        void set_uniform(builtin_uniform uniform, const texture_view* tex, uint32_t used_slots) const;
+        void set_uniform(builtin_uniform uniform, int data) const;
+        void set_uniform(builtin_uniform uniform, const math::transform_t<float>::mat4_t &data) const;
+        void set_uniform(builtin_uniform uniform, const std::vector<rect>& data) const;
+        void set_uniform(builtin_uniform uniform, const color& data) const;
+
         bool has_uniform(const char* uniform) const;
+        bool has_uniform(builtin_uniform uniform) const { return builtin_locations_[size_t(uniform)] >= 0; }
         void clear_textures() const;
         uint32_t get_program_id() const { return program_id_; }
 
-        vertex_buffer_layout& get_layout() { return layout_; }
-        const vertex_buffer_layout& get_layout() const { return layout_; }
+        /// Layout per vertex format. Formats without attributes
+        /// are not supported by the program.
+        vertex_buffer_layout& get_layout(vertex_format format = vertex_format::full) { return layouts_[size_t(format)]; }
+        const vertex_buffer_layout& get_layout(vertex_format format = vertex_format::full) const { return layouts_[size_t(format)]; }
 
     private:
         int get_uniform_location(const char* uniform) const;
 
+        void set_uniform_value(int location, const texture_view* tex, uint32_t used_slots) const;
+        void set_uniform_value(int location, int data) const;
+        void set_uniform_value(int location, float data) const;
+        void set_uniform_value(int location, const math::transform_t<float>::mat4_t &data) const;
+        void set_uniform_value(int location, const math::vec<2, int>& data) const;
+        void set_uniform_value(int location, const math::vec<2, float>& data) const;
+        void set_uniform_value(int location, const math::vec<3, int>& data) const;
+        void set_uniform_value(int location, const math::vec<3, float>& data) const;
+        void set_uniform_value(int location, const math::vec<4, int>& data) const;
+        void set_uniform_value(int location, const math::vec<4, float>& data) const;
+        void set_uniform_value(int location, const std::vector<math::vec<4, float>>& data) const;
+        void set_uniform_value(int location, const std::vector<rect>& data) const;
+        void set_uniform_value(int location, const color& data) const;
+
+        /// Stores the value as the last one uploaded to the location.
+        /// Returns false if it is the same, so the upload can be skipped.
+        bool update_shadow_value(int location, const void* data, size_t size) const;
+
         friend class renderer;
         shader(const gfx::renderer &rend, const char* fragment_code, const char* vertex_code);
 
         void unload() noexcept;
+        void release_textures() const;
         void compile(uint32_t shader_id);
         void link();
         void cache_uniform_locations();
 
-        vertex_buffer_layout layout_;
+        std::array<vertex_buffer_layout, size_t(vertex_format::count)> layouts_;
+        mutable vertex_format bound_format_{vertex_format::full};
         std::map<std::string, int, std::less<>> locations_;
+        std::array<int, size_t(builtin_uniform::count)> builtin_locations_{};
+        /// last values uploaded per location. Uniform values are
+        /// part of the program state so they survive program switches.
+        mutable std::vector<std::vector<uint8_t>> shadow_values_;
 
         uint32_t program_id_ = 0;
         uint32_t fragment_shader_id_ = 0;
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "draw_list.h"
+#include "vertex.h"
+
+#include <memory>
+
+namespace gfx
+{
+class renderer;
+
+/// A draw list uploaded once into gpu buffers owned by the segment.
+/// Use it for content which rarely changes (backgrounds, frames, static labels).
+/// It is drawn every frame through draw_list::add_static_segment without
+/// uploading its vertices and indices again.
+class static_segment
+{
+public:
+    ~static_segment() = default;
+    static_segment(const static_segment& other) = delete;
+    static_segment(static_segment&& other) = delete;
+
+    /// Invalidated segments are skipped when drawn
+    /// until they are updated through the renderer.
+    void invalidate() noexcept { valid_ = false; }
+    bool is_valid() const noexcept { return valid_; }
+
+    /// Size of the vertices and indices resident on the gpu
+    size_t get_uploaded_bytes() const noexcept { return uploaded_bytes_; }
+
+private:
+    friend class renderer;
+    static_segment() = default;
+
+    /// Commands and side tables of the uploaded list. Its
+    /// streams are released after the upload.
+    draw_list list_{false};
+
+    vertex_array_object vao_;
+    vertex_buffer vbo_;
+    index_buffer ibo_;
+
+    /// byte offset of the compact stream in the vertex buffer
+    size_t compact_vertices_offset_{};
+    /// byte offset of the sprite instances in the vertex buffer
+    size_t instances_offset_{};
+    size_t uploaded_bytes_{};
+    size_t max_quads_{};
+    bool valid_{};
+};
+
+using static_segment_ptr = std::shared_ptr<static_segment>;
+
+}
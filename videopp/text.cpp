@@ -1,11 +1,23 @@
 #include "text.h"
+#include "text_layout_cache.h"
 #include "font.h"
 #include "texture.h"
+#include "paged_glyph_index.h"
 #include <fontpp/ucaps.h>
 
 #include <array>
 #include <algorithm>
 #include <iostream>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VIDEOPP_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VIDEOPP_SSE2
+#endif
 namespace gfx
 {
 namespace
@@ -54,6 +66,130 @@ bool is_white_space(uint32_t c)
     return is_blank(c) || c == 0x0b || c == 0x0c || c == 0x0d;
 }
 
+/// Widens the leading ascii bytes of [beg, end) to codepoints.
+/// Returns the number of bytes widened.
+size_t widen_ascii(const uint8_t* beg, const uint8_t* end, uint32_t* out) noexcept
+{
+    const auto size = size_t(end - beg);
+    size_t i = 0;
+
+#if defined(VIDEOPP_AVX2)
+    for(; i + 32 <= size; i += 32)
+    {
+        const auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(beg + i));
+        if(_mm256_movemask_epi8(bytes) != 0)
+        {
+            break;
+        }
+
+        for(size_t k = 0; k < 32; k += 8)
+        {
+            const auto quarter = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(beg + i + k));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i + k), _mm256_cvtepu8_epi32(quarter));
+        }
+    }
+#endif
+
+#if defined(VIDEOPP_SSE2)
+    const auto zero = _mm_setzero_si128();
+    for(; i + 16 <= size; i += 16)
+    {
+        const auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(beg + i));
+        if(_mm_movemask_epi8(bytes) != 0)
+        {
+            break;
+        }
+
+        const auto lo = _mm_unpacklo_epi8(bytes, zero);
+        const auto hi = _mm_unpackhi_epi8(bytes, zero);
+        auto dst = reinterpret_cast<__m128i*>(out + i);
+        _mm_storeu_si128(dst + 0, _mm_unpacklo_epi16(lo, zero));
+        _mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(lo, zero));
+        _mm_storeu_si128(dst + 2, _mm_unpacklo_epi16(hi, zero));
+        _mm_storeu_si128(dst + 3, _mm_unpackhi_epi16(hi, zero));
+    }
+#endif
+
+    for(; i < size && beg[i] < 0x80; ++i)
+    {
+        out[i] = beg[i];
+    }
+
+    return i;
+}
+
+/// Case mappings of the basic multilingual plane which change the codepoint,
+/// in pages of 256 codepoints. Built on first use.
+struct case_tables
+{
+    paged_glyph_index<uint32_t> lower;
+    paged_glyph_index<uint32_t> upper;
+};
+
+const case_tables& get_case_tables()
+{
+    static const case_tables tables = []()
+    {
+        constexpr uint32_t count = 0x10000;
+        const auto invalid = paged_glyph_index<uint32_t>::invalid;
+        std::vector<uint32_t> lower(count, invalid);
+        std::vector<uint32_t> upper(count, invalid);
+        for(uint32_t c = 0; c < count; ++c)
+        {
+            const auto lower_c = uint32_t(fnt::find_lower_case(c));
+            if(lower_c != c)
+            {
+                lower[c] = lower_c;
+            }
+
+            const auto upper_c = uint32_t(fnt::find_upper_case(c));
+            if(upper_c != c)
+            {
+                upper[c] = upper_c;
+            }
+        }
+
+        case_tables result;
+        result.lower.assign(lower);
+        result.upper.assign(upper);
+        return result;
+    }();
+
+    return tables;
+}
+
+uint32_t to_lower(uint32_t c)
+{
+    if(c < 0x80)
+    {
+        return c - 'A' < 26u ? c + 32 : c;
+    }
+
+    if(c >= 0x10000)
+    {
+        return uint32_t(fnt::find_lower_case(c));
+    }
+
+    const auto mapped = get_case_tables().lower.get(c);
+    return mapped == paged_glyph_index<uint32_t>::invalid ? c : mapped;
+}
+
+uint32_t to_upper(uint32_t c)
+{
+    if(c < 0x80)
+    {
+        return c - 'a' < 26u ? c - 32 : c;
+    }
+
+    if(c >= 0x10000)
+    {
+        return uint32_t(fnt::find_upper_case(c));
+    }
+
+    const auto mapped = get_case_tables().upper.get(c);
+    return mapped == paged_glyph_index<uint32_t>::invalid ? c : mapped;
+}
+
 rect cast_rect(const frect& r)
 {
     rect result;
@@ -400,8 +536,9 @@ bool text::set_utf8_text(const std::string& t)
     {
         return false;
     }
+    const auto unchanged = find_unchanged_lines(t);
     utf8_text_ = t;
-    clear_lines();
+    keep_unchanged_lines(unchanged);
     decorators_.clear();
 
     return true;
@@ -413,14 +550,105 @@ bool text::set_utf8_text(std::string&& t)
     {
         return false;
     }
+    const auto unchanged = find_unchanged_lines(t);
     utf8_text_ = std::move(t);
-    clear_lines();
+    keep_unchanged_lines(unchanged);
 
     decorators_.clear();
 
     return true;
 }
 
+text::unchanged_lines text::find_unchanged_lines(const std::string& utf8_text) const
+{
+    unchanged_lines result{};
+
+    // the kept lines must not depend on the lines following them
+    if(lines_.empty() || partial_layout_ || !decorators_.empty() || !line_path_.empty())
+    {
+        return result;
+    }
+
+    const auto mismatch = std::mismatch(utf8_text_.begin(), utf8_text_.end(),
+                                        utf8_text.begin(), utf8_text.end());
+    const auto common = size_t(std::distance(utf8_text_.begin(), mismatch.first));
+    if(common == 0)
+    {
+        return result;
+    }
+
+    // keep the hard lines ending before the first changed byte
+    const auto newline_pos = utf8_text_.rfind('\n', common - 1);
+    if(newline_pos == std::string::npos)
+    {
+        return result;
+    }
+
+    const auto bytes = newline_pos + 1;
+    const auto chars = count_glyphs(utf8_text_.data(), utf8_text_.data() + bytes);
+    if(chars == 0 || chars > unicode_text_.size() || !is_newline(unicode_text_[chars - 1]))
+    {
+        return result;
+    }
+
+    // a hard line break always ends a line, find the line after it
+    size_t line = lines_.size();
+    size_t line_begin = chars_;
+    while(line > 0 && (line_begin > chars || lines_[line - 1].empty()))
+    {
+        --line;
+        line_begin -= lines_[line].size();
+    }
+
+    if(line == 0 || line_begin != chars || !is_newline(lines_[line - 1].back()))
+    {
+        return result;
+    }
+
+    result.lines = line;
+    result.chars = chars;
+    result.bytes = bytes;
+    return result;
+}
+
+void text::keep_unchanged_lines(const unchanged_lines& unchanged)
+{
+    if(unchanged.lines == 0)
+    {
+        clear_lines();
+        return;
+    }
+
+    // the geometry is kept only when it was generated for all lines
+    if(lines_vertices_.size() == lines_.size())
+    {
+        geometry_.resize(lines_vertices_[unchanged.lines]);
+        lines_vertices_.resize(unchanged.lines);
+    }
+    else
+    {
+        clear_geometry();
+    }
+
+    for(size_t i = unchanged.lines; i < lines_.size(); ++i)
+    {
+        cache<text>::add(lines_[i]);
+    }
+    lines_.resize(unchanged.lines);
+    lines_metrics_.resize(unchanged.lines);
+
+    unicode_text_.resize(unchanged.chars);
+    if(!cap_scales_.empty())
+    {
+        cap_scales_.resize(unchanged.chars);
+    }
+    append_unicode_text(unchanged.bytes);
+
+    chars_ = uint32_t(unchanged.chars);
+    rect_ = {};
+    partial_layout_ = true;
+}
+
 void text::set_style(const text_style& style)
 {
     set_font(style.font);
@@ -619,21 +847,22 @@ void text::set_alignment(align_t flag)
 
 const std::vector<vertex_2d>& text::get_geometry() const
 {
-    if(geometry_.empty())
-    {
-        update_geometry();
-    }
-    return geometry_;
+    update_geometry();
+    return shared_layout_ ? shared_layout_->geometry : geometry_;
 }
 
 const std::vector<std::vector<uint32_t>>& text::get_lines() const
 {
     update_lines();
-    return lines_;
+    return shared_layout_ ? shared_layout_->lines : lines_;
 }
 
 const std::vector<uint32_t> &text::get_unicode_text() const
 {
+    if(shared_layout_)
+    {
+        return shared_layout_->unicode_text;
+    }
     update_unicode_text();
     return unicode_text_;
 }
@@ -641,7 +870,7 @@ const std::vector<uint32_t> &text::get_unicode_text() const
 const std::vector<line_metrics>& text::get_lines_metrics() const
 {
     update_lines();
-    return lines_metrics_;
+    return shared_layout_ ? shared_layout_->lines_metrics : lines_metrics_;
 }
 
 bool text::is_valid() const
@@ -802,18 +1031,130 @@ const std::string& text::get_utf8_text() const
     return utf8_text_;
 }
 
-void text::clear_geometry()
+text_layout_key text::get_layout_key(float wrap_width) const
+{
+    text_layout_key key{};
+    key.font_id = style_.font.get();
+    key.weak_font = style_.font;
+    key.advance = style_.advance;
+    key.color_top = style_.color_top;
+    key.color_bot = style_.color_bot;
+    key.outline_color_top = style_.outline_color_top;
+    key.outline_color_bot = style_.outline_color_bot;
+    key.outline_width = style_.outline_width;
+    key.softness = style_.softness;
+    key.scale = style_.scale;
+    key.leaning = style_.leaning;
+    key.opacity = opacity_;
+    key.wrap_width = wrap_width;
+    key.alignment = alignment_;
+    key.overflow = overflow_;
+    key.line_height_mode = line_height_behaviour_;
+    key.case_mode = case_type_;
+    key.outline_advance = style_.outline_advance;
+    key.kerning_enabled = style_.kerning_enabled;
+    return key;
+}
+
+bool text::find_cached_layout() const
+{
+    // decorators and line paths carry callbacks and points which are not keyed
+    if(!text_layout_cache::is_enabled() || !decorators_.empty() || !line_path_.empty())
+    {
+        return false;
+    }
+
+    auto layout = text_layout_cache::find(get_layout_key(max_wrap_width_), utf8_text_);
+    if(!layout)
+    {
+        return false;
+    }
+
+    unicode_text_.clear();
+    cap_scales_.clear();
+    clear_geometry_buffers();
+
+    layout_wrap_width_ = max_wrap_width_;
+    layout_cacheable_ = false;
+
+    shared_layout_ = std::move(layout);
+    rect_ = shared_layout_->rect;
+    chars_ = shared_layout_->chars;
+    max_wrap_width_ = shared_layout_->wrap_width;
+    align_y_ = shared_layout_->align_y;
+    return true;
+}
+
+void text::add_cached_layout() const
+{
+    layout_cacheable_ = false;
+    if(!text_layout_cache::is_enabled() || !decorators_.empty() || !line_path_.empty())
+    {
+        return;
+    }
+
+    text_layout layout{};
+    layout.lines = std::move(lines_);
+    layout.lines_metrics = std::move(lines_metrics_);
+    layout.unicode_text = std::move(unicode_text_);
+    layout.cap_scales = std::move(cap_scales_);
+    layout.geometry = std::move(geometry_);
+    layout.rect = rect_;
+    layout.chars = chars_;
+    layout.wrap_width = max_wrap_width_;
+    layout.align_y = align_y_;
+
+    lines_.clear();
+    lines_metrics_.clear();
+    unicode_text_.clear();
+    cap_scales_.clear();
+    clear_geometry_buffers();
+
+    shared_layout_ = text_layout_cache::insert(get_layout_key(layout_wrap_width_), utf8_text_, std::move(layout));
+}
+
+void text::detach_shared_layout()
+{
+    if(!shared_layout_)
+    {
+        return;
+    }
+
+    // keep the lines and generate an own geometry, which is not cached
+    // since the style it depends on changed after the lines were laid out
+    const auto& layout = *shared_layout_;
+    lines_ = layout.lines;
+    lines_metrics_ = layout.lines_metrics;
+    unicode_text_ = layout.unicode_text;
+    cap_scales_ = layout.cap_scales;
+    shared_layout_.reset();
+    layout_cacheable_ = false;
+}
+
+void text::clear_geometry_buffers() const
 {
     geometry_.clear();
+    lines_vertices_.clear();
+}
+
+void text::clear_geometry()
+{
+    detach_shared_layout();
+    clear_geometry_buffers();
+    layout_cacheable_ = false;
 }
 
 void text::clear_lines()
 {
+    shared_layout_.reset();
+    layout_cacheable_ = false;
     chars_ = 0;
     lines_.clear();
     unicode_text_.clear();
     cap_scales_.clear();
     lines_metrics_.clear();
+    align_y_ = 0.0f;
+    partial_layout_ = false;
     rect_ = {};
 
     clear_geometry();
@@ -832,44 +1173,83 @@ void text::update_unicode_text() const
         return;
     }
 
-    cache<text>::get(unicode_text_, utf8_text_.size() * 2);
-    unicode_text_.reserve(utf8_text_.size() * 2); // enough for most scripts
+    // a codepoint takes at least a byte
+    cache<text>::get(unicode_text_, utf8_text_.size());
+    unicode_text_.reserve(utf8_text_.size());
 
-    cache<text>::get(cap_scales_, utf8_text_.size() * 2);
-    cap_scales_.reserve(utf8_text_.size() * 2); // enough for most scripts
+    if(case_type_ == case_type::small_caps)
+    {
+        cache<text>::get(cap_scales_, utf8_text_.size());
+        cap_scales_.reserve(utf8_text_.size());
+    }
+
+    append_unicode_text(0);
+}
 
-    const char* beg = utf8_text_.c_str();
-    const char* const end = beg + utf8_text_.size();
+void text::append_unicode_text(size_t utf8_offset) const
+{
+    const auto* beg = reinterpret_cast<const uint8_t*>(utf8_text_.data()) + utf8_offset;
+    const auto* const end = reinterpret_cast<const uint8_t*>(utf8_text_.data()) + utf8_text_.size();
+
+    // decode straight into the buffer, sized for the worst case of all ascii
+    const auto offset = unicode_text_.size();
+    unicode_text_.resize(offset + size_t(end - beg));
+    auto* const first = unicode_text_.data() + offset;
+    auto* out = first;
 
     while(beg < end)
     {
+        const auto ascii = widen_ascii(beg, end, out);
+        if(ascii > 0)
+        {
+            beg += ascii;
+            out += ascii;
+            continue;
+        }
+
         uint32_t uchar{};
 
-        int m = fnt::text_char_from_utf8(&uchar, beg, end);
+        int m = fnt::text_char_from_utf8(&uchar, reinterpret_cast<const char*>(beg), reinterpret_cast<const char*>(end));
         if(!m)
         {
             break;
         }
-        float scale = 1.0f;
-        if(case_type_ == case_type::lowercase)
+
+        *out++ = uchar;
+        beg += m;
+    }
+
+    const auto count = size_t(out - first);
+    unicode_text_.resize(offset + count);
+
+    switch(case_type_)
+    {
+        case case_type::lowercase:
         {
-            uchar = fnt::find_lower_case(uchar);
+            std::transform(first, first + count, first, to_lower);
         }
-        else if(case_type_ == case_type::uppercase)
+        break;
+        case case_type::uppercase:
         {
-            uchar = fnt::find_upper_case(uchar);
+            std::transform(first, first + count, first, to_upper);
         }
-        else if(case_type_ == case_type::small_caps)
+        break;
+        case case_type::small_caps:
         {
-            if(fnt::to_upper_case(uchar))
+            // the scales are stored only for small caps
+            const auto small_caps_scale = get_small_caps_scale();
+            cap_scales_.resize(offset, 1.0f);
+            cap_scales_.reserve(offset + count);
+            for(auto it = first; it != first + count; ++it)
             {
-                scale = get_small_caps_scale();
+                const auto upper = to_upper(*it);
+                cap_scales_.push_back(upper != *it ? small_caps_scale : 1.0f);
+                *it = upper;
             }
         }
-
-        cap_scales_.push_back(scale);
-        unicode_text_.push_back(uchar);
-        beg += m;
+        break;
+        default:
+        break;
     }
 }
 
@@ -955,7 +1335,7 @@ float text::get_decorator_scale(const text_decorator* current) const
 void text::update_lines() const
 {
     // if we already generated lines
-    if(!lines_.empty())
+    if(shared_layout_ || (!lines_.empty() && !partial_layout_))
     {
         return;
     }
@@ -967,6 +1347,11 @@ void text::update_lines() const
         return;
     }
 
+    if(!partial_layout_ && find_cached_layout())
+    {
+        return;
+    }
+
     const auto& unicode_text = get_unicode_text();
 
     if(unicode_text.empty())
@@ -974,6 +1359,9 @@ void text::update_lines() const
         return;
     }
 
+    // there are no scales unless the text is in small caps
+    const auto* cap_scales = cap_scales_.empty() ? nullptr : cap_scales_.data();
+
     struct line_breaker
     {
         enum class type
@@ -1028,6 +1416,24 @@ void text::update_lines() const
         }
     };
 
+    // continue after the lines kept by set_utf8_text
+    size_t first_line = 0;
+    layout_cacheable_ = !partial_layout_ && text_layout_cache::is_enabled();
+    layout_wrap_width_ = max_wrap_width_;
+    if(partial_layout_)
+    {
+        partial_layout_ = false;
+        if(decorators_.empty())
+        {
+            first_line = lines_.size();
+        }
+        else
+        {
+            lines_.clear();
+            lines_metrics_.clear();
+        }
+    }
+
     const auto is_splittable = (overflow_ == overflow_type::word_break || overflow_ == overflow_type::word) && max_wrap_width_ > 0.0f;
     constexpr int max_iterations = 2;
     for(int iteration = 0; iteration < max_iterations; ++iteration)
@@ -1035,15 +1441,23 @@ void text::update_lines() const
         line_breaker last_line_breaker;
         bool is_prev_symbol_space{};
 
-        chars_ = 0;
+        size_t first_char = 0;
+        for(size_t line = 0; line < first_line; ++line)
+        {
+            first_char += lines_[line].size();
+        }
+        chars_ = uint32_t(first_char);
 
-        lines_.clear();
-        cache<text>::get(lines_, 1);
-        lines_.resize(1);
+        lines_.resize(first_line);
+        if(first_line == 0)
+        {
+            cache<text>::get(lines_, 1);
+        }
+        lines_.resize(first_line + 1);
 
         const auto unicode_text_size = unicode_text.size();
-        cache<text>::get(lines_.back(), unicode_text_size);
-        lines_.back().reserve(unicode_text_size);
+        cache<text>::get(lines_.back(), unicode_text_size - first_char);
+        lines_.back().reserve(unicode_text_size - first_char);
 
         auto decorator = &main_decorator_;
         auto next_decorator = get_next_decorator(0, decorator);
@@ -1065,12 +1479,24 @@ void text::update_lines() const
         font_metric.cap_height = scale * font->cap_height;
         font_metric.median = font_metric.cap_height * 0.5f;
 
+        auto first_baseline = font_metric.ascent;
+        auto last_codepoint = char_t(-1);
+        if(first_line > 0)
+        {
+            // Continue below the last kept line, before its alignment.
+            const auto& last_metric = lines_metrics_[first_line - 1];
+            const auto height_bellow_baseline = last_metric.maxy - last_metric.baseline;
+            first_baseline = last_metric.baseline - align_y_ +
+                std::max(line_height, height_bellow_baseline + font_metric.ascent + line_padding);
+
+            // The kept newline kerns with the next character as in a full layout.
+            last_codepoint = font->get_glyph(unicode_text[first_char - 1]).codepoint;
+        }
+
         lines_metrics_.emplace_back();
         // Note: @metric is in absolute increasing values: miny <= ... <= baseline <= ... <= maxy.
         auto metric = &lines_metrics_.back();
-        set_default_line_metric(metric, font_metric.ascent, font_metric);
-
-        auto last_codepoint = char_t(-1);
+        set_default_line_metric(metric, first_baseline, font_metric);
 
         // Keeps the maximal decorator distances between the baseline and the other metric lines.
         line_metrics_distances max_dec_metrics_distances;
@@ -1194,12 +1620,12 @@ void text::update_lines() const
             }
         };
 
-        for(size_t i = 0; i < unicode_text_size; ++i)
+        for(size_t i = first_char; i < unicode_text_size; ++i)
         {
             const auto is_last_symbol = i == unicode_text_size - 1;
             const auto is_beginning_of_line = lines_.back().empty();
             const auto c = unicode_text[i];
-            auto caps_scale = cap_scales_[i];
+            auto caps_scale = cap_scales ? cap_scales[i] : 1.0f;
 
             const auto& g = font->get_glyph(c);
             // Decorator handling.
@@ -1393,7 +1819,7 @@ void text::update_lines() const
             update_fixed_line_heights();
         }
 
-        update_alignment();
+        update_alignment(first_line);
 
         if(overflow_ == overflow_type::none)
         {
@@ -1435,6 +1861,10 @@ void text::update_lines() const
             lines_.clear();
             lines_metrics_.clear();
             rect_ = {};
+
+            // the kept lines are laid out again too
+            first_line = 0;
+            clear_geometry_buffers();
         }
         else
         {
@@ -1443,7 +1873,7 @@ void text::update_lines() const
     }
 }
 
-void text::update_alignment() const
+void text::update_alignment(size_t first_line) const
 {
     if(lines_metrics_.empty())
     {
@@ -1451,14 +1881,32 @@ void text::update_alignment() const
     }
     const auto pixel_snap = style_.font->pixel_snap;
 
-    const auto& first_line = lines_metrics_.front();
-    const auto& last_line = lines_metrics_.back();
+    const auto& first_metric = lines_metrics_.front();
+    const auto& last_metric = lines_metrics_.back();
+
+    // lines before the first one are already aligned
+    const auto first_align_y = first_line > 0 ? align_y_ : 0.0f;
 
     float align_y = get_alignment_y(alignment_,
-                                    first_line.miny, first_line.baseline, first_line.cap_height,
-                                    last_line.maxy, last_line.baseline, last_line.cap_height,
+                                    first_metric.miny - first_align_y,
+                                    first_metric.baseline - first_align_y,
+                                    first_metric.cap_height - first_align_y,
+                                    last_metric.maxy, last_metric.baseline, last_metric.cap_height,
                                     pixel_snap);
 
+    // the aligned lines only move by the change of the offset
+    const auto aligned_offset_y = align_y - first_align_y;
+    align_y_ = align_y;
+
+    if(first_line > 0 && aligned_offset_y != 0.0f)
+    {
+        // the geometry holds only the aligned lines
+        for(auto& vertex : geometry_)
+        {
+            vertex.pos.y += aligned_offset_y;
+        }
+    }
+
 
     float min_x = std::numeric_limits<float>::max();
     float max_x = std::numeric_limits<float>::lowest();
@@ -1466,18 +1914,22 @@ void text::update_alignment() const
     float min_y = std::numeric_limits<float>::max();
     float max_y = std::numeric_limits<float>::lowest();
 
-    for(auto& metric : lines_metrics_)
+    for(size_t i = 0; i < lines_metrics_.size(); ++i)
     {
-        metric.miny += align_y;
-        metric.maxy += align_y;
-        metric.ascent += align_y;
-        metric.cap_height += align_y;
-        metric.x_height += align_y;
-        metric.median += align_y;
-        metric.baseline += align_y;
-        metric.descent += align_y;
+        auto& metric = lines_metrics_[i];
+        const auto is_aligned = i < first_line;
+        const auto offset_y = is_aligned ? aligned_offset_y : align_y;
 
-        if(line_path_.empty())
+        metric.miny += offset_y;
+        metric.maxy += offset_y;
+        metric.ascent += offset_y;
+        metric.cap_height += offset_y;
+        metric.x_height += offset_y;
+        metric.median += offset_y;
+        metric.baseline += offset_y;
+        metric.descent += offset_y;
+
+        if(line_path_.empty() && !is_aligned)
         {
             auto align_x = get_alignment_x(alignment_,
                                            metric.minx,
@@ -1509,16 +1961,21 @@ void text::update_geometry() const
         return;
     }
 
-    if(!geometry_.empty())
+    if(shared_layout_ || (!geometry_.empty() && !partial_layout_ && lines_vertices_.size() == lines_.size()))
     {
         return;
     }
     const auto& lines = get_lines();
-    if(lines.empty())
+    if(lines.empty() || shared_layout_)
     {
         return;
     }
 
+    // the geometry of the lines kept by set_utf8_text is reused
+    const auto first_line = std::min(lines_vertices_.size(), lines.size());
+
+    const auto* cap_scales = cap_scales_.empty() ? nullptr : cap_scales_.data();
+
     auto decorator = &main_decorator_;
     auto next_decorator = get_next_decorator(0, decorator);
     float scale = decorator->scale * get_small_caps_scale();
@@ -1558,8 +2015,13 @@ void text::update_geometry() const
     auto sdf_shift_x = fnt::calc_shift(scaled_spread, float(font->texture->get_rect().w));
     auto sdf_shift_y = fnt::calc_shift(scaled_spread, float(font->texture->get_rect().h));
 
-    cache<text>::get(geometry_, chars_ * vertices_per_quad);
+    const auto kept_vertices = geometry_.size();
+    if(kept_vertices == 0)
+    {
+        cache<text>::get(geometry_, chars_ * vertices_per_quad);
+    }
     geometry_.resize(chars_ * vertices_per_quad);
+    lines_vertices_.resize(first_line);
 
     has_leaning = math::epsilonNotEqual(style_.leaning, 0.0f, math::epsilon<float>());
     if(has_leaning)
@@ -1567,14 +2029,20 @@ void text::update_geometry() const
         leaning = math::rotateZ(math::vec3{0.0f, ascent, 0.0f}, math::radians(-style_.leaning)).x;
     }
 
-    auto vptr = geometry_.data();
-    size_t vtx_count{};
+    auto vptr = geometry_.data() + kept_vertices;
+    size_t vtx_count{kept_vertices};
 
     size_t i = 0;
-    for(size_t line_idx = 0; line_idx < lines.size(); ++line_idx)
+    for(size_t line_idx = 0; line_idx < first_line; ++line_idx)
+    {
+        i += lines[line_idx].size();
+    }
+
+    for(size_t line_idx = first_line; line_idx < lines.size(); ++line_idx)
     {
         const auto& line = lines[line_idx];
         const auto& metric = lines_metrics_[line_idx];
+        lines_vertices_.push_back(vtx_count);
 
         // Set glyph positions on a (0,0) baseline.
         // (x0,y0) for a glyph is the bottom-lefts
@@ -1586,7 +2054,7 @@ void text::update_geometry() const
         for(auto c : line)
         {
             auto glyph_idx = i++;
-            auto caps_scale = cap_scales_[glyph_idx];
+            auto caps_scale = cap_scales ? cap_scales[glyph_idx] : 1.0f;
             const auto& gl = font->get_glyph(c);
             auto g = fnt::shift(gl, sdf_shift_x, sdf_shift_y);
 
@@ -1719,6 +2187,11 @@ void text::update_geometry() const
 
     }
     geometry_.resize(vtx_count);
+
+    if(layout_cacheable_)
+    {
+        add_cached_layout();
+    }
 }
 
 float text::get_width() const
@@ -1759,12 +2232,12 @@ frect text::get_bounds(bounds_query query) const
 {
     if(rect_)
     {
-        return apply_typography_adjustment(query, rect_, alignment_, lines_metrics_);
+        return apply_typography_adjustment(query, rect_, alignment_, get_lines_metrics());
     }
 
     update_lines();
 
-    return apply_typography_adjustment(query, rect_, alignment_, lines_metrics_);
+    return apply_typography_adjustment(query, rect_, alignment_, get_lines_metrics());
 }
 
 const text_style& text::get_style() const
@@ -198,6 +198,9 @@ struct text_style
 };
 using text_style_ptr = std::shared_ptr<text_style>;
 
+struct text_layout;
+struct text_layout_key;
+
 class text
 {
 public:  
@@ -236,7 +239,8 @@ public:
     text& operator=(text&&) = default;
     ~text();
     //-----------------------------------------------------------------------------
-    /// Set the utf8 text.
+    /// Set the utf8 text. The laid out lines before the first changed
+    /// one are kept and only the following lines are laid out again.
     //-----------------------------------------------------------------------------
     bool set_utf8_text(const std::string& t);
     bool set_utf8_text(std::string&& t);
@@ -488,11 +492,28 @@ private:
     float get_advance_offset_x() const;
     float get_advance_offset_y() const;
 
+    /// The leading lines of the current layout which a new text leaves unchanged.
+    struct unchanged_lines
+    {
+        size_t lines{};
+        size_t chars{};
+        size_t bytes{};
+    };
+    unchanged_lines find_unchanged_lines(const std::string& utf8_text) const;
+    void keep_unchanged_lines(const unchanged_lines& unchanged);
+
+    text_layout_key get_layout_key(float wrap_width) const;
+    bool find_cached_layout() const;
+    void add_cached_layout() const;
+    void detach_shared_layout();
+    void clear_geometry_buffers() const;
+
     void clear_geometry();
     void update_lines() const;
     void update_geometry() const;
     void update_unicode_text() const;
-    void update_alignment() const;
+    void append_unicode_text(size_t utf8_offset) const;
+    void update_alignment(size_t first_line) const;
 
     color apply_opacity(color c) const noexcept;
     void set_scale(float scale);
@@ -504,12 +525,33 @@ private:
     /// Buffer of quads.
     mutable std::vector<vertex_2d> geometry_;
 
+    /// Offset of the first vertex of each line in the geometry.
+    /// Lines past its size have no geometry generated yet.
+    mutable std::vector<size_t> lines_vertices_;
+
     /// Lines of unicode codepoints.
     mutable std::vector<std::vector<uint32_t>> lines_;
 
     /// Lines metrics
     mutable std::vector<line_metrics> lines_metrics_;
 
+    /// Vertical alignment offset applied to the lines metrics.
+    mutable float align_y_{};
+
+    /// Only the lines kept by set_utf8_text are laid out,
+    /// the following ones are laid out on the next query.
+    mutable bool partial_layout_{};
+
+    /// Layout shared with other texts through the text_layout_cache.
+    /// The own lines, metrics and geometry are empty while it is set.
+    mutable std::shared_ptr<const text_layout> shared_layout_;
+
+    /// Wrap width of the last full layout before it was widened.
+    mutable float layout_wrap_width_{};
+
+    /// The lines are a full layout which can be cached with its geometry.
+    mutable bool layout_cacheable_{};
+
     /// Unicode text
     mutable std::vector<uint32_t> unicode_text_;
     mutable std::vector<float> cap_scales_;
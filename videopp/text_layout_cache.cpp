@@ -0,0 +1,252 @@
+#include "text_layout_cache.h"
+#include "utils.h"
+
+#include <atomic>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace gfx
+{
+namespace text_layout_cache
+{
+namespace
+{
+
+struct entry
+{
+    text_layout_key key;
+    std::string utf8_text;
+    text_layout_ptr layout;
+    uint64_t hash{};
+    size_t bytes{};
+};
+
+struct cache_state
+{
+    std::mutex mutex;
+    /// the most recently used entry first
+    std::list<entry> entries;
+    std::unordered_map<uint64_t, std::list<entry>::iterator> entries_by_hash;
+    size_t bytes{};
+    text_layout_cache_stats stats{};
+};
+
+cache_state& get_state()
+{
+    static cache_state state;
+    return state;
+}
+
+std::atomic<size_t> budget{0};
+
+uint64_t get_hash(const text_layout_key& key, const std::string& utf8_text) noexcept
+{
+    uint64_t seed = utils::hash_bytes(utf8_text.data(), utf8_text.size());
+    utils::hash(seed, key.font_id,
+                key.advance.x, key.advance.y,
+                key.color_top.r, key.color_top.g, key.color_top.b, key.color_top.a,
+                key.color_bot.r, key.color_bot.g, key.color_bot.b, key.color_bot.a,
+                key.outline_color_top.r, key.outline_color_top.g, key.outline_color_top.b, key.outline_color_top.a,
+                key.outline_color_bot.r, key.outline_color_bot.g, key.outline_color_bot.b, key.outline_color_bot.a,
+                key.outline_width, key.softness, key.scale, key.leaning, key.opacity, key.wrap_width,
+                key.alignment, uint32_t(key.overflow), uint32_t(key.line_height_mode), uint32_t(key.case_mode),
+                key.outline_advance, key.kerning_enabled);
+    return seed;
+}
+
+bool is_equal(const text_layout_key& lhs, const text_layout_key& rhs) noexcept
+{
+    return lhs.font_id == rhs.font_id &&
+           lhs.advance == rhs.advance &&
+           lhs.color_top == rhs.color_top &&
+           lhs.color_bot == rhs.color_bot &&
+           lhs.outline_color_top == rhs.outline_color_top &&
+           lhs.outline_color_bot == rhs.outline_color_bot &&
+           lhs.outline_width == rhs.outline_width &&
+           lhs.softness == rhs.softness &&
+           lhs.scale == rhs.scale &&
+           lhs.leaning == rhs.leaning &&
+           lhs.opacity == rhs.opacity &&
+           lhs.wrap_width == rhs.wrap_width &&
+           lhs.alignment == rhs.alignment &&
+           lhs.overflow == rhs.overflow &&
+           lhs.line_height_mode == rhs.line_height_mode &&
+           lhs.case_mode == rhs.case_mode &&
+           lhs.outline_advance == rhs.outline_advance &&
+           lhs.kerning_enabled == rhs.kerning_enabled;
+}
+
+template<typename T>
+size_t get_capacity_bytes(const std::vector<T>& v) noexcept
+{
+    return v.capacity() * sizeof(T);
+}
+
+size_t get_size_in_bytes(const text_layout& layout, const std::string& utf8_text) noexcept
+{
+    size_t bytes = sizeof(entry) + sizeof(text_layout) + utf8_text.capacity();
+    bytes += get_capacity_bytes(layout.lines);
+    for(const auto& line : layout.lines)
+    {
+        bytes += get_capacity_bytes(line);
+    }
+    bytes += get_capacity_bytes(layout.lines_metrics);
+    bytes += get_capacity_bytes(layout.unicode_text);
+    bytes += get_capacity_bytes(layout.cap_scales);
+    bytes += get_capacity_bytes(layout.geometry);
+    return bytes;
+}
+
+void erase(cache_state& state, std::list<entry>::iterator it)
+{
+    state.bytes -= it->bytes;
+    state.entries_by_hash.erase(it->hash);
+    state.entries.erase(it);
+}
+
+void evict(cache_state& state, size_t max_bytes)
+{
+    while(state.bytes > max_bytes && !state.entries.empty())
+    {
+        erase(state, std::prev(state.entries.end()));
+        state.stats.evictions++;
+    }
+}
+
+}
+
+void set_budget(size_t bytes)
+{
+    auto& state = get_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    budget = bytes;
+    evict(state, bytes);
+}
+
+size_t get_budget() noexcept
+{
+    return budget;
+}
+
+bool is_enabled() noexcept
+{
+    return budget > 0;
+}
+
+text_layout_ptr find(const text_layout_key& key, const std::string& utf8_text)
+{
+    const auto hash = get_hash(key, utf8_text);
+
+    auto& state = get_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    auto found = state.entries_by_hash.find(hash);
+    if(found == state.entries_by_hash.end())
+    {
+        state.stats.misses++;
+        return nullptr;
+    }
+
+    auto it = found->second;
+    if(it->key.weak_font.expired())
+    {
+        // the font is gone, so are all the layouts made with it
+        erase(state, it);
+        state.stats.misses++;
+        return nullptr;
+    }
+
+    if(!is_equal(it->key, key) || it->utf8_text != utf8_text)
+    {
+        state.stats.misses++;
+        return nullptr;
+    }
+
+    state.entries.splice(state.entries.begin(), state.entries, it);
+    state.stats.hits++;
+    return it->layout;
+}
+
+text_layout_ptr insert(const text_layout_key& key, const std::string& utf8_text, text_layout&& layout)
+{
+    // the buffers were reserved for laying out, not for keeping
+    for(auto& line : layout.lines)
+    {
+        line.shrink_to_fit();
+    }
+    layout.lines.shrink_to_fit();
+    layout.lines_metrics.shrink_to_fit();
+    layout.unicode_text.shrink_to_fit();
+    layout.cap_scales.shrink_to_fit();
+    layout.geometry.shrink_to_fit();
+
+    const auto bytes = get_size_in_bytes(layout, utf8_text);
+    auto result = std::make_shared<text_layout>(std::move(layout));
+
+    const auto hash = get_hash(key, utf8_text);
+
+    auto& state = get_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    if(bytes > budget)
+    {
+        return result;
+    }
+
+    // replaces an entry with the same hash, be it the same key or a collision
+    auto found = state.entries_by_hash.find(hash);
+    if(found != state.entries_by_hash.end())
+    {
+        erase(state, found->second);
+    }
+
+    evict(state, budget - bytes);
+
+    entry e{};
+    e.key = key;
+    e.utf8_text = utf8_text;
+    e.layout = result;
+    e.hash = hash;
+    e.bytes = bytes;
+    state.entries.emplace_front(std::move(e));
+    state.entries_by_hash.emplace(hash, state.entries.begin());
+    state.bytes += bytes;
+
+    return result;
+}
+
+void clear()
+{
+    auto& state = get_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    state.entries_by_hash.clear();
+    state.entries.clear();
+    state.bytes = 0;
+}
+
+text_layout_cache_stats get_stats()
+{
+    auto& state = get_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    auto stats = state.stats;
+    stats.entries = state.entries.size();
+    stats.bytes = state.bytes;
+    stats.budget = budget;
+    return stats;
+}
+
+void reset_stats()
+{
+    auto& state = get_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    state.stats = {};
+}
+
+}
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "text.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace gfx
+{
+
+/// Lines, metrics and geometry of a laid out text.
+/// Shared by all texts with the same key and never modified once cached.
+struct text_layout
+{
+    std::vector<std::vector<uint32_t>> lines;
+    std::vector<line_metrics> lines_metrics;
+    std::vector<uint32_t> unicode_text;
+    std::vector<float> cap_scales;
+    std::vector<vertex_2d> geometry;
+
+    frect rect{};
+    uint32_t chars{};
+    /// the wrap width after the layout, it is widened for unbreakable words
+    float wrap_width{};
+    /// vertical alignment offset applied to the metrics
+    float align_y{};
+};
+using text_layout_ptr = std::shared_ptr<const text_layout>;
+
+/// Everything except the utf8 text which the layout and the geometry depend on
+struct text_layout_key
+{
+    const font* font_id{};
+    /// an expired font makes the key stale even if its address is reused
+    font_weak_ptr weak_font{};
+
+    math::vec2 advance{};
+    color color_top{};
+    color color_bot{};
+    color outline_color_top{};
+    color outline_color_bot{};
+    float outline_width{};
+    float softness{};
+    float scale{};
+    float leaning{};
+    float opacity{};
+    float wrap_width{};
+    align_t alignment{};
+    text::overflow_type overflow{};
+    text::line_height_behaviour line_height_mode{};
+    text::case_type case_mode{};
+    bool outline_advance{};
+    bool kerning_enabled{};
+};
+
+struct text_layout_cache_stats
+{
+    size_t hits{};
+    size_t misses{};
+    size_t evictions{};
+    size_t entries{};
+    size_t bytes{};
+    size_t budget{};
+};
+
+/// Process wide least recently used cache of text layouts. Texts built anew
+/// every frame with the same content and style share the cached layout
+/// instead of laying it out again. All functions are thread safe.
+namespace text_layout_cache
+{
+
+/// The cache is disabled with a budget of 0, which is the default.
+/// Shrinking the budget evicts the least recently used layouts.
+void set_budget(size_t bytes);
+size_t get_budget() noexcept;
+bool is_enabled() noexcept;
+
+/// Returns nullptr on a miss
+text_layout_ptr find(const text_layout_key& key, const std::string& utf8_text);
+
+/// Takes the buffers of the layout and returns the cached one.
+/// A layout larger than the whole budget is returned without being cached.
+text_layout_ptr insert(const text_layout_key& key, const std::string& utf8_text, text_layout&& layout);
+
+void clear();
+
+text_layout_cache_stats get_stats();
+void reset_stats();
+
+}
+
+}
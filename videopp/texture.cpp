@@ -125,7 +125,7 @@ namespace gfx
             gl_call(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_, 0));
 
             GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-            gl_call(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+            rend_.set_old_framebuffer();
             if(status != GL_FRAMEBUFFER_COMPLETE)
             {
                 throw gfx::exception("Cannot create FBO. GL ERROR CODE: " + std::to_string(status));
@@ -85,7 +85,7 @@ font_info create_font(const std::string& id, fnt::font_atlas& atlas, fnt::font_i
 
     font_info f;
     f.glyphs = std::move(font->glyphs);
-    f.glyph_index = std::move(font->index_lookup);
+    f.glyph_index.assign(font->index_lookup);
 
     if(font->fallback_glyph)
     {
@@ -103,6 +103,7 @@ font_info create_font(const std::string& id, fnt::font_atlas& atlas, fnt::font_i
     f.cap_height = font->cap_height;
     f.line_height = font->line_height;
     f.kernings = std::move(font->kernings);
+    f.compile_kernings();
     f.size = font->font_size;
     f.surface = std::make_unique<surface>(std::move(atlas.tex_pixels_alpha8), atlas.tex_width, atlas.tex_height, pix_type::gray);
     f.sdf_spread = atlas.sdf_spread;
@@ -116,8 +117,7 @@ void add_to_font(font_info& f, fnt::font_info* font)
     f.glyphs.reserve(f.glyphs.size() + font->glyphs.size());
     std::copy(std::begin(font->glyphs), std::end(font->glyphs), std::back_inserter(f.glyphs));
 
-    f.glyph_index.reserve(f.glyph_index.size() + font->index_lookup.size());
-    std::copy(std::begin(font->index_lookup), std::end(font->index_lookup), std::back_inserter(f.glyph_index));
+    f.glyph_index.append(font->index_lookup);
 
     merge_maps(f.kernings, font->kernings);
 
@@ -205,6 +205,7 @@ font_info create_font_from_description(const std::vector<T>& descs,
     {
         add_to_font(f, font.get());
     }
+    f.compile_kernings();
 
     f.surface = std::make_unique<surface>(std::move(atlas.tex_pixels_alpha8), atlas.tex_width, atlas.tex_height, pix_type::gray);
     f.sdf_spread = atlas.sdf_spread;
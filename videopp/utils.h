@@ -1,4 +1,6 @@
 #pragma once
+#include <cstdint>
+#include <cstring>
 #include <functional>
 #include <stdexcept>
 #include <vector>
@@ -21,6 +23,45 @@ inline void hash(uint64_t& seed, Arg0&& arg0, Arg1&& arg1, Args&& ...args) noexc
     hash(seed, std::forward<Arg1>(arg1), std::forward<Args>(args)...);
 }
 
+/// Fast non cryptographic hash of a memory block, 8 bytes per step.
+/// Used to key cached text layouts by their utf8 text
+/// and to fingerprint the streams uploaded by the renderer.
+inline uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0) noexcept
+{
+    constexpr uint64_t m0 = 0x9e3779b97f4a7c15ull;
+    constexpr uint64_t m1 = 0xbf58476d1ce4e5b9ull;
+
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    uint64_t h = seed ^ (uint64_t(size) * m0);
+
+    const auto mix = [&](uint64_t k)
+    {
+        k *= m0;
+        k ^= k >> 32;
+        h = (h ^ k) * m1;
+    };
+
+    size_t i = 0;
+    for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        uint64_t k;
+        std::memcpy(&k, bytes + i, sizeof(k));
+        mix(k);
+    }
+
+    if(i < size)
+    {
+        uint64_t k = 0;
+        std::memcpy(&k, bytes + i, size - i);
+        mix(k);
+    }
+
+    h ^= h >> 31;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 29;
+    return h;
+}
+
 }
 
 namespace gfx
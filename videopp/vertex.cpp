@@ -2,8 +2,215 @@
 #include "logger.h"
 #include "detail/utils.h"
 
+#include <algorithm>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define VIDEOPP_AVX
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VIDEOPP_SSE2
+#endif
+
 namespace gfx
 {
+
+namespace
+{
+
+/// The 2d affine part of a transform
+///  x' = a * x + c * y + tx
+///  y' = b * x + d * y + ty
+struct affine_2d
+{
+    float a, b, c, d, tx, ty;
+};
+
+inline bool get_affine_2d(const math::transformf& transform, affine_2d& out) noexcept
+{
+    const auto& m = transform.get_matrix();
+
+    // a projective transform needs the perspective divide
+    if(m[0][3] != 0.0f || m[1][3] != 0.0f || m[3][3] != 1.0f)
+    {
+        return false;
+    }
+
+    out = {m[0][0], m[0][1], m[1][0], m[1][1], m[3][0], m[3][1]};
+    return true;
+}
+
+inline void transform_vertices_scalar(vertex_2d* vertices, size_t count,
+                                      const affine_2d& tr, bool pixel_snap) noexcept
+{
+    for(size_t i = 0; i < count; ++i)
+    {
+        auto& pos = vertices[i].pos;
+        const float x = pos.x;
+        const float y = pos.y;
+        pos.x = tr.a * x + tr.c * y + tr.tx;
+        pos.y = tr.b * x + tr.d * y + tr.ty;
+
+        if(pixel_snap)
+        {
+            pos.x = float(int(pos.x));
+        }
+    }
+}
+
+#ifdef VIDEOPP_SSE2
+/// Transforms two vertices per iteration. Positions are loaded
+/// as [x0, y0, x1, y1] straight from the interleaved vertices.
+inline size_t transform_vertices_sse2(vertex_2d* vertices, size_t count,
+                                      const affine_2d& tr, bool pixel_snap) noexcept
+{
+    const __m128 col_x = _mm_setr_ps(tr.a, tr.b, tr.a, tr.b);
+    const __m128 col_y = _mm_setr_ps(tr.c, tr.d, tr.c, tr.d);
+    const __m128 trans = _mm_setr_ps(tr.tx, tr.ty, tr.tx, tr.ty);
+    const __m128 x_mask = _mm_castsi128_ps(_mm_setr_epi32(-1, 0, -1, 0));
+
+    size_t i = 0;
+    for(; i + 2 <= count; i += 2)
+    {
+        auto* p0 = reinterpret_cast<__m64*>(&vertices[i].pos);
+        auto* p1 = reinterpret_cast<__m64*>(&vertices[i + 1].pos);
+
+        __m128 xy = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), p0), p1);
+        __m128 xx = _mm_shuffle_ps(xy, xy, _MM_SHUFFLE(2, 2, 0, 0));
+        __m128 yy = _mm_shuffle_ps(xy, xy, _MM_SHUFFLE(3, 3, 1, 1));
+        __m128 res = _mm_add_ps(_mm_add_ps(_mm_mul_ps(xx, col_x), _mm_mul_ps(yy, col_y)), trans);
+
+        if(pixel_snap)
+        {
+            __m128 snapped = _mm_cvtepi32_ps(_mm_cvttps_epi32(res));
+            res = _mm_or_ps(_mm_and_ps(x_mask, snapped), _mm_andnot_ps(x_mask, res));
+        }
+
+        _mm_storel_pi(p0, res);
+        _mm_storeh_pi(p1, res);
+    }
+
+    return i;
+}
+#endif
+
+#ifdef VIDEOPP_AVX
+/// Transforms four vertices per iteration.
+inline size_t transform_vertices_avx(vertex_2d* vertices, size_t count,
+                                     const affine_2d& tr, bool pixel_snap) noexcept
+{
+    const __m256 col_x = _mm256_setr_ps(tr.a, tr.b, tr.a, tr.b, tr.a, tr.b, tr.a, tr.b);
+    const __m256 col_y = _mm256_setr_ps(tr.c, tr.d, tr.c, tr.d, tr.c, tr.d, tr.c, tr.d);
+    const __m256 trans = _mm256_setr_ps(tr.tx, tr.ty, tr.tx, tr.ty, tr.tx, tr.ty, tr.tx, tr.ty);
+
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        auto* p0 = reinterpret_cast<__m64*>(&vertices[i].pos);
+        auto* p1 = reinterpret_cast<__m64*>(&vertices[i + 1].pos);
+        auto* p2 = reinterpret_cast<__m64*>(&vertices[i + 2].pos);
+        auto* p3 = reinterpret_cast<__m64*>(&vertices[i + 3].pos);
+
+        __m128 lo = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), p0), p1);
+        __m128 hi = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), p2), p3);
+        __m256 xy = _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+
+        // the shuffles operate within each 128 bit lane
+        __m256 xx = _mm256_shuffle_ps(xy, xy, _MM_SHUFFLE(2, 2, 0, 0));
+        __m256 yy = _mm256_shuffle_ps(xy, xy, _MM_SHUFFLE(3, 3, 1, 1));
+        __m256 res = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(xx, col_x), _mm256_mul_ps(yy, col_y)), trans);
+
+        if(pixel_snap)
+        {
+            __m256 snapped = _mm256_round_ps(res, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+            res = _mm256_blend_ps(res, snapped, 0x55);
+        }
+
+        lo = _mm256_castps256_ps128(res);
+        hi = _mm256_extractf128_ps(res, 1);
+        _mm_storel_pi(p0, lo);
+        _mm_storeh_pi(p1, lo);
+        _mm_storel_pi(p2, hi);
+        _mm_storeh_pi(p3, hi);
+    }
+
+    return i;
+}
+#endif
+
+}
+
+void transform_vertices(vertex_2d* vertices, size_t count, const math::transformf& transform, bool pixel_snap) noexcept
+{
+    affine_2d tr{};
+    if(!get_affine_2d(transform, tr))
+    {
+        for(size_t i = 0; i < count; ++i)
+        {
+            auto& pos = vertices[i].pos;
+            pos = transform.transform_coord(pos);
+
+            if(pixel_snap)
+            {
+                pos.x = float(int(pos.x));
+            }
+        }
+        return;
+    }
+
+    size_t done = 0;
+#if defined(VIDEOPP_AVX)
+    done = transform_vertices_avx(vertices, count, tr, pixel_snap);
+#elif defined(VIDEOPP_SSE2)
+    done = transform_vertices_sse2(vertices, count, tr, pixel_snap);
+#endif
+
+    transform_vertices_scalar(vertices + done, count - done, tr, pixel_snap);
+}
+
+std::size_t get_vertex_stride(vertex_format format) noexcept
+{
+    switch(format)
+    {
+        case vertex_format::compact:
+            return sizeof(vertex_2d_compact);
+        case vertex_format::instance:
+            return sizeof(sprite_instance);
+        default:
+            return sizeof(vertex_2d);
+    }
+}
+
+bool is_compactable(const vertex_2d* vertices, std::size_t count) noexcept
+{
+    for(size_t i = 0; i < count; ++i)
+    {
+        const auto& v = vertices[i];
+        if(v.uv.x < 0.0f || v.uv.x > 1.0f || v.uv.y < 0.0f || v.uv.y > 1.0f || v.tex_idx > 255)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void to_compact_vertices(const vertex_2d* src, std::size_t count, vertex_2d_compact* dst) noexcept
+{
+    for(size_t i = 0; i < count; ++i)
+    {
+        const auto& v = src[i];
+        auto& c = dst[i];
+        c.pos = v.pos;
+        c.uv[0] = uint16_t(v.uv.x * 65535.0f + 0.5f);
+        c.uv[1] = uint16_t(v.uv.y * 65535.0f + 0.5f);
+        c.col = v.col;
+        c.tex_idx = uint8_t(v.tex_idx);
+    }
+}
+
 ////
 /// Vertex array object implementation
 ////
@@ -127,6 +334,18 @@ bool vertex_buffer::update(const void* data, std::size_t offset, std::size_t siz
     return true;
 }
 
+/// Allocate immutable storage which stays mapped for writing
+///     @param size - the byte budget for this buffer
+///     @returns the mapped memory or nullptr
+void* vertex_buffer::reserve_persistent(std::size_t size) noexcept
+{
+    constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    gl_call(glBufferStorage(GL_ARRAY_BUFFER, GLsizeiptr(size), nullptr, flags));
+    reserved_bytes_ = size;
+
+    return glMapBufferRange(GL_ARRAY_BUFFER, 0, GLsizeiptr(size), flags);
+}
+
 /// Bind the hardware vertex buffer to the pipe
 ///     @param as_indices - whether to bind as vertex or index buffer
 void vertex_buffer::bind() const noexcept
@@ -218,6 +437,18 @@ bool index_buffer::update(const void* data, std::size_t offset, std::size_t size
     return true;
 }
 
+/// Allocate immutable storage which stays mapped for writing
+///     @param size - the byte budget for this buffer
+///     @returns the mapped memory or nullptr
+void* index_buffer::reserve_persistent(std::size_t size) noexcept
+{
+    constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    gl_call(glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, GLsizeiptr(size), nullptr, flags));
+    reserved_bytes_ = size;
+
+    return glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, GLsizeiptr(size), flags);
+}
+
 /// Bind the hardware index_buffer to the pipe
 ///     @param as_indices - whether to bind as vertex or index buffer
 void index_buffer::bind() const noexcept
@@ -336,7 +567,7 @@ void vertex_buffer_layout::add<int32_t>(uint32_t count, uint32_t offset, const s
     element.location = glGetAttribLocation(id_, element.atrr.c_str());
 }
 
-void vertex_buffer_layout::bind() const noexcept
+void vertex_buffer_layout::bind(std::size_t base_offset) const noexcept
 {
     for(const auto& element : elements_)
     {
@@ -351,8 +582,61 @@ void vertex_buffer_layout::bind() const noexcept
                                       GLenum(element.attr_type),
                                       GLboolean(element.normalized),
                                       GLsizei(element.stride),
-                                      reinterpret_cast<const GLvoid*>(uintptr_t(element.offset))));
+                                      reinterpret_cast<const GLvoid*>(uintptr_t(base_offset + element.offset))));
+    }
+}
+
+void vertex_buffer_layout::bind_pointers(std::size_t base_offset) const noexcept
+{
+    for(const auto& element : elements_)
+    {
+        if(element.location < 0)
+        {
+            continue;
+        }
+
+        gl_call(glVertexAttribPointer(GLuint(element.location),
+                                      GLint(element.count),
+                                      GLenum(element.attr_type),
+                                      GLboolean(element.normalized),
+                                      GLsizei(element.stride),
+                                      reinterpret_cast<const GLvoid*>(uintptr_t(base_offset + element.offset))));
+    }
+}
+
+std::uint32_t vertex_buffer_layout::get_attributes_mask() const noexcept
+{
+    std::uint32_t mask = 0;
+    for(const auto& element : elements_)
+    {
+        if(element.location >= 0 && element.location < 32)
+        {
+            mask |= std::uint32_t(1) << element.location;
+        }
+    }
+    return mask;
+}
+
+bool vertex_buffer_layout::operator==(const vertex_buffer_layout& rhs) const noexcept
+{
+    if(elements_.size() != rhs.elements_.size() || divisor_ != rhs.divisor_)
+    {
+        return false;
     }
+
+    for(size_t i = 0; i < elements_.size(); ++i)
+    {
+        const auto& lhs_el = elements_[i];
+        const auto& rhs_el = rhs.elements_[i];
+        if(lhs_el.location != rhs_el.location || lhs_el.count != rhs_el.count ||
+           lhs_el.offset != rhs_el.offset || lhs_el.attr_type != rhs_el.attr_type ||
+           lhs_el.stride != rhs_el.stride || lhs_el.normalized != rhs_el.normalized)
+        {
+            return false;
+        }
+    }
+
+    return true;
 }
 
 void vertex_buffer_layout::set_program_id(uint32_t id) noexcept
@@ -371,4 +655,216 @@ void vertex_buffer_layout::unbind() const noexcept
         gl_call(glDisableVertexAttribArray(GLuint(element.location)));
     }
 }
+
+////
+/// Ring buffer implementation
+////
+
+template<typename Buffer>
+ring_buffer<Buffer>::~ring_buffer()
+{
+    // Dimo: this might also crash if called after gl context release
+    destroy();
+}
+
+template<typename Buffer>
+bool ring_buffer<Buffer>::is_supported() noexcept
+{
+    return (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage) &&
+           (GLAD_GL_VERSION_3_2 || GLAD_GL_ARB_sync);
+}
+
+template<typename Buffer>
+bool ring_buffer<Buffer>::create(std::size_t capacity) noexcept
+{
+    destroy();
+
+    if(!is_supported() || capacity == 0)
+    {
+        return false;
+    }
+
+    buffer_.create();
+    buffer_.bind();
+    mapped_ = static_cast<std::uint8_t*>(buffer_.reserve_persistent(capacity));
+    buffer_.unbind();
+
+    if(!mapped_)
+    {
+        buffer_.destroy();
+        return false;
+    }
+
+    capacity_ = capacity;
+    return true;
+}
+
+template<typename Buffer>
+void ring_buffer<Buffer>::destroy() noexcept
+{
+    while(!regions_.empty())
+    {
+        release_front();
+    }
+
+    // deleting the buffer also unmaps it. The driver keeps
+    // the storage alive while the gpu still reads it.
+    buffer_.destroy();
+    mapped_ = nullptr;
+    capacity_ = 0;
+    head_ = 0;
+}
+
+template<typename Buffer>
+std::uint8_t* ring_buffer<Buffer>::allocate(std::size_t size, std::size_t& offset) noexcept
+{
+    if(!mapped_)
+    {
+        return nullptr;
+    }
+
+    if(size == 0)
+    {
+        offset = head_;
+        return mapped_ + head_;
+    }
+
+    reclaim();
+
+    // keeps the regions aligned for any vertex attribute or index type
+    constexpr std::size_t alignment = 16;
+    auto begin = (head_ + alignment - 1) & ~(alignment - 1);
+    if(begin + size > capacity_)
+    {
+        begin = 0;
+    }
+
+    const auto overlaps = [&](std::size_t b, std::size_t e)
+    {
+        for(const auto& r : regions_)
+        {
+            if(b < r.end && r.begin < e)
+            {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    if(begin + size > capacity_ || overlaps(begin, begin + size))
+    {
+        // the gpu still reads this space. Grow instead of waiting for it.
+        if(!grow(size))
+        {
+            return nullptr;
+        }
+        begin = 0;
+    }
+
+    regions_.emplace_back();
+    auto& r = regions_.back();
+    r.begin = begin;
+    r.end = begin + size;
+    head_ = r.end;
+
+    // bytes from the oldest region in flight up to the new one
+    const auto first = regions_.front().begin;
+    const auto in_flight = head_ > first ? head_ - first : capacity_ - first + head_;
+    high_water_mark_ = std::max(high_water_mark_, in_flight);
+
+    offset = begin;
+    return mapped_ + begin;
+}
+
+template<typename Buffer>
+bool ring_buffer<Buffer>::retain(std::size_t offset, std::size_t size) noexcept
+{
+    if(!mapped_)
+    {
+        return false;
+    }
+
+    if(size == 0)
+    {
+        return true;
+    }
+
+    // a region not reclaimed yet cannot have been overwritten
+    const auto end = offset + size;
+    for(const auto& r : regions_)
+    {
+        if(r.begin == offset && r.end == end)
+        {
+            regions_.emplace_back();
+            auto& kept = regions_.back();
+            kept.begin = offset;
+            kept.end = end;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+template<typename Buffer>
+void ring_buffer<Buffer>::fence() noexcept
+{
+    if(regions_.empty() || regions_.back().sync)
+    {
+        return;
+    }
+
+    // one fence for all the regions written since the last one
+    auto sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    for(auto it = regions_.rbegin(); it != regions_.rend() && !it->sync; ++it)
+    {
+        it->sync = sync;
+    }
+}
+
+template<typename Buffer>
+void ring_buffer<Buffer>::reclaim() noexcept
+{
+    while(!regions_.empty())
+    {
+        auto sync = static_cast<GLsync>(regions_.front().sync);
+        if(!sync)
+        {
+            return;
+        }
+
+        auto status = glClientWaitSync(sync, 0, 0);
+        if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        {
+            return;
+        }
+
+        release_front();
+    }
+}
+
+template<typename Buffer>
+void ring_buffer<Buffer>::release_front() noexcept
+{
+    auto sync = regions_.front().sync;
+    regions_.pop_front();
+
+    // regions sharing a fence are adjacent
+    if(sync && (regions_.empty() || regions_.front().sync != sync))
+    {
+        gl_call(glDeleteSync(static_cast<GLsync>(sync)));
+    }
+}
+
+template<typename Buffer>
+bool ring_buffer<Buffer>::grow(std::size_t size) noexcept
+{
+    const auto capacity = std::max(capacity_ * 2, size * 2);
+    log("Growing stream ring buffer to " + std::to_string(capacity) + " bytes.");
+    return create(capacity);
+}
+
+template class ring_buffer<vertex_buffer>;
+template class ring_buffer<index_buffer>;
+
 }
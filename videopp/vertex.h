@@ -3,11 +3,25 @@
 #include "color.h"
 #include "point.h"
 #include <cstdint>
+#include <deque>
 #include <vector>
 
 namespace gfx
 {
 
+/// Vertex formats a program can consume
+enum class vertex_format : uint8_t
+{
+    /// vertex_2d
+    full,
+    /// vertex_2d_compact
+    compact,
+    /// sprite_instance, one per drawn quad
+    instance,
+
+    count
+};
+
 /// Common vertex definition attribute properties
 struct vertex_buffer_element
 {
@@ -31,9 +45,23 @@ public:
 
     template <typename T>
     void add(uint32_t count, uint32_t offset, const std::string& attr, uint32_t stride, bool normalized = false);
-    void bind() const noexcept;
+    /// Binds the attributes. The base offset (in bytes) shifts the start
+    /// of the vertex buffer, so indices can be relative to a vertex range.
+    void bind(std::size_t base_offset = 0) const noexcept;
     void unbind() const noexcept;
 
+    /// Sets only the attribute pointers, the attributes must be enabled.
+    void bind_pointers(std::size_t base_offset = 0) const noexcept;
+    /// Bit per attribute location used by the layout
+    std::uint32_t get_attributes_mask() const noexcept;
+
+    /// Attributes of layouts with a non zero divisor advance once per
+    /// that many instances instead of once per vertex.
+    void set_divisor(std::uint32_t divisor) noexcept { divisor_ = divisor; }
+    std::uint32_t get_divisor() const noexcept { return divisor_; }
+
+    bool operator==(const vertex_buffer_layout& rhs) const noexcept;
+
     inline operator bool() const noexcept
     {
         return id_ != 0 && !elements_.empty();
@@ -42,6 +70,7 @@ public:
 private:
     std::vector<vertex_buffer_element> elements_;
     uint32_t id_ = 0;
+    uint32_t divisor_ = 0;
 };
 
 /// Specializations for pushing data to vertex_buffer_layout
@@ -71,6 +100,55 @@ struct vertex_2d
     uint32_t tex_idx{};
 };
 
+/// A compact vertex definition for programs that don't
+/// use the extra color and extra data.
+struct vertex_2d_compact
+{
+    math::vec2 pos{0.0f, 0.0f}; // 2d position
+    uint16_t uv[2]{};           // 2d texture coordinates normalized to 16 bits
+    color col{0, 0, 0, 0};      // 32bit RGBA color
+    uint8_t tex_idx{};
+    uint8_t padding[3]{};
+};
+
+static_assert(sizeof(vertex_2d_compact) == 20, "vertex_2d_compact should be 20 bytes");
+
+/// A sprite drawn as an instance of a unit quad. The corners are
+/// pos, pos + axis_x, pos + axis_x + axis_y and pos + axis_y,
+/// which covers both plain rects and 2x3 affine transforms.
+struct sprite_instance
+{
+    math::vec2 pos{0.0f, 0.0f};    // top left corner
+    math::vec2 axis_x{0.0f, 0.0f}; // top edge
+    math::vec2 axis_y{0.0f, 0.0f}; // left edge
+    uint16_t uv[4]{};              // min and max texture coordinates normalized to 16 bits
+    color col{0, 0, 0, 0};         // 32bit RGBA color
+    uint8_t tex_idx{};
+    uint8_t padding[3]{};
+};
+
+static_assert(sizeof(sprite_instance) == 40, "sprite_instance should be 40 bytes");
+
+/// Size of a vertex in the given format
+std::size_t get_vertex_stride(vertex_format format) noexcept;
+
+/// Checks whether the vertices can be stored in the compact
+/// format without losing data (texture coordinates in [0, 1]).
+bool is_compactable(const vertex_2d* vertices, std::size_t count) noexcept;
+
+/// Converts vertices to the compact format.
+void to_compact_vertices(const vertex_2d* src, std::size_t count, vertex_2d_compact* dst) noexcept;
+
+//-----------------------------------------------------------------------------
+/// Transforms the positions of the vertices in bulk. Affine 2d transforms
+/// take a vectorized path, anything else falls back to a full transform.
+/// Pixel snapping truncates the resulting x coordinate.
+//-----------------------------------------------------------------------------
+void transform_vertices(vertex_2d* vertices,
+                        size_t count,
+                        const math::transformf& transform,
+                        bool pixel_snap = false) noexcept;
+
 class vertex_array_object
 {
 public:
@@ -87,6 +165,8 @@ public:
     void bind() const noexcept;
     void unbind() const noexcept;
 
+    uint32_t get_id() const noexcept { return id_; }
+
 private:
     uint32_t id_ = 0;
 };
@@ -110,9 +190,15 @@ public:
     /// Upload new vertices to the vertex buffer
     bool update(const void* data, std::size_t offset, std::size_t size, bool mapped = false) const noexcept;
 
+    /// Allocate immutable storage which stays mapped for writing.
+    /// The buffer must be bound. Returns the mapped memory or nullptr.
+    void* reserve_persistent(std::size_t size) noexcept;
+
     void bind() const noexcept;
     void unbind() const noexcept;
 
+    uint32_t get_id() const noexcept { return id_; }
+
 private:
     mutable std::size_t reserved_bytes_ = 0;
     uint32_t id_ = 0;
@@ -137,14 +223,88 @@ public:
     /// Upload new vertices to the index_buffer
     bool update(const void* data, std::size_t offset, std::size_t size, bool mapped = false) const noexcept;
 
+    /// Allocate immutable storage which stays mapped for writing.
+    /// The buffer must be bound. Returns the mapped memory or nullptr.
+    void* reserve_persistent(std::size_t size) noexcept;
+
     void bind() const noexcept;
     void unbind() const noexcept;
 
+    uint32_t get_id() const noexcept { return id_; }
+
 private:
     mutable std::size_t reserved_bytes_ = 0;
     uint32_t id_ = 0;
 };
 
+/// A persistently mapped buffer written as a ring. Regions written
+/// for a draw are fenced and reused once the gpu is done with them.
+/// When the space is still in use, the ring grows instead of waiting.
+template<typename Buffer>
+class ring_buffer
+{
+public:
+    ring_buffer() = default;
+    ~ring_buffer();
+    ring_buffer(const ring_buffer&) = delete;
+    ring_buffer& operator=(const ring_buffer&) = delete;
+
+    /// Whether the context supports persistent mapping and fences
+    static bool is_supported() noexcept;
+
+    /// Create the storage
+    bool create(std::size_t capacity) noexcept;
+
+    /// Destroy the storage and the pending fences
+    void destroy() noexcept;
+
+    /// Allocate a region to write into
+    ///     @param size - bytes to allocate
+    ///     @param offset - byte offset of the region in the buffer
+    ///     @return mapped memory of the region or nullptr
+    std::uint8_t* allocate(std::size_t size, std::size_t& offset) noexcept;
+
+    /// Keep a region allocated earlier in use by the next draws.
+    /// It is fenced again by the next fence.
+    ///     @param offset - byte offset of the region in the buffer
+    ///     @param size - bytes of the region
+    ///     @return false if the region was already reclaimed
+    bool retain(std::size_t offset, std::size_t size) noexcept;
+
+    /// Fence the regions allocated since the last fence.
+    /// Call after the draws reading them are issued.
+    void fence() noexcept;
+
+    const Buffer& get_buffer() const noexcept { return buffer_; }
+    std::size_t get_capacity() const noexcept { return capacity_; }
+    /// Most bytes in flight at once. A ring of this size never grows.
+    std::size_t get_high_water_mark() const noexcept { return high_water_mark_; }
+
+    inline operator bool() const noexcept
+    {
+        return mapped_ != nullptr;
+    }
+
+private:
+    struct region
+    {
+        void* sync{};
+        std::size_t begin{};
+        std::size_t end{};
+    };
+
+    void reclaim() noexcept;
+    void release_front() noexcept;
+    bool grow(std::size_t size) noexcept;
+
+    Buffer buffer_;
+    std::uint8_t* mapped_{};
+    std::deque<region> regions_;
+    std::size_t capacity_{};
+    std::size_t head_{};
+    std::size_t high_water_mark_{};
+};
+
 
 
 } // namespace gfx